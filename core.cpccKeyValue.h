@@ -27,6 +27,7 @@
 /** 
     A small and portable (cross platform) C++ class 
 	Provides a std:map that can store any (primitive type) value
+	cpccKeyValue keeps the keys in a std::map, cpccKeyValueFlat in a cpccFlatHashMap. See data.cpccKeyValueStr.h
 		
 */
 
@@ -34,12 +35,15 @@
 
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 //
-//		class cpccKeyValue declaration
+//		class cpccKeyValueT declaration
 //
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 
-class cpccKeyValue: private strConvertionsV3, public cpccKeyValueStr
+template <typename tContainer>
+class cpccKeyValueT: private strConvertionsV3, public cpccKeyValueStrT<tContainer>
 {
+private:
+    typedef cpccKeyValueStrT<tContainer>  tBase;
 
 public:		// get functions
 
@@ -49,12 +53,15 @@ public:		// get functions
     template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value, T>::type >
     T    get(const cpcc_char *aKey, const T aDefaultValue) const
     {
-        cpcc_string valueStr(get(aKey, _T("not-fOunD-there")));
-        if (valueStr.compare(_T("not-fOunD-there")) == 0)
+        const cpccTypedValue *value = this->findValue(aKey);
+        if (!value)
             return aDefaultValue;
-        
-        // if (!std::is_same<T, cpcc_char *>::value)
-        return fromString(valueStr.c_str(), aDefaultValue);
+
+        // bools and numbers that were set, or loaded, as such are not parsed again
+        T result = aDefaultValue;
+        if (value->getAs(result))
+            return result;
+        return fromString(value->getText().c_str(), aDefaultValue);
     }
     
 public:		// set functions
@@ -63,8 +70,8 @@ public:		// set functions
     // inline void set_impl(const cpcc_char* aKey, const cpcc_char* aValue);
 	
 	template <typename T>
-	void		set(const cpcc_char   *aKey, const T aValue)              	{ cpccKeyValueStr::set(aKey, toString(aValue).c_str()) ;  }
-	void     set(const cpcc_char   *aKey, const cpcc_string &aValue)		{ cpccKeyValueStr::set(aKey, aValue.c_str());  }
+	void		set(const cpcc_char   *aKey, const T aValue)              	{ tBase::set(aKey, cpccTypedValue::from(aValue)) ;  }
+	void     set(const cpcc_char   *aKey, const cpcc_string &aValue)		{ tBase::set(aKey, aValue.c_str());  }
     // void        set(const cpcc_string &aKey, const cpcc_string &aDefaultValue) { m_map[aKey] = aDefaultValue; }
     // void		set(const cpcc_char   *aKey, const cpcc_char *aValue)		{ set(aKey, aValue);  }
 
@@ -79,40 +86,41 @@ public: // load from string functions
 
 };
 
+
+typedef cpccKeyValueT<cpccKeyValueSortedMap>    cpccKeyValue;
+typedef cpccKeyValueT<cpccKeyValueFlatMap>      cpccKeyValueFlat;
+
+
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 //
-//		class cpccKeyValue implementation
+//		class cpccKeyValueT implementation
 //
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 
 
 
-inline const cpcc_string	cpccKeyValue::get(const cpcc_char* aKey, const cpcc_char* aDefaultValue) const
+template <typename tContainer>
+inline const cpcc_string	cpccKeyValueT<tContainer>::get(const cpcc_char* aKey, const cpcc_char* aDefaultValue) const
 {
-    if (aKey)
-    {
-        if (keyExists(aKey))
-            return cpccKeyValueStr::get(aKey);
-        /*
-        auto searchIterator = m_map.find(aKey);
-        if (searchIterator != m_map.end())
-            return searchIterator->second;
-         */
-    }
+    const cpccTypedValue *value = this->findValue(aKey);
+    if (value)
+        return value->getText();
 
     return aDefaultValue ? aDefaultValue : _T("");
 }
 
 
-inline const int cpccKeyValue::loadFromSimpleString(const cpcc_char* aKeyValueList)
+template <typename tContainer>
+inline const int cpccKeyValueT<tContainer>::loadFromSimpleString(const cpcc_char* aKeyValueList)
 {
-    clear();
-    dataHasChanged();
+    this->clear();
+    this->dataHasChanged();
     return addFromSimpleString(aKeyValueList);
 }
 
 
-inline const int cpccKeyValue::addFromSimpleString(const cpcc_char* aKeyValueList)
+template <typename tContainer>
+inline const int cpccKeyValueT<tContainer>::addFromSimpleString(const cpcc_char* aKeyValueList)
 {
     // see also:
     // https://stackoverflow.com/questions/27006958/parsing-key-value-pairs-from-a-string-in-caz
@@ -143,7 +151,7 @@ inline const int cpccKeyValue::addFromSimpleString(const cpcc_char* aKeyValueLis
 
         // todo: na balo kai to \r eite na to sbiso eksarxis
         val_end = s.find(_T('\n'), val_pos);
-        m_map[s.substr(key_pos, key_end - key_pos)] = s.substr(val_pos, val_end - val_pos);
+        this->m_map[s.substr(key_pos, key_end - key_pos)] = s.substr(val_pos, val_end - val_pos);
         ++nPairs;
 
         key_pos = val_end;
@@ -151,7 +159,8 @@ inline const int cpccKeyValue::addFromSimpleString(const cpcc_char* aKeyValueLis
             ++key_pos;
     }
 
-    dataHasChanged();
+    ++this->m_generation;
+    this->dataHasChanged();
     return nPairs;
 
     /*
@@ -222,3 +231,40 @@ TEST_RUN(cpccKeyValue_test)
 }
 
 
+TEST_RUN(cpccKeyValue_typedValuesTest)
+{
+    const bool skipThisTest = false;
+
+    if (skipThisTest)
+    {
+        TEST_ADDNOTE("Test skipped");
+        return;
+    }
+
+    cpccKeyValue testSubject;
+    testSubject.set(_T("int"), -42);
+    testSubject.set(_T("double"), 0.1);
+    testSubject.set(_T("bool"), true);
+    testSubject.set(_T("big unsigned"), 18446744073709551615ULL);
+    TEST_EXPECT(testSubject.findValue(_T("int"))->getType() == cpccTypedValue::tType::integer, _T("#7280a: the integer is not kept as such"));
+    TEST_EXPECT(testSubject.get(_T("int"), 0) == -42 && testSubject.get(_T("int"), 0.0) == -42.0, _T("#7280b: typed read of an integer"));
+    TEST_EXPECT(testSubject.get(_T("int"), 7u) == static_cast<unsigned int>(-42), _T("#7280c: a negative value read as unsigned, as the stream does"));
+    TEST_EXPECT(testSubject.get(_T("double"), 1.0) == 0.1 && testSubject.get(_T("double"), 5) == 0, _T("#7280d: typed read of a real"));
+    TEST_EXPECT(testSubject.get(_T("big unsigned"), 0ULL) == 18446744073709551615ULL, _T("#7280e: unsigned over the int64 range"));
+
+    // the text is the same as the text of strConvertionsV3::toString()
+    TEST_EXPECT(testSubject.get(_T("int"), _T("")) == _T("-42") && testSubject.get(_T("bool"), _T("")) == _T("yes"), _T("#7280f: text of typed values"));
+    TEST_EXPECT(testSubject.get(_T("double"), _T("")) == strConvertionsV3::toString(0.1), _T("#7280g: text of a real"));
+
+    // loaded texts become typed only if their text is the exact text of the value
+    testSubject.loadFromSimpleString(_T("a=123\nb=0123\nc=true\nd=2.5\ne=2.50\nf=no\ng=-0\nh=9223372036854775808"));
+    TEST_EXPECT(testSubject.findValue(_T("a"))->getType() == cpccTypedValue::tType::integer, _T("#7280h: integer text"));
+    TEST_EXPECT(testSubject.findValue(_T("d"))->getType() == cpccTypedValue::tType::real, _T("#7280i: real text"));
+    TEST_EXPECT(testSubject.findValue(_T("f"))->getType() == cpccTypedValue::tType::boolean, _T("#7280j: bool text"));
+    TEST_EXPECT(testSubject.findValue(_T("b"))->getType() == cpccTypedValue::tType::text && testSubject.findValue(_T("e"))->getType() == cpccTypedValue::tType::text
+            && testSubject.findValue(_T("g"))->getType() == cpccTypedValue::tType::text && testSubject.findValue(_T("h"))->getType() == cpccTypedValue::tType::text, _T("#7280k: texts that must stay texts"));
+    TEST_EXPECT(testSubject.get(_T("b"), _T("")) == _T("0123") && testSubject.get(_T("b"), 0) == 123, _T("#7280l: a text is kept as it is, and parsed as before"));
+    TEST_EXPECT(testSubject.get(_T("c"), false) && !testSubject.get(_T("f"), true) && testSubject.get(_T("a"), false) == false, _T("#7280m: bool reads"));
+    TEST_EXPECT(testSubject.get(_T("e"), 0.0) == 2.5 && testSubject.get(_T("d"), 0) == 2, _T("#7280n: real reads"));
+}
+
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <map>
+#include <set>
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -23,6 +24,7 @@
 #include "cpccUnicodeSupport.h"
 #include "io.cpccLog.h"
 #include "io.cpccFileSystemMini.h"
+#include "fs.cpccDirectory.h"
 #include "io.cpccSettings.h"
 
 //////////////////////////////////////////////
@@ -84,13 +86,11 @@ public:
 		if (!aKey)
 			return "null key to translate";
 
-		if (m_lookupTable.size() == 0)
-			setTranslation(aKey, aKey); // add a  phantom translation so it can return a static reference to the table
+		auto found = m_lookupTable.find(aKey);
+		if (found == m_lookupTable.end()) // not found
+			found = m_lookupTable.emplace(aKey, aKey).first; // add a  phantom translation so it can return a static reference to the table
 
-		if (m_lookupTable.find(aKey) == m_lookupTable.end()) // not found
-			setTranslation(aKey, aKey); // add a  phantom translation so it can return a static reference to the table
-
-		return m_lookupTable[aKey].c_str();
+		return found->second.c_str();
 	}
 		
 	/// aFileStem should be like: <appname>
@@ -101,7 +101,8 @@ public:
 		infoLog().addf(_T("loading translations from file:%s"), aFilename.c_str());
         
         cpccSettings translationFile(aFilename.c_str());
-        m_lookupTable = translationFile.getMap();
+        for (const auto &element : translationFile.getMap())
+            m_lookupTable[element.first] = element.second.getText();
 
         /*
 		cpcc_string line;
@@ -173,6 +174,20 @@ private:
 		filename += _T(".txt");
 		return filename;
 	}
+
+	// the file systems of Windows and macOS are case insensitive
+	static cpcc_string		filenameKey(const cpcc_string &aFilename)
+	{
+	#if defined(_WIN32) || defined(__APPLE__)
+		cpcc_string result(aFilename);
+		for (auto &c : result)
+			if ((c >= _T('A')) && (c <= _T('Z')))
+				c = c - _T('A') + _T('a');
+		return result;
+	#else
+		return aFilename;
+	#endif
+	}
     
 public:		// ctors,  factory
 
@@ -230,6 +245,16 @@ public:
 		if ((m_folderWithTranslations.length() == 0) || (m_translationFileStem.length() == 0))
 			warningLog().add("getInstalledLanguages() called but m_folderWithTranslations or m_translationFileStem is empty");
 
+		// one listing of the folder, instead of one fileExists() per language
+		const cpcc_string anyFilename(composeFilename(_T(""), m_folderWithTranslations, m_translationFileStem));
+		const size_t nameStart = anyFilename.find_last_of(_T("/\\")) + 1;	// 0 if there is no folder
+		std::set<cpcc_string> filesInFolder;
+		cpccDirectoryIterator folder((nameStart > 0) ? anyFilename.substr(0, nameStart).c_str() : _T("."));
+		cpccDirEntry entry;
+		while (folder.next(entry))
+			if (!entry.isFolder())
+				filesInFolder.insert(filenameKey(entry.name));
+
 		cpcc_string filename, languagesFound;
 		// reverse iterate std::map and erase the elements that do not match. 
 		// STL does not provide a simple solution to this simple problem.
@@ -240,7 +265,7 @@ public:
 		{
 			filename = composeFilename(rIter->first, m_folderWithTranslations, m_translationFileStem);
 
-			if (!cpccFileSystemMini::fileExists(filename.c_str()))
+			if (filesInFolder.count(filenameKey(filename.substr(nameStart))) == 0)
 			{
 				++rIter;
 				rIter = cLanguageList::reverse_iterator(m_languagesTable.erase(rIter.base())); 
@@ -155,6 +155,7 @@ typedef		std::basic_ofstream<TCHAR>	    cpcc_ofstream;
 	#define		cpcc_fscanf			fwscanf
 	#define		cpcc_fopen			_wfopen
 	#define		cpcc_rmdir			_wrmdir
+	#define		cpcc_remove			_wremove
 	#define		cpcc_tmpnam_s		_wtmpnam_s
 	#define		cpcc_strlen			_tcslen
 	//  stricmp, wcsicmp: These POSIX functions are deprecated. Use the ISO C++ conformant _stricmp, _wcsicmp,
@@ -187,6 +188,7 @@ typedef		std::basic_ofstream<TCHAR>	    cpcc_ofstream;
 	#define		cpcc_fscanf			fscanf
 	#define		cpcc_fopen			fopen
 	#define		cpcc_rmdir			rmdir
+	#define		cpcc_remove			remove
 	#define		cpcc_tmpnam_s		tmpnam_s        // todo: never use tmpnam
 	#define		cpcc_strlen			strlen
 	#define		cpcc_stricmp		_stricmp
@@ -0,0 +1,319 @@
+/*  *****************************************
+ *  File:		data.cpccFlatHashMap.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				hash map with string keys in flat arrays, with lookup without a temporary string
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L))
+	#include <string_view>
+	#define cpccFlatHashMap_HAS_STRING_VIEW
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+
+/*
+	The subset of std::map that cpccKeyValueStr uses, for string keys:
+		the elements (key, value) are in one vector, in no particular order,
+		and an open addressing table (linear probing, at most half full) has the hash and the position of each element.
+	A lookup reads one or two 8 byte slots and compares one key. find(), count() and erase() take a const tChar *,
+	a (pointer, length) or a std::basic_string_view and do not allocate.
+
+	Unlike std::map:
+		insert() and erase() move elements, so they invalidate the iterators and the pointers to the elements
+		the iteration is not in the order of the keys: sortedElements() returns them in the order of the keys
+		the key of an element (first) must not be changed through an iterator
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccFlatHashMap
+//
+///////////////////////////////////////////////////////////////////////////////
+template <typename tValue, typename tChar = cpcc_char>
+class cpccFlatHashMap
+{
+public:
+	typedef std::basic_string<tChar>			key_type;
+	typedef tValue								mapped_type;
+	typedef std::pair<key_type, tValue>			value_type;
+	typedef size_t								size_type;
+	typedef typename std::vector<value_type>::iterator			iterator;
+	typedef typename std::vector<value_type>::const_iterator	const_iterator;
+
+private:
+	struct tSlot
+	{
+		uint32_t	hash = 0;
+		uint32_t	position = 0;	// 0: empty, else the position of the element + 1
+	};
+
+	std::vector<value_type>	m_elements;
+	std::vector<tSlot>		m_slots;	// empty, or a power of 2
+
+public:		// std::map like functions
+
+	inline bool				empty(void) const { return m_elements.empty(); }
+	inline size_type		size(void) const { return m_elements.size(); }
+	inline iterator			begin(void) { return m_elements.begin(); }
+	inline iterator			end(void) { return m_elements.end(); }
+	inline const_iterator	begin(void) const { return m_elements.begin(); }
+	inline const_iterator	end(void) const { return m_elements.end(); }
+
+	void clear(void)
+	{
+		m_elements.clear();
+		m_slots.clear();
+	}
+
+	void swap(cpccFlatHashMap &other)
+	{
+		m_elements.swap(other.m_elements);
+		m_slots.swap(other.m_slots);
+	}
+
+	void reserve(const size_type aCount)
+	{
+		m_elements.reserve(aCount);
+		if (aCount * 2 > m_slots.size())
+			rehash(aCount * 2);
+	}
+
+	iterator		find(const tChar *aKey, const size_t aLength)		{ return positionToIterator(findSlot(aKey, aLength)); }
+	const_iterator	find(const tChar *aKey, const size_t aLength) const	{ return positionToIterator(findSlot(aKey, aLength)); }
+	iterator		find(const tChar *aKey)				{ return find(aKey, std::char_traits<tChar>::length(aKey)); }
+	const_iterator	find(const tChar *aKey) const		{ return find(aKey, std::char_traits<tChar>::length(aKey)); }
+	iterator		find(const key_type &aKey)			{ return find(aKey.data(), aKey.length()); }
+	const_iterator	find(const key_type &aKey) const	{ return find(aKey.data(), aKey.length()); }
+#ifdef cpccFlatHashMap_HAS_STRING_VIEW
+	iterator		find(const std::basic_string_view<tChar> aKey)			{ return find(aKey.data(), aKey.length()); }
+	const_iterator	find(const std::basic_string_view<tChar> aKey) const	{ return find(aKey.data(), aKey.length()); }
+#endif
+
+	size_type count(const tChar *aKey) const		{ return (find(aKey) != end()) ? 1 : 0; }
+	size_type count(const key_type &aKey) const		{ return (find(aKey) != end()) ? 1 : 0; }
+
+	tValue &operator[](const key_type &aKey)	{ return insertKey(aKey.data(), aKey.length()).first->second; }
+	tValue &operator[](const tChar *aKey)		{ return insertKey(aKey, std::char_traits<tChar>::length(aKey)).first->second; }
+
+	/// as std::map::emplace(): an existing value is not replaced
+	template <typename tArg>
+	std::pair<iterator, bool> emplace(const key_type &aKey, tArg &&aValue)	{ return emplace(aKey.data(), aKey.length(), std::forward<tArg>(aValue)); }
+	template <typename tArg>
+	std::pair<iterator, bool> emplace(const tChar *aKey, tArg &&aValue)		{ return emplace(aKey, std::char_traits<tChar>::length(aKey), std::forward<tArg>(aValue)); }
+
+	template <typename tArg>
+	std::pair<iterator, bool> emplace(const tChar *aKey, const size_t aLength, tArg &&aValue)
+	{
+		const std::pair<iterator, bool> result(insertKey(aKey, aLength));
+		if (result.second)
+			result.first->second = std::forward<tArg>(aValue);
+		return result;
+	}
+
+	std::pair<iterator, bool> insert(const value_type &aElement) { return emplace(aElement.first, aElement.second); }
+
+	template <typename tInputIterator>
+	void insert(tInputIterator aFirst, const tInputIterator aLast)
+	{
+		for (; aFirst != aLast; ++aFirst)
+			emplace(aFirst->first, aFirst->second);
+	}
+
+	size_type erase(const key_type &aKey) { return erase(aKey.data(), aKey.length()); }
+	size_type erase(const tChar *aKey) { return erase(aKey, std::char_traits<tChar>::length(aKey)); }
+
+	size_type erase(const tChar *aKey, const size_t aLength)
+	{
+		const size_t slot = findSlot(aKey, aLength);
+		if (slot == notFound)
+			return 0;
+		const size_t position = m_slots[slot].position - 1;
+		removeSlot(slot);
+
+		// the last element fills the gap, and its slot is updated
+		const size_t last = m_elements.size() - 1;
+		if (position != last)
+		{
+			const size_t lastSlot = findSlot(m_elements[last].first.data(), m_elements[last].first.length());
+			m_elements[position] = std::move(m_elements[last]);
+			m_slots[lastSlot].position = static_cast<uint32_t>(position + 1);
+		}
+		m_elements.pop_back();
+		return 1;
+	}
+
+public:		// other functions
+
+	/// the elements in the order of the keys, e.g. to save them in a file that gives the same diffs
+	std::vector<const value_type *> sortedElements(void) const
+	{
+		std::vector<const value_type *> result;
+		result.reserve(m_elements.size());
+		for (const auto &element : m_elements)
+			result.push_back(&element);
+		std::sort(result.begin(), result.end(), [](const value_type *a, const value_type *b) { return a->first < b->first; });
+		return result;
+	}
+
+	static uint32_t hashOf(const tChar *aKey, const size_t aLength)
+	{
+		// FNV-1a, folded to 32 bits
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < aLength; ++i)
+		{
+			hash ^= static_cast<uint64_t>(aKey[i]);
+			hash *= 1099511628211ULL;
+		}
+		return static_cast<uint32_t>(hash ^ (hash >> 32));
+	}
+
+private:
+
+	static const size_t notFound = static_cast<size_t>(-1);
+
+	inline size_t mask(void) const { return m_slots.size() - 1; }
+
+	iterator positionToIterator(const size_t aSlot)
+	{
+		return (aSlot == notFound) ? m_elements.end() : m_elements.begin() + (m_slots[aSlot].position - 1);
+	}
+
+	const_iterator positionToIterator(const size_t aSlot) const
+	{
+		return (aSlot == notFound) ? m_elements.end() : m_elements.begin() + (m_slots[aSlot].position - 1);
+	}
+
+	size_t findSlot(const tChar *aKey, const size_t aLength) const
+	{
+		if (m_elements.empty() || !aKey)
+			return notFound;
+		const uint32_t hash = hashOf(aKey, aLength);
+		for (size_t slot = hash & mask(); m_slots[slot].position; slot = (slot + 1) & mask())
+			if (m_slots[slot].hash == hash)
+			{
+				const key_type &key = m_elements[m_slots[slot].position - 1].first;
+				if ((key.length() == aLength) && (std::char_traits<tChar>::compare(key.data(), aKey, aLength) == 0))
+					return slot;
+			}
+		return notFound;
+	}
+
+	std::pair<iterator, bool> insertKey(const tChar *aKey, const size_t aLength)
+	{
+		const size_t slot = findSlot(aKey, aLength);
+		if (slot != notFound)
+			return std::make_pair(positionToIterator(slot), false);
+
+		if ((m_elements.size() + 1) * 2 > m_slots.size())
+			rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+		const uint32_t hash = hashOf(aKey, aLength);
+		size_t freeSlot = hash & mask();
+		while (m_slots[freeSlot].position)
+			freeSlot = (freeSlot + 1) & mask();
+		m_elements.push_back(value_type(key_type(aKey, aLength), tValue()));
+		m_slots[freeSlot].hash = hash;
+		m_slots[freeSlot].position = static_cast<uint32_t>(m_elements.size());
+		return std::make_pair(m_elements.end() - 1, true);
+	}
+
+	void rehash(size_t aSlots)
+	{
+		size_t nSlots = 16;
+		while (nSlots < aSlots)
+			nSlots *= 2;
+		std::vector<tSlot> slots(nSlots);
+		for (const tSlot &slot : m_slots)
+			if (slot.position)
+			{
+				size_t newSlot = slot.hash & (nSlots - 1);
+				while (slots[newSlot].position)
+					newSlot = (newSlot + 1) & (nSlots - 1);
+				slots[newSlot] = slot;
+			}
+		m_slots.swap(slots);
+	}
+
+	// backward shift: the next slots of the probe sequence move back, so that no lookup stops at the gap
+	void removeSlot(size_t aSlot)
+	{
+		for (size_t next = (aSlot + 1) & mask(); m_slots[next].position; next = (next + 1) & mask())
+		{
+			const size_t home = m_slots[next].hash & mask();
+			if (((next - home) & mask()) >= ((next - aSlot) & mask()))
+			{
+				m_slots[aSlot] = m_slots[next];
+				aSlot = next;
+			}
+		}
+		m_slots[aSlot] = tSlot();
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	cpccFlatHashMap testing
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccFlatHashMap_test)
+{
+	const bool skipThisTest = false;
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	// against std::map, with inserts and erases that wrap around the table and shift the probe sequences
+	cpccFlatHashMap<int> flat;
+	std::map<cpcc_string, int> reference;
+	unsigned int random = 12345;
+	bool same = true;
+	for (int i = 0; i < 20000; ++i)
+	{
+		random = random * 1103515245 + 12345;
+		const cpcc_string key(cpcc_string(_T("k")) + cpcc_to_string((random >> 8) % 700));
+		if ((random >> 4) % 3 == 0)
+			same = (flat.erase(key.c_str()) == reference.erase(key)) && same;
+		else
+			flat[key] = reference[key] = i;
+	}
+	same = same && (flat.size() == reference.size());
+	for (const auto &element : reference)
+	{
+		const auto found = flat.find(element.first.c_str());
+		same = same && (found != flat.end()) && (found->second == element.second);
+	}
+	TEST_EXPECT(same, _T("#7281a: cpccFlatHashMap differs from std::map"));
+
+	const std::vector<const cpccFlatHashMap<int>::value_type *> sorted(flat.sortedElements());
+	TEST_EXPECT((sorted.size() == reference.size()) && std::equal(reference.begin(), reference.end(), sorted.begin(),
+			[](const std::pair<const cpcc_string, int> &a, const cpccFlatHashMap<int>::value_type *b) { return (a.first == b->first) && (a.second == b->second); }),
+		_T("#7281b: sortedElements() is not in the order of the keys"));
+
+	const cpcc_char *text = _T("abc=1");
+	TEST_EXPECT((flat.emplace(_T("abc"), 5).second) && !flat.emplace(_T("abc"), 6).second && (flat.find(text, 3)->second == 5)
+			&& (flat.find(_T("abcd")) == flat.end()), _T("#7281c: emplace() or find() of a part of a text"));
+}
@@ -16,29 +16,74 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <type_traits>
 #include "data.cpccWideCharSupport.h"
+#include "data.cpccTypedValue.h"
+#include "data.cpccFlatHashMap.h"
 
 
 /** 
     A small and portable (cross platform) C++ class 
 	Provides a std:map that can store any (primitive type) value
-		
+	The values are cpccTypedValue: bools and numbers are kept in their native type, see data.cpccTypedValue.h
+
+	The container of the keys is the template parameter:
+		cpccKeyValueSortedMap	std::map
+		cpccKeyValueFlatMap		cpccFlatHashMap: the lookups do not make a temporary string and are about 6 times faster
+								with thousands of keys. See data.cpccFlatHashMap.h and tools/data.cpccKeyValueBenchmark.cpp
+	serialize() and cpccSortedElements() give the keys in their order with both.
 */
 
+
+typedef std::map<std::basic_string<TCHAR>, cpccTypedValue>   cpccKeyValueSortedMap;
+typedef cpccFlatHashMap<cpccTypedValue, TCHAR>                              cpccKeyValueFlatMap;
+
+
+/// the elements of the container in the order of the keys
+template <typename tKey, typename tValue, typename tCompare, typename tAllocator>
+std::vector<const typename std::map<tKey, tValue, tCompare, tAllocator>::value_type *> cpccSortedElements(const std::map<tKey, tValue, tCompare, tAllocator> &aMap)
+{
+    std::vector<const typename std::map<tKey, tValue, tCompare, tAllocator>::value_type *> result;
+    result.reserve(aMap.size());
+    for (const auto &element : aMap)
+        result.push_back(&element);
+    return result;
+}
+
+
+template <typename tValue, typename tChar>
+std::vector<const typename cpccFlatHashMap<tValue, tChar>::value_type *> cpccSortedElements(const cpccFlatHashMap<tValue, tChar> &aMap)
+{
+    return aMap.sortedElements();
+}
+
+
+/// true for the containers that can find a key by a string_view without making a string
+template <typename tContainer>
+struct cpccFindsByStringView : std::false_type { };
+
+template <typename tValue, typename tChar>
+struct cpccFindsByStringView<cpccFlatHashMap<tValue, tChar>> : std::true_type { };
+
+
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 //
-//        class cpccKeyValueStr
+//        class cpccKeyValueStrT
 //
 // /////////////////////////////////////////////////////////////////////////////////////////////////
-class cpccKeyValueStr
+template <typename tContainer>
+class cpccKeyValueStrT
 {
-private:
+public:
     typedef std::basic_string<TCHAR> tStringWN;
-    typedef std::map<tStringWN, tStringWN> tKeysAndValues;
+    typedef tContainer tKeysAndValues;
 
 protected:
     tKeysAndValues    m_map;
+    uint64_t          m_generation = 1;     // a descendant that changes m_map directly must increase it
 
 public:
     
@@ -52,59 +97,94 @@ public:
     const bool          keyExists(const TCHAR* aKey) const;
 
     const tStringWN     get(const TCHAR* aKey) const;
+    /// the value of the key, or NULL. One lookup, for the typed get() functions
+    const cpccTypedValue *findValue(const TCHAR* aKey) const;
+#ifdef cpccFlatHashMap_HAS_STRING_VIEW
+    // only with cpccKeyValueFlatMap. std::map (without a transparent comparator) cannot find a string_view.
+    template <typename tMap = tContainer, typename std::enable_if<cpccFindsByStringView<tMap>::value, int>::type = 0>
+    const cpccTypedValue *findValue(const std::basic_string_view<TCHAR> aKey) const
+    {
+        auto searchIterator = m_map.find(aKey);
+        return (searchIterator != m_map.end()) ? &searchIterator->second : NULL;
+    }
+
+    template <typename tMap = tContainer, typename std::enable_if<cpccFindsByStringView<tMap>::value, int>::type = 0>
+    const bool          keyExists(const std::basic_string_view<TCHAR> aKey) const { return findValue(aKey) != NULL; }
+#endif
     
     void set(const TCHAR* aKey, const TCHAR* aValue);
     void set(const TCHAR* aKey, const tStringWN &aValue) { set(aKey, aValue.c_str()); }
+    void set(const TCHAR* aKey, const cpccTypedValue &aValue);
     const tKeysAndValues &getMap(void) const { return m_map; }
+
+    /// changes on every change of the keys or values, so that a reader can keep the values it parsed
+    /// until the generation changes (e.g. cpccPersistentVar)
+    inline uint64_t     getGeneration(void) const { return m_generation; }
     
     const tStringWN     serialize(const TCHAR* aRecordSeparator, const bool addRecordSeparatorToTheEnd, tEncodingFunc encodingFuncPtr) const;
     
-    bool isEqual(const cpccKeyValueStr & other) const;
+    bool isEqual(const cpccKeyValueStrT & other) const;
     
-    void mergeFrom(const cpccKeyValueStr & other);
+    void mergeFrom(const cpccKeyValueStrT & other);
     
 protected:
     // called when set() functions are called.
     // A descendant of this class can override this function to implement further actions,
     // e.g. saving to a file
     virtual void dataHasChanged(void) { }
+
+    // called when one key was set, or removed (aValue == NULL).
+    // A descendant can override this to save only the changed key. By default it calls dataHasChanged().
+    virtual void keyHasChanged(const TCHAR* aKey, const cpccTypedValue* aValue) { (void) aKey; (void) aValue; dataHasChanged(); }
     
 };
 
 
+typedef cpccKeyValueStrT<cpccKeyValueSortedMap>     cpccKeyValueStr;
+
+
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 //
-//		class cpccKeyValue declaration
+//		class cpccKeyValueStrT implementation
 //
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 
-inline void cpccKeyValueStr::mergeFrom(const cpccKeyValueStr & other)
+template <typename tContainer>
+inline void cpccKeyValueStrT<tContainer>::mergeFrom(const cpccKeyValueStrT & other)
 {
     m_map.insert(other.m_map.begin(), other.m_map.end());
+    ++m_generation;
 }
 
 
-inline bool cpccKeyValueStr::isEqual(const cpccKeyValueStr & other) const
+template <typename tContainer>
+inline bool cpccKeyValueStrT<tContainer>::isEqual(const cpccKeyValueStrT & other) const
 {
-    // compare std::map
-    // https://stackoverflow.com/questions/8473009/how-to-efficiently-compare-two-maps-of-strings-in-c
+    // the keys of cpccFlatHashMap are not in order, so each key is looked up in the other map
     if (m_map.size() != other.m_map.size())
         return false;
-    return std::equal(m_map.begin(), m_map.end(), other.m_map.begin());
+    for (const auto &element : m_map)
+    {
+        const cpccTypedValue *otherValue = other.findValue(element.first.c_str());
+        if (!otherValue || !(*otherValue == element.second))
+            return false;
+    }
+    return true;
 }
 
 
-inline const cpccKeyValueStr::tStringWN     cpccKeyValueStr::serialize(const TCHAR* aRecordSeparator, const bool addRecordSeparatorToTheEnd, tEncodingFunc encodingFuncPtr) const
+template <typename tContainer>
+inline const typename cpccKeyValueStrT<tContainer>::tStringWN     cpccKeyValueStrT<tContainer>::serialize(const TCHAR* aRecordSeparator, const bool addRecordSeparatorToTheEnd, tEncodingFunc encodingFuncPtr) const
 {
     tStringWN result;
     const TCHAR *recordSeparator = _T("");
-    for (auto element : m_map)
+    for (const auto element : cpccSortedElements(m_map))
     {
-        tStringWN    value(element.second);
+        tStringWN    value(element->second.getText());
         if (encodingFuncPtr)
             encodingFuncPtr(value);
         
-        result += recordSeparator + element.first + _T("=") + value;
+        result += recordSeparator + element->first + _T("=") + value;
         
         if (aRecordSeparator)
             recordSeparator = aRecordSeparator;
@@ -116,63 +196,89 @@ inline const cpccKeyValueStr::tStringWN     cpccKeyValueStr::serialize(const TCH
 }
 
 
-inline void cpccKeyValueStr::removeKey(const TCHAR* aKey)
+template <typename tContainer>
+inline void cpccKeyValueStrT<tContainer>::removeKey(const TCHAR* aKey)
 {
     if (!aKey)
         return;
-    m_map.erase(aKey);
-    dataHasChanged();
+    if (m_map.erase(aKey) == 0)
+        return;
+    ++m_generation;
+    keyHasChanged(aKey, NULL);
 }
 
 
-inline void	cpccKeyValueStr::clear(void)
+template <typename tContainer>
+inline void	cpccKeyValueStrT<tContainer>::clear(void)
 {
     if (m_map.size() == 0)
         return;
 
     m_map.clear();
+    ++m_generation;
     dataHasChanged();
 }
 
 
-inline const bool	cpccKeyValueStr::keyExists(const TCHAR* aKey) const
+template <typename tContainer>
+inline const bool	cpccKeyValueStrT<tContainer>::keyExists(const TCHAR* aKey) const
 {
-    if (!aKey)
-        return false;
-    return (m_map.find(aKey) != m_map.end());
+    return (findValue(aKey) != NULL);
 }
 
 
-inline void cpccKeyValueStr::set(const TCHAR* aKey, const TCHAR* aValue)
+template <typename tContainer>
+inline void cpccKeyValueStrT<tContainer>::set(const TCHAR* aKey, const TCHAR* aValue)
 {
     if (!aValue || !aKey) return;
+    set(aKey, cpccTypedValue(aValue));
+}
+
+
+template <typename tContainer>
+inline void cpccKeyValueStrT<tContainer>::set(const TCHAR* aKey, const cpccTypedValue &aValue)
+{
+    if (!aKey) return;
 
     // caching here 
-    if (keyExists(aKey))
-        if (m_map[aKey].compare(aValue) == 0)
+    auto searchIterator = m_map.find(aKey);
+    if (searchIterator != m_map.end())
+    {
+        if (searchIterator->second == aValue)
             return;	// the value is already there.
+        searchIterator->second = aValue;
+    }
+    else
+        searchIterator = m_map.emplace(aKey, aValue).first;
+    ++m_generation;
 
-    // set
-    m_map[aKey] = aValue;
-    dataHasChanged(); // let descendant classes know that the data has changes so they need to save it somewhere
+    keyHasChanged(aKey, &searchIterator->second); // let descendant classes know that the data has changes so they need to save it somewhere
 }
 
 
-inline const cpccKeyValueStr::tStringWN	cpccKeyValueStr::get(const TCHAR* aKey) const
+template <typename tContainer>
+inline const typename cpccKeyValueStrT<tContainer>::tStringWN	cpccKeyValueStrT<tContainer>::get(const TCHAR* aKey) const
 {
     // amap[k]
     // If k matches the key of an element in the container, the function returns a reference to its mapped value.
     // If k does not match the key of any element in the container, the function inserts a new element with that key and returns a reference to its mapped value.
     // this is not a const function:
     
-    if (aKey)
-    {
-        auto searchIterator = m_map.find(aKey);
-        if (searchIterator != m_map.end())
-            return searchIterator->second;
-    }
+    const cpccTypedValue *value = findValue(aKey);
+    if (value)
+        return value->getText();
 
     return _T("");
 }
 
 
+template <typename tContainer>
+inline const cpccTypedValue *cpccKeyValueStrT<tContainer>::findValue(const TCHAR* aKey) const
+{
+    if (!aKey)
+        return NULL;
+    auto searchIterator = m_map.find(aKey);
+    return (searchIterator != m_map.end()) ? &searchIterator->second : NULL;
+}
+
+
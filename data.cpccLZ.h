@@ -0,0 +1,268 @@
+/*  *****************************************
+ *  File:		data.cpccLZ.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				small LZ77 compressor without external dependencies
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+
+/*
+	A fast LZ77 compressor in the spirit of LZ4, meant for text such as log files.
+	It finds repeated text with a hash table of the last position of every 4 byte sequence.
+
+	Stream layout:
+		header:		"cpLZ", u64 uncompressed size (little endian)
+		sequence:	varint nLiterals, nLiterals bytes, varint (matchLength - minMatch), u16 offset (little endian)
+		last:		varint nLiterals, nLiterals bytes
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLZ
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLZ
+{
+private:
+	enum { minMatch = 4, maxOffset = 65535, hashBits = 14, headerSize = 12 };
+
+	static const char *getMagic(void) { return "cpLZ"; }
+
+	static inline uint32_t read32(const unsigned char *p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static inline uint32_t hash(const uint32_t aValue) { return (aValue * 2654435761u) >> (32 - hashBits); }
+
+	static void putVarint(std::string &out, size_t aValue)
+	{
+		while (aValue >= 0x80)
+		{
+			out.push_back(static_cast<char>((aValue & 0x7F) | 0x80));
+			aValue >>= 7;
+		}
+		out.push_back(static_cast<char>(aValue));
+	}
+
+	static bool getVarint(const unsigned char *&p, const unsigned char *end, size_t &aValue)
+	{
+		aValue = 0;
+		for (int shift = 0; (p < end) && (shift < 64); shift += 7)
+		{
+			const unsigned char b = *p++;
+			aValue |= static_cast<size_t>(b & 0x7F) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+public:
+
+	static void compress(const std::string &aInput, std::string &aOutput)
+	{
+		const size_t n = aInput.size();
+		const unsigned char *in = reinterpret_cast<const unsigned char *>(aInput.data());
+
+		aOutput.clear();
+		aOutput.reserve(headerSize + n / 2 + 16);
+		aOutput.append(getMagic(), 4);
+		for (int i = 0; i < 8; ++i)
+			aOutput.push_back(static_cast<char>((static_cast<uint64_t>(n) >> (8 * i)) & 0xFF));
+
+		std::vector<size_t> lastPos(size_t(1) << hashBits, 0);	// position + 1, 0 for none
+		size_t pos = 0, literalStart = 0;
+		while (pos + minMatch <= n)
+		{
+			const uint32_t h = hash(read32(in + pos));
+			const size_t candidate = lastPos[h];
+			lastPos[h] = pos + 1;
+			if ((candidate == 0) || (pos - (candidate - 1) > maxOffset) || (read32(in + candidate - 1) != read32(in + pos)))
+			{
+				++pos;
+				continue;
+			}
+
+			const size_t matchPos = candidate - 1;
+			size_t length = minMatch;
+			while ((pos + length < n) && (in[matchPos + length] == in[pos + length]))
+				++length;
+
+			putVarint(aOutput, pos - literalStart);
+			aOutput.append(aInput, literalStart, pos - literalStart);
+			putVarint(aOutput, length - minMatch);
+			const size_t offset = pos - matchPos;
+			aOutput.push_back(static_cast<char>(offset & 0xFF));
+			aOutput.push_back(static_cast<char>(offset >> 8));
+
+			pos += length;
+			literalStart = pos;
+		}
+
+		putVarint(aOutput, n - literalStart);
+		aOutput.append(aInput, literalStart, n - literalStart);
+	}
+
+	/// returns false if the input is not a valid compressed stream
+	static bool decompress(const std::string &aInput, std::string &aOutput)
+	{
+		aOutput.clear();
+		if ((aInput.size() < headerSize) || (aInput.compare(0, 4, getMagic()) != 0))
+			return false;
+
+		const unsigned char *p = reinterpret_cast<const unsigned char *>(aInput.data()) + 4;
+		const unsigned char *end = reinterpret_cast<const unsigned char *>(aInput.data()) + aInput.size();
+		uint64_t originalSize = 0;
+		for (int i = 0; i < 8; ++i)
+			originalSize |= static_cast<uint64_t>(*p++) << (8 * i);
+		aOutput.reserve(static_cast<size_t>(originalSize));
+
+		while (p < end)
+		{
+			size_t nLiterals;
+			if (!getVarint(p, end, nLiterals) || (nLiterals > static_cast<size_t>(end - p)))
+				return false;
+			aOutput.append(reinterpret_cast<const char *>(p), nLiterals);
+			p += nLiterals;
+			if (p == end)
+				break;
+
+			size_t length;
+			if (!getVarint(p, end, length) || (end - p < 2))
+				return false;
+			length += minMatch;
+			const size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8);
+			p += 2;
+			if ((offset == 0) || (offset > aOutput.size()))
+				return false;
+
+			// byte by byte, because the match can overlap the bytes it produces
+			size_t from = aOutput.size() - offset;
+			for (size_t i = 0; i < length; ++i)
+				aOutput.push_back(aOutput[from++]);
+		}
+		return (aOutput.size() == originalSize);
+	}
+
+	static bool compressFile(const cpcc_char *aSourceFile, const cpcc_char *aDestFile)
+	{
+		std::string data, compressed;
+		if (!readFile(aSourceFile, data))
+			return false;
+		compress(data, compressed);
+		return writeFile(aDestFile, compressed);
+	}
+
+	static bool decompressFile(const cpcc_char *aSourceFile, const cpcc_char *aDestFile)
+	{
+		std::string compressed, data;
+		if (!readFile(aSourceFile, compressed) || !decompress(compressed, data))
+			return false;
+		return writeFile(aDestFile, data);
+	}
+
+private:
+
+	static bool readFile(const cpcc_char *aFilename, std::string &aData)
+	{
+		if (!aFilename)
+			return false;
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aFilename, _T("rb"));
+		if (!fp)
+			return false;
+		char buffer[64 * 1024];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+			aData.append(buffer, n);
+		const bool readOk = (ferror(fp) == 0);
+		fclose(fp);
+		return readOk;
+	}
+
+	static bool writeFile(const cpcc_char *aFilename, const std::string &aData)
+	{
+		if (!aFilename)
+			return false;
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aFilename, _T("wb"));
+		if (!fp)
+			return false;
+		const bool writtenOk = (fwrite(aData.data(), 1, aData.size(), fp) == aData.size());
+		return (fclose(fp) == 0) && writtenOk;
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLZ testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLZ_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	std::string logText;
+	for (int i = 0; i < 2000; ++i)
+	{
+		logText.append("Info>\t12.0003");
+		logText.push_back(static_cast<char>('0' + i % 10));
+		logText.append("\t| frame took some ms\n");
+	}
+
+	std::string binary;
+	uint32_t x = 12345;
+	for (int i = 0; i < 5000; ++i)
+	{
+		x = x * 1103515245u + 12345u;
+		binary.push_back(static_cast<char>(x >> 16));
+	}
+
+	const std::string samples[] = { std::string(), std::string("abc"), std::string(1000, 'a'), logText, binary };
+	bool allOk = true;
+	for (const auto &sample : samples)
+	{
+		std::string compressed, decompressed;
+		cpccLZ::compress(sample, compressed);
+		allOk = allOk && cpccLZ::decompress(compressed, decompressed) && (decompressed == sample);
+	}
+	TEST_EXPECT(allOk, _T("#7265a: cpccLZ round trip failed"));
+
+	std::string compressed;
+	cpccLZ::compress(logText, compressed);
+	TEST_EXPECT(compressed.size() * 5 < logText.size(), _T("#7265b: cpccLZ does not compress repeated text"));
+
+	std::string decompressed;
+	TEST_EXPECT(!cpccLZ::decompress(compressed.substr(0, compressed.size() - 5), decompressed), _T("#7265c: cpccLZ accepted a truncated stream"));
+}
@@ -0,0 +1,236 @@
+/*  *****************************************
+ *  File:		data.cpccTypedValue.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				a value of cpccKeyValueStr that keeps bools and numbers in their native type
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+#include <type_traits>
+#include "data.cpccWideCharSupport.h"
+
+
+/**
+    A value that was set as a bool, an integer or a real number is kept in its native type.
+    Its text is made only when it is asked for, e.g. when the keys are saved to a file, and it is
+    the same text as strConvertionsV3::toString() makes: "yes"/"no", the digits, or 14 significant digits.
+
+    A text value that is exactly such a text (e.g. "123" or "yes" from a loaded file) is converted once,
+    when it is stored. Other texts (e.g. "true", " 12", "0.50") stay texts, and are parsed as before.
+
+    getAs() reads the value without parsing. It returns false if the native value does not fit in T,
+    or the value is a text, and then the caller parses getText().
+*/
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//        class cpccTypedValue
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+class cpccTypedValue
+{
+public:
+    typedef std::basic_string<TCHAR> tStringWN;
+    enum class tType : unsigned char { text, boolean, integer, real };
+
+private:
+    tStringWN   m_text;         // only for tType::text
+    int64_t     m_integer = 0;  // also the boolean, 0 or 1
+    double      m_real = 0;
+    tType       m_type = tType::text;
+
+public:     // ctors
+
+    cpccTypedValue() { }
+    cpccTypedValue(const tStringWN &aText): m_text(aText) { convertText(); }
+    cpccTypedValue(const TCHAR *aText): m_text(aText ? aText : _T("")) { convertText(); }
+
+    explicit cpccTypedValue(const bool aValue): m_integer(aValue ? 1 : 0), m_type(tType::boolean) { }
+    explicit cpccTypedValue(const int64_t aValue): m_integer(aValue), m_type(tType::integer) { }
+    explicit cpccTypedValue(const double aValue): m_real(aValue), m_type(tType::real) { }
+
+    /// the value of set<T>()
+    static cpccTypedValue from(const bool aValue) { return cpccTypedValue(aValue); }
+    static cpccTypedValue from(const TCHAR *aValue) { return cpccTypedValue(aValue); }
+    static cpccTypedValue from(const tStringWN &aValue) { return cpccTypedValue(aValue); }
+
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value, T>::type >
+    static cpccTypedValue from(const T aValue)
+    {
+        if (isCharType<T>())        // written as a character, as the stream does
+            return cpccTypedValue(formatWithStream(aValue));
+        if (std::is_floating_point<T>::value)
+            return cpccTypedValue(static_cast<double>(aValue));
+        if (std::is_unsigned<T>::value && (static_cast<uint64_t>(aValue) > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())))
+            return cpccTypedValue(formatWithStream(aValue));
+        return cpccTypedValue(static_cast<int64_t>(aValue));
+    }
+
+public:     // functions
+
+    inline tType getType(void) const { return m_type; }
+
+    tStringWN getText(void) const
+    {
+        switch (m_type)
+        {
+            case tType::boolean:    return m_integer ? _T("yes") : _T("no");
+            case tType::integer:    return TOSTRING_WN(m_integer);
+            case tType::real:       return formatWithStream(m_real);
+            default:                return m_text;
+        }
+    }
+
+    operator tStringWN(void) const { return getText(); }
+
+    bool operator==(const cpccTypedValue &other) const
+    {
+        if ((m_type != other.m_type) || (m_type == tType::text))
+            return getText() == other.getText();
+        if (m_type == tType::real)
+            return m_real == other.m_real;
+        return m_integer == other.m_integer;
+    }
+
+    bool operator!=(const cpccTypedValue &other) const { return !(*this == other); }
+
+    /// bool from a boolean, or from the integers 0 and 1 ("0" and "1" are bool texts)
+    bool getAs(bool &aResult) const
+    {
+        if ((m_type != tType::boolean) && ((m_type != tType::integer) || ((m_integer != 0) && (m_integer != 1))))
+            return false;
+        aResult = (m_integer != 0);
+        return true;
+    }
+
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value, T>::type >
+    bool getAs(T &aResult) const
+    {
+        if (isCharType<T>())
+            return false;
+        return getNumber(aResult, std::is_floating_point<T>());
+    }
+
+private:
+
+    template <typename T>
+    static constexpr bool isCharType(void)
+    {
+        return std::is_same<T, char>::value || std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value
+            || std::is_same<T, wchar_t>::value || std::is_same<T, char16_t>::value || std::is_same<T, char32_t>::value;
+    }
+
+    // integers. A negative value for an unsigned type is left to the stream, which wraps it.
+    template <typename T>
+    bool getNumber(T &aResult, std::false_type) const
+    {
+        if ((m_type != tType::integer) || !fitsIn<T>(m_integer))
+            return false;
+        aResult = static_cast<T>(m_integer);
+        return true;
+    }
+
+    // reals. The stream fails on "inf" and "nan", and on values that the type cannot hold
+    template <typename T>
+    bool getNumber(T &aResult, std::true_type) const
+    {
+        if (m_type == tType::integer)
+        {
+            aResult = static_cast<T>(m_integer);
+            return true;
+        }
+        if ((m_type != tType::real) || !std::isfinite(m_real) || (std::fabs(m_real) > static_cast<double>(std::numeric_limits<T>::max())))
+            return false;
+        if ((m_real != 0) && (std::fabs(m_real) < static_cast<double>(std::numeric_limits<T>::min())))
+            return false;
+        aResult = static_cast<T>(m_real);
+        return true;
+    }
+
+    template <typename T>
+    static bool fitsIn(const int64_t aValue)
+    {
+        if (std::is_signed<T>::value)
+            return (aValue >= static_cast<int64_t>(std::numeric_limits<T>::min())) && (aValue <= static_cast<int64_t>(std::numeric_limits<T>::max()));
+        return (aValue >= 0) && (static_cast<uint64_t>(aValue) <= static_cast<uint64_t>(std::numeric_limits<T>::max()));
+    }
+
+    // as strConvertionsV3::toString()
+    template <typename T>
+    static tStringWN formatWithStream(const T aValue)
+    {
+        std::basic_ostringstream<TCHAR> ss;
+        ss.precision(14);
+        ss << aValue;
+        return ss.str();
+    }
+
+    // "yes", "no", integers without leading zeros or '+', and the reals whose text is the 14 digits text
+    void convertText(void)
+    {
+        if ((m_text.length() == 0) || (m_text.length() > 24))
+            return;
+        if ((m_text == _T("yes")) || (m_text == _T("no")))
+        {
+            m_integer = (m_text[0] == _T('y')) ? 1 : 0;
+            m_type = tType::boolean;
+            m_text.clear();
+            return;
+        }
+
+        const size_t firstDigit = (m_text[0] == _T('-')) ? 1 : 0;
+        bool onlyDigits = (firstDigit < m_text.length());
+        bool realChars = onlyDigits;
+        for (size_t i = firstDigit; i < m_text.length(); ++i)
+        {
+            const TCHAR c = m_text[i];
+            if ((c < _T('0')) || (c > _T('9')))
+            {
+                onlyDigits = false;
+                if ((c != _T('.')) && (c != _T('e')) && (c != _T('+')) && (c != _T('-')))
+                    realChars = false;
+            }
+        }
+
+        if (onlyDigits)
+        {
+            const size_t nDigits = m_text.length() - firstDigit;
+            if ((nDigits > 19) || ((nDigits > 1) && (m_text[firstDigit] == _T('0'))) || (m_text == _T("-0")))
+                return;
+            uint64_t magnitude = 0;
+            for (size_t i = firstDigit; i < m_text.length(); ++i)
+                magnitude = magnitude * 10 + static_cast<uint64_t>(m_text[i] - _T('0'));
+            const uint64_t maxMagnitude = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + (firstDigit ? 1 : 0);
+            if (magnitude > maxMagnitude)
+                return;
+            m_integer = firstDigit ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+            m_type = tType::integer;
+            m_text.clear();
+            return;
+        }
+
+        if (!realChars)
+            return;
+        std::basic_istringstream<TCHAR> ss(m_text);
+        double value = 0;
+        if (!(ss >> value) || (ss.peek() != std::char_traits<TCHAR>::eof()) || (formatWithStream(value) != m_text))
+            return;
+        m_real = value;
+        m_type = tType::real;
+        m_text.clear();
+    }
+};
@@ -0,0 +1,464 @@
+/*  *****************************************
+ *  File:		fs.cpccAtomicFile.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				replaces files atomically and durably, with one sync for a group of files
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <climits>
+#else
+	#error #4743: Unsupported platform for fs.cpccAtomicFile.h
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccFileSystemMini.h"
+#include "fs.cpccFileSystem.h"
+#include "fs.cpccPathHelper.h"
+#include "fs.cpccDirectory.h"
+#include "cpccTesting.h"
+
+/*
+	Usage:
+		cpccAtomicFile::replace(_T("state.bin"), data.data(), data.size());
+
+		// several files, with one sync of the disk at the end
+		cpccAtomicFileGroup group;
+		settings.save(group);
+		group.add(_T("translations.txt"), translationsText);
+		group.addText(_T("app state.ini"), stateText.c_str(), true);
+		group.commit();
+
+	The data are written to a temporary file in the folder of the file, which then replaces the file
+	with one rename. Readers, and the file after a crash of the application, see either the old or the new
+	file, never a part of it. If the file is a symbolic link (macOS/Linux), the file it points to is replaced.
+	A crash before commit() leaves the temporary file "<filename>.<process id>-<n>.tmp" next to the file.
+
+	aDurable = true: the new file also survives a power loss after the function returns:
+		Linux:		fdatasync() for each file, then fsync() for each folder
+		macOS:		F_BARRIERFSYNC for each file, then one F_FULLFSYNC for each folder, which flushes
+					the disk's cache for all the files of the group
+		Windows:	FlushFileBuffers() for each file, MoveFileEx() with MOVEFILE_WRITE_THROUGH
+	The syncs of the folders are the part that a group shares: a group of N files in one folder
+	waits for the disk N + 1 times instead of 2 * N.
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccAtomicFileGroup
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccAtomicFileGroup
+{
+private:
+	struct tFile
+	{
+		cpcc_string	filename, tempFilename;
+	#ifdef _WIN32
+		HANDLE		handle = INVALID_HANDLE_VALUE;
+	#else
+		int			fd = -1;
+	#endif
+	};
+
+	std::vector<tFile>	m_files;
+	const bool			m_durable;
+	bool				m_failed = false;
+
+	cpccAtomicFileGroup(const cpccAtomicFileGroup& x) = delete;
+	cpccAtomicFileGroup& operator=(const cpccAtomicFileGroup& x) = delete;
+
+public:
+	explicit cpccAtomicFileGroup(const bool aDurable = true): m_durable(aDurable) { }
+
+	/// the files that were not committed are left unchanged
+	~cpccAtomicFileGroup() { discard(); }
+
+	inline size_t size(void) const { return m_files.size(); }
+
+	/// writes the data to a temporary file now. The file is replaced by commit().
+	bool add(const cpcc_char *aFilename, const void *aData, const size_t aSize)
+	{
+		if (!aFilename || (!aData && aSize))
+			return setFailed();
+
+		tFile file;
+		file.filename = resolveLink(aFilename);
+		file.tempFilename = makeTempFilename(file.filename);
+		if (!createTemp(file))
+			return setFailed();
+		m_files.push_back(file);	// before writing, so that discard() deletes it
+		if (!writeTemp(m_files.back(), static_cast<const char *>(aData), aSize))
+			return setFailed();
+		return true;
+	}
+
+	bool add(const cpcc_char *aFilename, const std::string &aData) { return add(aFilename, aData.data(), aData.size()); }
+
+	/// the text is written in UTF-8, or in the code page of the system if !inUTF8 (Windows with UNICODE).
+	/// As with a text mode stream, the lines end with "\r\n" on Windows.
+	bool addText(const cpcc_char *aFilename, const cpcc_char *aText, const bool inUTF8)
+	{
+		if (!aText)
+			return setFailed();
+		return add(aFilename, textToBytes(aText, inUTF8));
+	}
+
+	/// replaces the files. If an add() failed, no file is replaced.
+	/// Returns false if a file was not replaced, or if the sync of a folder failed.
+	bool commit(void)
+	{
+		bool ok = !m_failed;
+		for (auto &file : m_files)
+			ok = flushAndClose(file) && ok;
+		if (!ok)
+		{
+			discard();
+			return false;
+		}
+
+		std::vector<cpcc_string> folders;
+		for (auto &file : m_files)
+		{
+			ok = renameOver(file) && ok;	// a failed rename does not stop the other files of the group
+			cpccStatCache::getInstance().invalidate(file.filename.c_str());
+			const cpcc_string folder(folderOf(file.filename));
+			if (std::find(folders.begin(), folders.end(), folder) == folders.end())
+				folders.push_back(folder);
+		}
+		m_files.clear();
+
+		if (m_durable)
+			for (const auto &folder : folders)
+				ok = syncFolder(folder) && ok;
+		return ok;
+	}
+
+	/// deletes the temporary files of the group without replacing anything
+	void discard(void)
+	{
+		for (auto &file : m_files)
+		{
+			closeTemp(file);
+		#ifdef _WIN32
+			DeleteFile(file.tempFilename.c_str());
+		#else
+			unlink(file.tempFilename.c_str());
+		#endif
+		}
+		m_files.clear();
+		m_failed = false;
+	}
+
+	static std::string textToBytes(const cpcc_char *aText, const bool inUTF8)
+	{
+	#if defined(_WIN32) && defined(UNICODE)
+		const UINT codePage = inUTF8 ? CP_UTF8 : CP_ACP;
+		const int nBytes = WideCharToMultiByte(codePage, 0, aText, -1, NULL, 0, NULL, NULL);
+		std::string text(nBytes > 0 ? nBytes : 1, '\0');
+		if (nBytes > 0)
+			WideCharToMultiByte(codePage, 0, aText, -1, &text[0], nBytes, NULL, NULL);
+		text.resize(text.size() - 1);	// the terminating zero
+	#else
+		(void) inUTF8;	// cpcc_char strings are already UTF-8, or in the code page of the system
+		std::string text(aText);
+	#endif
+
+	#ifdef _WIN32
+		std::string crlfText;
+		crlfText.reserve(text.size() + text.size() / 16);
+		for (const char c : text)
+		{
+			if (c == '\n')
+				crlfText.push_back('\r');
+			crlfText.push_back(c);
+		}
+		return crlfText;
+	#else
+		return text;
+	#endif
+	}
+
+private:
+
+	bool setFailed(void)
+	{
+		m_failed = true;
+		return false;
+	}
+
+	static cpcc_string makeTempFilename(const cpcc_string &aFilename)
+	{
+		static std::atomic<unsigned int> counter(0);
+	#ifdef _WIN32
+		const unsigned long pid = GetCurrentProcessId();
+	#else
+		const unsigned long pid = static_cast<unsigned long>(getpid());
+	#endif
+		return aFilename + _T(".") + cpcc_to_string(pid) + _T("-") + cpcc_to_string(++counter) + _T(".tmp");
+	}
+
+	static cpcc_string folderOf(const cpcc_string &aFilename)
+	{
+	#ifdef _WIN32
+		const size_t separator = aFilename.find_last_of(_T("\\/"));
+	#else
+		const size_t separator = aFilename.find_last_of(_T('/'));
+	#endif
+		if (separator == cpcc_string::npos)
+			return _T(".");
+		return (separator == 0) ? aFilename.substr(0, 1) : aFilename.substr(0, separator);
+	}
+
+#ifdef _WIN32
+
+	static cpcc_string resolveLink(const cpcc_char *aFilename) { return aFilename; }
+
+	static bool createTemp(tFile &aFile)
+	{
+		aFile.handle = CreateFile(aFile.tempFilename.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+		return aFile.handle != INVALID_HANDLE_VALUE;
+	}
+
+	static bool writeTemp(tFile &aFile, const char *aData, size_t aSize)
+	{
+		while (aSize > 0)
+		{
+			const DWORD chunk = (aSize > 0x40000000) ? 0x40000000 : static_cast<DWORD>(aSize);
+			DWORD nWritten = 0;
+			if (!WriteFile(aFile.handle, aData, chunk, &nWritten, NULL) || (nWritten == 0))
+				return false;
+			aData += nWritten;
+			aSize -= nWritten;
+		}
+		return true;
+	}
+
+	static void closeTemp(tFile &aFile)
+	{
+		if (aFile.handle != INVALID_HANDLE_VALUE)
+			CloseHandle(aFile.handle);
+		aFile.handle = INVALID_HANDLE_VALUE;
+	}
+
+	bool flushAndClose(tFile &aFile) const
+	{
+		const bool ok = !m_durable || FlushFileBuffers(aFile.handle);
+		closeTemp(aFile);
+		return ok;
+	}
+
+	bool renameOver(const tFile &aFile) const
+	{
+		const DWORD flags = MOVEFILE_REPLACE_EXISTING | (m_durable ? MOVEFILE_WRITE_THROUGH : 0);
+		for (int attempt = 0; attempt < 5; ++attempt)	// e.g. a virus scanner has the file open for a moment
+		{
+			if (MoveFileEx(aFile.tempFilename.c_str(), aFile.filename.c_str(), flags))
+				return true;
+			Sleep(20);
+		}
+		DeleteFile(aFile.tempFilename.c_str());
+		return false;
+	}
+
+	static bool syncFolder(const cpcc_string &) { return true; }	// MOVEFILE_WRITE_THROUGH did it
+
+#else
+
+	static cpcc_string resolveLink(const cpcc_char *aFilename)
+	{
+		struct stat info;
+		if ((lstat(aFilename, &info) != 0) || !S_ISLNK(info.st_mode))
+			return aFilename;
+		char target[PATH_MAX];
+		return realpath(aFilename, target) ? cpcc_string(target) : cpcc_string(aFilename);
+	}
+
+	static bool createTemp(tFile &aFile)
+	{
+		aFile.fd = ::open(aFile.tempFilename.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+		if (aFile.fd < 0)
+			return false;
+		struct stat info;
+		if (stat(aFile.filename.c_str(), &info) == 0)
+			fchmod(aFile.fd, info.st_mode & 07777);	// keep the permissions of the file that is replaced
+		return true;
+	}
+
+	bool writeTemp(tFile &aFile, const char *aData, size_t aSize) const
+	{
+		while (aSize > 0)
+		{
+			const ssize_t nWritten = ::write(aFile.fd, aData, aSize);
+			if (nWritten < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			aData += nWritten;
+			aSize -= static_cast<size_t>(nWritten);
+		}
+	#ifdef __linux__
+		if (m_durable)	// the disk starts writing now, while the other files of the group are prepared
+			sync_file_range(aFile.fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+	#endif
+		return true;
+	}
+
+	static void closeTemp(tFile &aFile)
+	{
+		if (aFile.fd >= 0)
+			::close(aFile.fd);
+		aFile.fd = -1;
+	}
+
+	bool flushAndClose(tFile &aFile) const
+	{
+		bool ok = true;
+		if (m_durable)
+		{
+		#ifdef __linux__
+			ok = (fdatasync(aFile.fd) == 0);
+		#elif defined(F_BARRIERFSYNC)
+			// in order with the rename, without waiting for the disk's cache. syncFolder() flushes it.
+			ok = (fcntl(aFile.fd, F_BARRIERFSYNC) == 0) || (fsync(aFile.fd) == 0);
+		#else
+			ok = (fsync(aFile.fd) == 0);
+		#endif
+		}
+		ok = (::close(aFile.fd) == 0) && ok;
+		aFile.fd = -1;
+		return ok;
+	}
+
+	static bool renameOver(const tFile &aFile)
+	{
+		if (::rename(aFile.tempFilename.c_str(), aFile.filename.c_str()) == 0)
+			return true;
+		unlink(aFile.tempFilename.c_str());
+		return false;
+	}
+
+	static bool syncFolder(const cpcc_string &aFolder)
+	{
+		const int fd = ::open(aFolder.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+	#ifdef F_FULLFSYNC	// macOS: also flushes the disk's cache
+		const bool ok = (fcntl(fd, F_FULLFSYNC) == 0) || (fsync(fd) == 0);
+	#else
+		const bool ok = (fsync(fd) == 0);
+	#endif
+		::close(fd);
+		return ok;
+	}
+
+#endif
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccAtomicFile
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccAtomicFile
+{
+public:
+	/// replaces the file with the data, atomically. See cpccAtomicFileGroup for several files.
+	static bool replace(const cpcc_char *aFilename, const void *aData, const size_t aSize, const bool aDurable = true)
+	{
+		cpccAtomicFileGroup group(aDurable);
+		return group.add(aFilename, aData, aSize) && group.commit();
+	}
+
+	static bool replaceText(const cpcc_char *aFilename, const cpcc_char *aText, const bool inUTF8, const bool aDurable = true)
+	{
+		cpccAtomicFileGroup group(aDurable);
+		return group.addText(aFilename, aText, inUTF8) && group.commit();
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccAtomicFile testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccAtomicFile_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	const cpcc_string tmp(cpccFileSystemMini::getTempFilename());
+	const cpcc_string fn[3] = { tmp + _T(".a"), tmp + _T(".b"), tmp + _T(".c") };
+	const auto contentOf = [](const cpcc_string &aFilename)
+		{
+			char buffer[64];
+			const size_t n = cpccFileSystemMini::readFromFile(aFilename.c_str(), buffer, sizeof(buffer));
+			return (n <= sizeof(buffer)) ? std::string(buffer, n) : std::string();
+		};
+
+	TEST_EXPECT(cpccAtomicFile::replace(fn[0].c_str(), "first version", 13) && (contentOf(fn[0]) == "first version"), _T("#7277a: cpccAtomicFile::replace() of a new file"));
+
+#ifndef _WIN32
+	chmod(fn[0].c_str(), 0600);
+#endif
+	TEST_EXPECT(cpccAtomicFile::replace(fn[0].c_str(), "second", 6, false) && (contentOf(fn[0]) == "second"), _T("#7277b: cpccAtomicFile::replace() of an existing file"));
+#ifndef _WIN32
+	TEST_EXPECT(cpccFileSystem::getFileInfo(fn[0].c_str()).permissions == 0600, _T("#7277c: cpccAtomicFile::replace() changed the permissions"));
+#endif
+
+	{
+		cpccAtomicFileGroup group;
+		for (const auto &f : fn)
+			group.add(f.c_str(), std::string("group"));
+		TEST_EXPECT((group.size() == 3) && (contentOf(fn[0]) == "second") && !cpccFileSystem::fileExists(fn[1].c_str()), _T("#7277d: cpccAtomicFileGroup replaced a file before commit()"));
+		TEST_EXPECT(group.commit() && (contentOf(fn[0]) == "group") && (contentOf(fn[1]) == "group") && (contentOf(fn[2]) == "group"), _T("#7277e: cpccAtomicFileGroup::commit()"));
+	}
+
+	{
+		cpccAtomicFileGroup group;
+		group.addText(fn[1].c_str(), _T("discarded"), true);
+	}
+	const cpcc_string prefix(cpccPathHelper::extractFilename(fn[1]) + _T("."));
+	bool tempFileLeft = false;
+	for (const auto &entry : cpccDirectoryIterator::list(cpccPathHelper::getParentFolderOf(fn[1].c_str()).c_str()))
+		tempFileLeft = tempFileLeft || ((entry.name.compare(0, prefix.length(), prefix) == 0) && cpccDirectoryWalker::endsWith(entry.name, _T(".tmp")));
+	TEST_EXPECT((contentOf(fn[1]) == "group") && !tempFileLeft, _T("#7277f: cpccAtomicFileGroup without commit()"));
+
+	for (const auto &f : fn)
+		cpccFileSystem::deleteFile(f.c_str());
+}
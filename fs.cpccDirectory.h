@@ -0,0 +1,491 @@
+/*  *****************************************
+ *  File:		fs.cpccDirectory.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				listing of folders and parallel walk of folder trees
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#elif defined(__linux__)
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <dirent.h>		// for the DT_ constants
+#elif defined(__APPLE__)
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <dirent.h>
+	#include <fcntl.h>
+#else
+	#error #4742: Unsupported platform for fs.cpccDirectory.h
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "fs.cpccFileSystem.h"
+#include "io.cpccFileSystemMini.h"
+
+/*
+	Usage:
+		cpccDirEntry entry;
+		cpccDirectoryIterator folder(_T("/some/folder"));
+		while (folder.next(entry))
+			if (entry.isFile())
+				std::cout << entry.name << std::endl;
+
+		// all the .txt files of a tree, from several threads
+		std::atomic<int> nFiles(0);
+		cpccDirectoryWalker::walk(_T("/some/folder"), [&nFiles](const cpcc_string &aFolder, const cpccDirEntry &anEntry)
+			{
+				if (anEntry.isFile() && cpccDirectoryWalker::endsWith(anEntry.name, _T(".txt")))
+					++nFiles;
+				return true;	// false stops the walk
+			});
+
+	The type of the entries comes with the listing (getdents64() on Linux, readdir() on macOS,
+	FindFirstFileEx() on Windows), without a stat() per entry.
+	"." and ".." are skipped.
+*/
+
+
+struct cpccDirEntry
+{
+	cpcc_string			name;
+	cpccFileInfo::tType	type = cpccFileInfo::tType::other;
+	bool				isSymlink = false;	// or a junction on Windows. The type is the type of the link itself.
+
+	inline bool isFile(void) const { return type == cpccFileInfo::tType::file; }
+	inline bool isFolder(void) const { return type == cpccFileInfo::tType::folder; }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccDirectoryIterator
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccDirectoryIterator
+{
+private:
+#ifdef _WIN32
+	HANDLE				m_find = INVALID_HANDLE_VALUE;
+	WIN32_FIND_DATA		m_findData;
+	bool				m_hasPending = false;	// m_findData has an entry not returned yet
+#elif defined(__linux__)
+	struct tLinuxDirent64	// the kernel's struct linux_dirent64
+	{
+		uint64_t		d_ino;
+		int64_t			d_off;
+		unsigned short	d_reclen;
+		unsigned char	d_type;
+		char			d_name[1];
+	};
+
+	int					m_fd = -1;
+	std::vector<char>	m_buffer;
+	long				m_bufferBytes = 0,
+						m_bufferPos = 0;
+#else
+	DIR					*m_dir = NULL;
+#endif
+
+	cpccDirectoryIterator(const cpccDirectoryIterator& x) = delete;
+	cpccDirectoryIterator& operator=(const cpccDirectoryIterator& x) = delete;
+
+	static bool isDotOrDotDot(const cpcc_char *aName)
+	{
+		return (aName[0] == _T('.')) && ((aName[1] == 0) || ((aName[1] == _T('.')) && (aName[2] == 0)));
+	}
+
+public:
+
+	explicit cpccDirectoryIterator(const cpcc_char *aFolder)
+	{
+		if (!aFolder)
+			return;
+	#ifdef _WIN32
+		cpcc_string pattern(aFolder);
+		if (!pattern.empty() && (pattern.back() != _T('\\')) && (pattern.back() != _T('/')))
+			pattern.push_back(_T('\\'));
+		pattern.push_back(_T('*'));
+		m_find = FindFirstFileEx(pattern.c_str(), FindExInfoBasic, &m_findData, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+		m_hasPending = (m_find != INVALID_HANDLE_VALUE);
+	#elif defined(__linux__)
+		m_fd = ::open(aFolder, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (m_fd >= 0)
+			m_buffer.resize(64 * 1024);		// glibc's readdir() reads 32KB at a time
+	#else
+		m_dir = opendir(aFolder);
+	#endif
+	}
+
+	~cpccDirectoryIterator()
+	{
+	#ifdef _WIN32
+		if (m_find != INVALID_HANDLE_VALUE)
+			FindClose(m_find);
+	#elif defined(__linux__)
+		if (m_fd >= 0)
+			::close(m_fd);
+	#else
+		if (m_dir)
+			closedir(m_dir);
+	#endif
+	}
+
+	bool isOpen(void) const
+	{
+	#ifdef _WIN32
+		return (m_find != INVALID_HANDLE_VALUE);
+	#elif defined(__linux__)
+		return (m_fd >= 0);
+	#else
+		return (m_dir != NULL);
+	#endif
+	}
+
+	/// returns false after the last entry
+	bool next(cpccDirEntry &anEntry)
+	{
+	#ifdef _WIN32
+		while (m_hasPending)
+		{
+			const WIN32_FIND_DATA &data = m_findData;
+			const bool skip = isDotOrDotDot(data.cFileName);
+			if (!skip)
+			{
+				anEntry.name = data.cFileName;
+				anEntry.type = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? cpccFileInfo::tType::folder : cpccFileInfo::tType::file;
+				anEntry.isSymlink = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+			}
+			m_hasPending = (FindNextFile(m_find, &m_findData) != 0);
+			if (!skip)
+				return true;
+		}
+		return false;
+
+	#elif defined(__linux__)
+		if (m_fd < 0)
+			return false;
+		for (;;)
+		{
+			if (m_bufferPos >= m_bufferBytes)
+			{
+				m_bufferBytes = syscall(SYS_getdents64, m_fd, m_buffer.data(), m_buffer.size());
+				m_bufferPos = 0;
+				if (m_bufferBytes <= 0)
+					return false;
+			}
+			const tLinuxDirent64 *dirent = reinterpret_cast<const tLinuxDirent64 *>(m_buffer.data() + m_bufferPos);
+			m_bufferPos += dirent->d_reclen;
+			if (isDotOrDotDot(dirent->d_name))
+				continue;
+			anEntry.name = dirent->d_name;
+			setType(anEntry, dirent->d_type, m_fd);
+			return true;
+		}
+
+	#else
+		if (!m_dir)
+			return false;
+		while (const struct dirent *dirent = readdir(m_dir))
+		{
+			if (isDotOrDotDot(dirent->d_name))
+				continue;
+			anEntry.name = dirent->d_name;
+			setType(anEntry, dirent->d_type, dirfd(m_dir));
+			return true;
+		}
+		return false;
+	#endif
+	}
+
+	/// all the entries of a folder
+	static std::vector<cpccDirEntry> list(const cpcc_char *aFolder)
+	{
+		std::vector<cpccDirEntry> result;
+		cpccDirectoryIterator folder(aFolder);
+		cpccDirEntry entry;
+		while (folder.next(entry))
+			result.push_back(entry);
+		return result;
+	}
+
+private:
+
+#ifndef _WIN32
+	static void setType(cpccDirEntry &anEntry, unsigned char aType, const int aFolderFd)
+	{
+		if (aType == DT_UNKNOWN)
+		{	// some file systems do not give the type with the listing
+			struct stat info;
+			if (fstatat(aFolderFd, anEntry.name.c_str(), &info, AT_SYMLINK_NOFOLLOW) == 0)
+				aType = S_ISREG(info.st_mode) ? DT_REG : (S_ISDIR(info.st_mode) ? DT_DIR : (S_ISLNK(info.st_mode) ? DT_LNK : DT_UNKNOWN));
+		}
+		anEntry.type = (aType == DT_REG) ? cpccFileInfo::tType::file : ((aType == DT_DIR) ? cpccFileInfo::tType::folder : cpccFileInfo::tType::other);
+		anEntry.isSymlink = (aType == DT_LNK);
+	}
+#endif
+};
+
+
+struct cpccDirectoryWalkOptions
+{
+	/// 0: as many as the CPU cores
+	unsigned int	maxThreads = 0;
+
+	/// how deep to go under the root folder. 0: only the entries of the root folder. -1: no limit
+	int				maxDepth = -1;
+
+	/// which subfolders to walk into. Without it, all of them except the symlinks.
+	std::function<bool(const cpcc_string &aFolder, const cpccDirEntry &aSubfolder)> descendInto;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccDirectoryWalker
+//
+//	Each thread takes folders from its own queue, newest first, so that it works
+//	depth first on folders that are still in the disk cache. A thread with an empty
+//	queue steals the oldest folder of another thread: the biggest piece of work.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccDirectoryWalker
+{
+public:
+	typedef std::function<bool(const cpcc_string &aFolder, const cpccDirEntry &anEntry)> tCallback;
+
+	/// calls aCallback for every entry of the tree, from several threads at the same time.
+	/// aFolder is the folder of the entry. The walk stops when aCallback returns false, and then walk() returns false.
+	static bool walk(const cpcc_char *aRoot, const tCallback &aCallback, const cpccDirectoryWalkOptions &aOptions = cpccDirectoryWalkOptions())
+	{
+		if (!aRoot || !aCallback)
+			return false;
+
+		unsigned int nThreads = aOptions.maxThreads ? aOptions.maxThreads : std::thread::hardware_concurrency();
+		if (nThreads == 0)
+			nThreads = 1;
+
+		tWalk walk(aCallback, aOptions, nThreads);
+		walk.queues[0].folders.push_back(tFolder{ cpcc_string(aRoot), 0 });
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < nThreads; ++i)
+			threads.emplace_back(&tWalk::work, &walk, i);
+		walk.work(0);
+		for (auto &thread : threads)
+			thread.join();
+		return !walk.stop;
+	}
+
+	static bool endsWith(const cpcc_string &aText, const cpcc_char *aSuffix)
+	{
+		const size_t length = cpcc_strlen(aSuffix);
+		return (aText.length() >= length) && (aText.compare(aText.length() - length, length, aSuffix) == 0);
+	}
+
+	static cpcc_string joinPath(const cpcc_string &aFolder, const cpcc_string &aName)
+	{
+	#ifdef _WIN32
+		const cpcc_char separator = _T('\\');
+	#else
+		const cpcc_char separator = _T('/');
+	#endif
+		cpcc_string result(aFolder);
+		if (!result.empty() && (result.back() != separator) && (result.back() != _T('/')))
+			result.push_back(separator);
+		result.append(aName);
+		return result;
+	}
+
+private:
+	struct tFolder
+	{
+		cpcc_string	path;
+		int			depth;
+	};
+
+	struct tQueue
+	{
+		std::mutex			mutex;
+		std::deque<tFolder>	folders;
+	};
+
+	struct tWalk
+	{
+		const tCallback					&callback;
+		const cpccDirectoryWalkOptions	&options;
+		std::vector<tQueue>				queues;
+		std::atomic<size_t>				pending;	// folders queued or being read
+		std::atomic<bool>				stop;
+
+		tWalk(const tCallback &aCallback, const cpccDirectoryWalkOptions &aOptions, const unsigned int nThreads):
+			callback(aCallback), options(aOptions), queues(nThreads), pending(1), stop(false)
+		{ }
+
+		bool take(const unsigned int aThread, tFolder &aFolder)
+		{
+			{	// the newest of the own queue
+				tQueue &own = queues[aThread];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				if (!own.folders.empty())
+				{
+					aFolder = std::move(own.folders.back());
+					own.folders.pop_back();
+					return true;
+				}
+			}
+			for (size_t i = 1; i < queues.size(); ++i)
+			{	// the oldest of another queue
+				tQueue &other = queues[(aThread + i) % queues.size()];
+				std::lock_guard<std::mutex> lock(other.mutex);
+				if (!other.folders.empty())
+				{
+					aFolder = std::move(other.folders.front());
+					other.folders.pop_front();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void work(const unsigned int aThread)
+		{
+			tFolder folder;
+			int idleRounds = 0;
+			while (!stop && (pending > 0))
+			{
+				if (!take(aThread, folder))
+				{	// the other threads are reading folders that may have subfolders
+					if (++idleRounds < 64)
+						std::this_thread::yield();
+					else
+						std::this_thread::sleep_for(std::chrono::microseconds(200));
+					continue;
+				}
+				idleRounds = 0;
+				readFolder(aThread, folder);
+				--pending;
+			}
+		}
+
+		void readFolder(const unsigned int aThread, const tFolder &aFolder)
+		{
+			const bool descend = (options.maxDepth < 0) || (aFolder.depth < options.maxDepth);
+			cpccDirectoryIterator iterator(aFolder.path.c_str());
+			cpccDirEntry entry;
+			while (!stop && iterator.next(entry))
+			{
+				if (!callback(aFolder.path, entry))
+				{
+					stop = true;
+					return;
+				}
+				if (!descend || !entry.isFolder())
+					continue;
+				if (options.descendInto ? !options.descendInto(aFolder.path, entry) : entry.isSymlink)
+					continue;
+
+				++pending;
+				tQueue &own = queues[aThread];
+				std::lock_guard<std::mutex> lock(own.mutex);
+				own.folders.push_back(tFolder{ joinPath(aFolder.path, entry.name), aFolder.depth + 1 });
+			}
+		}
+	};
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccDirectoryWalker testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccDirectoryWalker_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	// root/f0..f2, root/a/f0..f2, root/b/c/f0..f2
+	const cpcc_string root(cpccFileSystemMini::getTempFilename());
+	const cpcc_string folders[4] = { root, cpccDirectoryWalker::joinPath(root, _T("a")), cpccDirectoryWalker::joinPath(root, _T("b")),
+		cpccDirectoryWalker::joinPath(cpccDirectoryWalker::joinPath(root, _T("b")), _T("c")) };
+	for (const auto &folder : folders)
+	{
+		cpccFileSystemMini::createFolder(folder.c_str());
+		if (folder == folders[2])
+			continue;
+		for (int i = 0; i < 3; ++i)
+			cpccFileSystemMini::createEmptyFile(cpccDirectoryWalker::joinPath(folder, cpcc_string(_T("f")) + cpcc_to_string(i)).c_str());
+	}
+
+	const std::vector<cpccDirEntry> entries(cpccDirectoryIterator::list(root.c_str()));
+	size_t nFiles = 0, nFolders = 0;
+	for (const auto &entry : entries)
+	{
+		nFiles += entry.isFile();
+		nFolders += entry.isFolder();
+	}
+	TEST_EXPECT((entries.size() == 5) && (nFiles == 3) && (nFolders == 2), _T("#7276a: cpccDirectoryIterator::list()"));
+
+	std::atomic<int> nEntries(0);
+	cpccDirectoryWalkOptions options;
+	options.maxThreads = 3;
+	const auto count = [&nEntries](const cpcc_string &, const cpccDirEntry &) { ++nEntries; return true; };
+	TEST_EXPECT(cpccDirectoryWalker::walk(root.c_str(), count, options) && (nEntries == 12), _T("#7276b: cpccDirectoryWalker::walk() of the whole tree"));
+
+	nEntries = 0;
+	options.descendInto = [](const cpcc_string &, const cpccDirEntry &aSubfolder) { return aSubfolder.name != _T("b"); };
+	cpccDirectoryWalker::walk(root.c_str(), count, options);
+	TEST_EXPECT(nEntries == 8, _T("#7276c: cpccDirectoryWalker::walk() with a folder filter"));
+
+	nEntries = 0;
+	options.descendInto = nullptr;
+	options.maxDepth = 0;
+	cpccDirectoryWalker::walk(root.c_str(), count, options);
+	TEST_EXPECT(nEntries == 5, _T("#7276d: cpccDirectoryWalker::walk() with maxDepth"));
+
+	nEntries = 0;
+	options.maxDepth = -1;
+	options.maxThreads = 1;	// with more threads, a few more entries can be reported before all threads stop
+	const bool completed = cpccDirectoryWalker::walk(root.c_str(), [&nEntries](const cpcc_string &, const cpccDirEntry &) { return ++nEntries < 4; }, options);
+	TEST_EXPECT(!completed && (nEntries == 4), _T("#7276e: cpccDirectoryWalker::walk() did not stop"));
+
+	for (int i = 3; i >= 0; --i)
+	{
+		for (const auto &entry : cpccDirectoryIterator::list(folders[i].c_str()))
+			if (entry.isFile())
+				cpccFileSystem::deleteFile(cpccDirectoryWalker::joinPath(folders[i], entry.name).c_str());
+		cpccFileSystem::deleteFolder(folders[i].c_str());
+	}
+}
@@ -0,0 +1,424 @@
+/*  *****************************************
+ *  File:		fs.cpccFileCopy.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				file copy with the fastest copy path of the OS
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+	#include <Windows.h>
+	#include <malloc.h>	// for _aligned_malloc()
+#elif defined(__linux__)
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/sendfile.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#elif defined(__APPLE__)
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <copyfile.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#else
+	#error #4741: Unsupported platform for fs.cpccFileCopy.h
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccFileSystemMini.h"
+#include "fs.cpccFileSystem.h"
+#include "cpccTesting.h"
+
+/*
+	Usage:
+		cpccFileCopy::copy(_T("a.bin"), _T("b.bin"));
+
+		cpccFileCopyOptions options;
+		options.preserveTimesAndPermissions = true;
+		options.progress = [](uint64_t copied, uint64_t total) { showProgress(copied, total); return true; };	// false cancels
+		cpccFileCopy::copy(_T("a.bin"), _T("b.bin"), options);
+
+	The copy goes through the kernel, without passing the data through a buffer of the process:
+		Windows:	CopyFileEx()
+		macOS:		copyfile()
+		Linux:		copy_file_range(), or sendfile() where copy_file_range() is not supported
+	If the kernel path fails before it copied anything (e.g. a file system that does not support it),
+	the data are copied with large aligned buffers (copyBuffered()).
+*/
+
+
+struct cpccFileCopyOptions
+{
+	/// copy the modification time and the permission bits of the source. CopyFileEx() keeps the times anyway.
+	bool			preserveTimesAndPermissions = false;
+
+	/// the buffer of copyBuffered()
+	size_t			bufferBytes = 1024 * 1024;
+
+	/// called while copying, with the bytes copied so far and the size of the source. Return false to cancel.
+	/// It is called at least once at the end, with copied == total.
+	std::function<bool(uint64_t aCopied, uint64_t aTotal)> progress;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccFileCopy
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccFileCopy
+{
+public:
+	enum class tMethod { none = 0, kernel, buffered };
+
+	/// copies the source to the destination file, replacing it. The destination must be a file, not a folder.
+	static bool copy(const cpcc_char *aSourceFile, const cpcc_char *aDestFile, const cpccFileCopyOptions &aOptions = cpccFileCopyOptions(), tMethod *aUsedMethod = NULL)
+	{
+		if (aUsedMethod)
+			*aUsedMethod = tMethod::none;
+		if (!aSourceFile || !aDestFile)
+			return false;
+
+		bool fallBack = false;
+		const bool copied = copyWithKernel(aSourceFile, aDestFile, aOptions, fallBack);
+		cpccStatCache::getInstance().invalidate(aDestFile);
+		if (copied)
+		{
+			if (aUsedMethod)
+				*aUsedMethod = tMethod::kernel;
+			return true;
+		}
+		if (!fallBack)
+			return false;
+
+		if (aUsedMethod)
+			*aUsedMethod = tMethod::buffered;
+		return copyBuffered(aSourceFile, aDestFile, aOptions);
+	}
+
+	/// the portable copy: fread/fwrite without stdio buffering, through one aligned buffer of aOptions.bufferBytes
+	static bool copyBuffered(const cpcc_char *aSourceFile, const cpcc_char *aDestFile, const cpccFileCopyOptions &aOptions = cpccFileCopyOptions())
+	{
+		if (!aSourceFile || !aDestFile)
+			return false;
+
+		#pragma warning(suppress : 4996)
+		FILE *source = cpcc_fopen(aSourceFile, _T("rb"));
+		if (!source)
+			return false;
+		#pragma warning(suppress : 4996)
+		FILE *dest = cpcc_fopen(aDestFile, _T("wb"));
+		if (!dest)
+		{
+			fclose(source);
+			return false;
+		}
+		setvbuf(source, NULL, _IONBF, 0);
+		setvbuf(dest, NULL, _IONBF, 0);
+
+		const size_t alignmentBytes = static_cast<size_t>(alignment);
+		const size_t bufferBytes = (aOptions.bufferBytes >= alignmentBytes) ? (aOptions.bufferBytes / alignmentBytes) * alignmentBytes : alignmentBytes;
+		char *buffer = static_cast<char *>(alignedAlloc(bufferBytes));
+		const uint64_t total = getSize(aSourceFile);
+		uint64_t copied = 0;
+		bool ok = (buffer != NULL);
+		while (ok)
+		{
+			const size_t nRead = fread(buffer, 1, bufferBytes, source);
+			if (nRead == 0)
+			{
+				ok = (ferror(source) == 0);
+				break;
+			}
+			ok = (fwrite(buffer, 1, nRead, dest) == nRead);
+			copied += nRead;
+			if (ok && aOptions.progress && (nRead == bufferBytes))
+				ok = aOptions.progress(copied, total);
+		}
+		alignedFree(buffer);
+		fclose(source);
+		ok = (fclose(dest) == 0) && ok;
+
+		if (ok && aOptions.progress)
+			ok = aOptions.progress(copied, copied);
+		if (ok && aOptions.preserveTimesAndPermissions)
+			preserveTimesAndPermissions(aSourceFile, aDestFile);
+		cpccStatCache::getInstance().invalidate(aDestFile);
+		return ok;
+	}
+
+private:
+	enum { alignment = 4096, kernelChunkBytes = 8 * 1024 * 1024 };
+
+	static void *alignedAlloc(const size_t aBytes)
+	{
+	#ifdef _WIN32
+		return _aligned_malloc(aBytes, alignment);
+	#else
+		void *p = NULL;
+		return (posix_memalign(&p, alignment, aBytes) == 0) ? p : NULL;
+	#endif
+	}
+
+	static void alignedFree(void *p)
+	{
+	#ifdef _WIN32
+		_aligned_free(p);
+	#else
+		free(p);
+	#endif
+	}
+
+#ifdef _WIN32
+
+	static uint64_t getSize(const cpcc_char *aFilename)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA info;
+		if (!GetFileAttributesEx(aFilename, GetFileExInfoStandard, &info))
+			return 0;
+		return (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+	}
+
+	static DWORD CALLBACK progressRoutine(LARGE_INTEGER aTotal, LARGE_INTEGER aCopied, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID aOptions)
+	{
+		const cpccFileCopyOptions &options = *static_cast<const cpccFileCopyOptions *>(aOptions);
+		return options.progress(static_cast<uint64_t>(aCopied.QuadPart), static_cast<uint64_t>(aTotal.QuadPart)) ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+	}
+
+	static bool copyWithKernel(const cpcc_char *aSourceFile, const cpcc_char *aDestFile, const cpccFileCopyOptions &aOptions, bool &aFallBack)
+	{
+		aFallBack = false;
+		if (CopyFileEx(aSourceFile, aDestFile, aOptions.progress ? progressRoutine : NULL, const_cast<cpccFileCopyOptions *>(&aOptions), NULL, 0))
+			return true;
+		const DWORD error = GetLastError();
+		aFallBack = (error == ERROR_NOT_SUPPORTED) || (error == ERROR_INVALID_FUNCTION);
+		return false;
+	}
+
+	// the times are kept by CopyFileEx(). The read-only attribute is the Windows permission bit.
+	static void preserveTimesAndPermissions(const cpcc_char *aSourceFile, const cpcc_char *aDestFile)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA info;
+		if (!GetFileAttributesEx(aSourceFile, GetFileExInfoStandard, &info))
+			return;
+		HANDLE h = CreateFile(aDestFile, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (h != INVALID_HANDLE_VALUE)
+		{
+			SetFileTime(h, &info.ftCreationTime, &info.ftLastAccessTime, &info.ftLastWriteTime);
+			CloseHandle(h);
+		}
+		SetFileAttributes(aDestFile, info.dwFileAttributes & FILE_ATTRIBUTE_READONLY);
+	}
+
+#else	// macOS and Linux
+
+	static uint64_t getSize(const cpcc_char *aFilename)
+	{
+		struct stat info;
+		return (stat(aFilename, &info) == 0) ? static_cast<uint64_t>(info.st_size) : 0;
+	}
+
+	static void preserveTimesAndPermissions(const int aSourceFd, const int aDestFd)
+	{
+		struct stat info;
+		if (fstat(aSourceFd, &info) != 0)
+			return;
+		#ifdef __linux__
+			const struct timespec times[2] = { info.st_atim, info.st_mtim };
+		#else
+			const struct timespec times[2] = { info.st_atimespec, info.st_mtimespec };
+		#endif
+		futimens(aDestFd, times);
+		fchmod(aDestFd, info.st_mode & 07777);
+	}
+
+	static void preserveTimesAndPermissions(const cpcc_char *aSourceFile, const cpcc_char *aDestFile)
+	{
+		const int source = ::open(aSourceFile, O_RDONLY);
+		const int dest = ::open(aDestFile, O_WRONLY);
+		if ((source >= 0) && (dest >= 0))
+			preserveTimesAndPermissions(source, dest);
+		if (source >= 0)
+			::close(source);
+		if (dest >= 0)
+			::close(dest);
+	}
+
+	#ifdef __linux__
+
+	static bool copyWithKernel(const cpcc_char *aSourceFile, const cpcc_char *aDestFile, const cpccFileCopyOptions &aOptions, bool &aFallBack)
+	{
+		aFallBack = false;
+		const int source = ::open(aSourceFile, O_RDONLY);
+		if (source < 0)
+			return false;
+		struct stat info;
+		const int dest = (fstat(source, &info) == 0) ? ::open(aDestFile, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+		if (dest < 0)
+		{
+			::close(source);
+			return false;
+		}
+		posix_fadvise(source, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		const uint64_t total = static_cast<uint64_t>(info.st_size);
+		uint64_t copied = 0;
+		bool ok = true, useCopyFileRange = true;
+		for (;;)
+		{
+			ssize_t n = useCopyFileRange ? copy_file_range(source, NULL, dest, NULL, kernelChunkBytes, 0) : sendfile(dest, source, NULL, kernelChunkBytes);
+			if ((n < 0) && useCopyFileRange && (copied == 0) && isUnsupported(errno))
+			{	// e.g. between different file systems on older kernels
+				useCopyFileRange = false;
+				continue;
+			}
+			if (n < 0)
+			{
+				ok = false;
+				aFallBack = (copied == 0) && isUnsupported(errno);
+				break;
+			}
+			if (n == 0)
+				break;
+			copied += static_cast<uint64_t>(n);
+			if (aOptions.progress && !aOptions.progress(copied, total))
+			{
+				ok = false;
+				break;
+			}
+		}
+
+		if (ok && aOptions.progress)
+			ok = aOptions.progress(copied, copied);
+		if (ok && aOptions.preserveTimesAndPermissions)
+			preserveTimesAndPermissions(source, dest);
+		::close(source);
+		ok = (::close(dest) == 0) && ok;
+		return ok;
+	}
+
+	static bool isUnsupported(const int anError)
+	{
+		return (anError == ENOSYS) || (anError == EXDEV) || (anError == EINVAL) || (anError == EOPNOTSUPP);
+	}
+
+	#else	// __APPLE__
+
+	static bool copyWithKernel(const cpcc_char *aSourceFile, const cpcc_char *aDestFile, const cpccFileCopyOptions &aOptions, bool &aFallBack)
+	{
+		aFallBack = false;
+		struct tContext
+		{
+			const cpccFileCopyOptions	*options;
+			uint64_t					total;
+		} context = { &aOptions, getSize(aSourceFile) };
+
+		copyfile_state_t state = copyfile_state_alloc();
+		if (!state)
+		{
+			aFallBack = true;
+			return false;
+		}
+		if (aOptions.progress)
+		{
+			copyfile_callback_t callback = [](int aWhat, int aStage, copyfile_state_t aState, const char *, const char *, void *aContext) -> int
+			{
+				if ((aWhat != COPYFILE_COPY_DATA) || (aStage != COPYFILE_PROGRESS))
+					return COPYFILE_CONTINUE;
+				const tContext &ctx = *static_cast<const tContext *>(aContext);
+				off_t copied = 0;
+				copyfile_state_get(aState, COPYFILE_STATE_COPIED, &copied);
+				return ctx.options->progress(static_cast<uint64_t>(copied), ctx.total) ? COPYFILE_CONTINUE : COPYFILE_QUIT;
+			};
+			copyfile_state_set(state, COPYFILE_STATE_STATUS_CB, reinterpret_cast<const void *>(callback));
+			copyfile_state_set(state, COPYFILE_STATE_STATUS_CTX, &context);
+		}
+
+		const copyfile_flags_t flags = COPYFILE_DATA | (aOptions.preserveTimesAndPermissions ? COPYFILE_STAT : 0);
+		const bool ok = (copyfile(aSourceFile, aDestFile, state, flags) == 0);
+		copyfile_state_free(state);
+		aFallBack = !ok && (errno == ENOTSUP);
+		if (ok && aOptions.progress)
+			return aOptions.progress(context.total, context.total);
+		return ok;
+	}
+
+	#endif
+
+#endif
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccFileCopy testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccFileCopy_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	const cpcc_string tmp(cpccFileSystemMini::getTempFilename());
+	const cpcc_string source(tmp + _T(".src")), kernelCopy(tmp + _T(".kernel")), bufferedCopy(tmp + _T(".buffered"));
+
+	// 3 MB and a bit, so that the copy needs several buffers
+	std::string data(3 * 1024 * 1024 + 123, ' ');
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = static_cast<char>((i * 7919) >> 5);
+	cpccFileSystemMini::writeToFile(source.c_str(), data.data(), data.size(), false);
+
+	cpccFileCopyOptions options;
+	options.preserveTimesAndPermissions = true;
+	uint64_t lastCopied = 0, lastTotal = 1;
+	options.progress = [&lastCopied, &lastTotal](uint64_t aCopied, uint64_t aTotal) { lastCopied = aCopied; lastTotal = aTotal; return true; };
+
+	TEST_EXPECT(cpccFileCopy::copy(source.c_str(), kernelCopy.c_str(), options), _T("#7272a: cpccFileCopy::copy()"));
+	TEST_EXPECT((lastCopied == data.size()) && (lastTotal == data.size()), _T("#7272b: cpccFileCopy progress"));
+
+	options.bufferBytes = 1000 * 1000;	// not a multiple of the alignment
+	TEST_EXPECT(cpccFileCopy::copyBuffered(source.c_str(), bufferedCopy.c_str(), options), _T("#7272c: cpccFileCopy::copyBuffered()"));
+
+	bool sameData = true;
+	const cpcc_string copies[2] = { kernelCopy, bufferedCopy };
+	for (const auto &copy : copies)
+	{
+		std::string readBack(data.size() + 1, '\0');
+		sameData = sameData && (cpccFileSystemMini::readFromFile(copy.c_str(), &readBack[0], readBack.size()) == data.size()) && (readBack.compare(0, data.size(), data) == 0);
+		sameData = sameData && (cpccFileSystem::getModificationDate(copy.c_str()) == cpccFileSystem::getModificationDate(source.c_str()));
+	}
+	TEST_EXPECT(sameData, _T("#7272d: cpccFileCopy copies differ from the source"));
+
+	// cancelled by the progress callback
+	options.progress = [](uint64_t, uint64_t) { return false; };
+	TEST_EXPECT(!cpccFileCopy::copyBuffered(source.c_str(), bufferedCopy.c_str(), options), _T("#7272e: cpccFileCopy was not cancelled"));
+
+	cpccFileSystem::deleteFile(source.c_str());
+	cpccFileSystem::deleteFile(kernelCopy.c_str());
+	cpccFileSystem::deleteFile(bufferedCopy.c_str());
+}
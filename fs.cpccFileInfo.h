@@ -0,0 +1,128 @@
+/*  *****************************************
+ *  File:		fs.cpccFileInfo.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				type, size, date and permissions of a file or folder, with one system call
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <ctime>
+#include <cstdio>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#else
+	#include <sys/types.h>
+	#include <sys/stat.h>
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+#include "fs.cpccPathHelper.h"
+#include "fs.cpccUserFolders.h"
+
+/*
+	Usage:
+		const cpccFileInfo info(cpccFileSystem::getFileInfo(_T("image.png")));
+		if (info.isFile())
+			showSize(info.size);
+
+	Normally called through cpccFileSystem::getFileInfo(), which also uses cpccStatCache if it is enabled.
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	struct cpccFileInfo
+//
+///////////////////////////////////////////////////////////////////////////////
+struct cpccFileInfo
+{
+	enum class tType { none = 0, file, folder, other };
+
+	tType			type = tType::none;		// none: the path does not exist or cannot be accessed
+	long long		size = -1;
+	time_t			modificationDate = 0;
+	unsigned int	permissions = 0;		// the POSIX bits, e.g. 0644. On Windows 0444 for read only files, else 0666 (+0111 for folders)
+
+	inline bool exists(void) const { return type != tType::none; }
+	inline bool isFile(void) const { return type == tType::file; }
+	inline bool isFolder(void) const { return type == tType::folder; }
+
+	/// asks the OS with one call: stat() or GetFileAttributesEx()
+	template<typename aPCharType>
+	static cpccFileInfo query(const aPCharType *aPath)
+	{
+		cpccFileInfo result;
+		if (!aPath)
+			return result;
+
+	#ifdef _WIN32
+		WIN32_FILE_ATTRIBUTE_DATA info;
+		if (!GetFileAttributesEx(aPath, GetFileExInfoStandard, &info))
+			return result;
+		const bool isFolder = (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		result.type = isFolder ? tType::folder : tType::file;
+		result.size = (static_cast<long long>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+		// 100-nanosecond intervals since 1601 -> seconds since 1970
+		const unsigned long long filetime = (static_cast<unsigned long long>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+		result.modificationDate = static_cast<time_t>(filetime / 10000000ULL - 11644473600ULL);
+		result.permissions = ((info.dwFileAttributes & FILE_ATTRIBUTE_READONLY) ? 0444 : 0666) | (isFolder ? 0111 : 0);
+	#else
+		struct stat info;
+		if (stat(aPath, &info) != 0)
+			return result;
+		result.type = S_ISREG(info.st_mode) ? tType::file : (S_ISDIR(info.st_mode) ? tType::folder : tType::other);
+		result.size = info.st_size;
+		result.modificationDate = info.st_mtime;
+		result.permissions = info.st_mode & 07777;
+	#endif
+		return result;
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		cpccFileInfo testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccFileInfo_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpcc_string folder(cpccUserFolders::getUsersTempDir());
+	cpccPathHelper::addTrailingPathDelimiter(folder);
+	const cpcc_string fn(folder + _T("cpccFileInfo_test.tmp"));
+	#pragma warning(suppress : 4996)
+	FILE *fp = cpcc_fopen(fn.c_str(), _T("wb"));
+	if (fp)
+	{
+		fwrite("0123456789", 1, 10, fp);
+		fclose(fp);
+	}
+
+	const cpccFileInfo info(cpccFileInfo::query(fn.c_str()));
+	TEST_EXPECT(info.isFile() && (info.size == 10) && (info.modificationDate > 0) && ((info.permissions & 0400) != 0), _T("#7275a: cpccFileInfo::query() of a file"));
+	TEST_EXPECT(cpccFileInfo::query(folder.c_str()).isFolder(), _T("#7275b: cpccFileInfo::query() of a folder"));
+
+	cpcc_remove(fn.c_str());
+	TEST_EXPECT(!cpccFileInfo::query(fn.c_str()).exists(), _T("#7275d: cpccFileInfo::query() of a missing file"));
+}
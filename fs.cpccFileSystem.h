@@ -22,6 +22,10 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <ctime>
@@ -35,6 +39,12 @@
 	#include <Windows.h> // for GetFileAttributesEx()
 #endif
 
+#include "cpccTesting.h"
+#include "fs.cpccFileInfo.h"
+#include "fs.cpccStatCache.h"
+#include "fs.cpccPathHelper.h"
+#include "fs.cpccUserFolders.h"
+
 
 
 // /////////////////////////////////
@@ -50,6 +60,14 @@ class cpccFileSystem
 
 public:  // functions   
 
+    /// type, size, date and permissions with one system call (none, if cpccStatCache has them)
+    template<typename aPCharType>
+    static cpccFileInfo getFileInfo(const aPCharType *aPath);
+
+    /// the same for many paths, asked from up to aMaxThreads threads. The results are in the order of aPaths.
+    template<typename aStringType>
+    static std::vector<cpccFileInfo> getFileInfo(const std::vector<aStringType> &aPaths, const unsigned int aMaxThreads = 8);
+
 	template<typename aPCharType>
     static long long getFileSize(const aPCharType *aFilename);
 
@@ -99,29 +117,44 @@ public: // utility functions
 #endif
 
 template<typename aPCharType>
-inline time_t		cpccFileSystem::getModificationDate(const aPCharType* aFilename)
-{	// http://linux.die.net/man/2/stat
+inline cpccFileInfo cpccFileSystem::getFileInfo(const aPCharType *aPath)
+{
+    cpccFileInfo info;
+    if (cpccStatCache::getInstance().lookup(aPath, info))
+        return info;
+    return cpccFileInfo::query(aPath);
+}
 
-    if (!fileExists(aFilename) && !folderExists(aFilename))
-        return 0;
 
-#ifdef _WIN32
-    WIN32_FILE_ATTRIBUTE_DATA fileInfoWin;
-    BOOL result = GetFileAttributesEx(aFilename, GetFileExInfoStandard, &fileInfoWin); // Returns non zero if succeed
-    if (!result) // If the function fails, the return value is zero (0). To get extended error information, call GetLastError.
-    {
-        // GetLastError();
-        return 0;
-    }
-    return filetime2time_t(fileInfoWin.ftLastWriteTime);
-#else
-    // _stat does not work on XP
-    cpcc_struct_stat attrib;         // create a file attribute structure
-    cpcc_stat(aFilename, &attrib);     // get the attributes
-    return attrib.st_mtime;
+template<typename aStringType>
+inline std::vector<cpccFileInfo> cpccFileSystem::getFileInfo(const std::vector<aStringType> &aPaths, const unsigned int aMaxThreads)
+{
+    std::vector<cpccFileInfo> results(aPaths.size());
 
-#endif
+    // a thread costs about as much as a few tens of stat() calls on a local disk
+    const size_t pathsPerThread = 32;
+    const size_t nThreads = std::min<size_t>(std::min<size_t>(aMaxThreads, std::thread::hardware_concurrency()), aPaths.size() / pathsPerThread);
+    std::atomic<size_t> next(0);
+    auto worker = [&aPaths, &results, &next]()
+        {
+            for (size_t i = next++; i < aPaths.size(); i = next++)
+                results[i] = getFileInfo(aPaths[i].c_str());
+        };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; ++t)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+        thread.join();
+    return results;
+}
 
+
+template<typename aPCharType>
+inline time_t		cpccFileSystem::getModificationDate(const aPCharType* aFilename)
+{	// http://linux.die.net/man/2/stat
+    return getFileInfo(aFilename).modificationDate;
 }
 
 
@@ -129,45 +162,15 @@ template<typename aPCharType>
 inline long long cpccFileSystem::getFileSize(const aPCharType *aFilename)
 {
     //  long is 4 byte in Visual Studio, so you have to use long long to get correct file size for big files on Windows
-    // On a Windows system this is implemented with a Windows specific GetFileAttributesEx(), or getfilesizeex(),
-    // on linux this is implemented as a lstat64(), and
-    // on the Macintosh it uses the Mac specific call getattrlist().
-
-
-    // for windows use getfilesizeex()
-    // https://docs.microsoft.com/en-gb/windows/win32/api/fileapi/nf-fileapi-getfilesizeex
+    // https://docs.microsoft.com/en-us/windows/win32/api/fileapi/ns-fileapi-win32_file_attribute_data
+    const cpccFileInfo info(getFileInfo(aFilename));
+    if (info.exists())
+        return info.size;
     #ifdef _WIN32
-        /*
-        // https://docs.microsoft.com/en-us/cpp/c-runtime-library/reference/stat-functions
-        // seems to fail under windows server 2003 32 bit
-        struct _stat64 stat_buf;
-        #ifdef UNICODE
-            int rc = _wstat64(aFilename, &stat_buf);
-        #else
-            int rc = _stat64(aFilename, &stat_buf);
-        #endif
-
-        return (rc == 0) ? stat_buf.st_size : -1;
-        */
-        // https://docs.microsoft.com/en-us/windows/win32/api/fileapi/ns-fileapi-win32_file_attribute_data
-        WIN32_FILE_ATTRIBUTE_DATA fileInfoWin;
-        BOOL result = GetFileAttributesEx(aFilename, GetFileExInfoStandard, &fileInfoWin); // Returns non zero if succeed
-        if (!result) // If the function fails, the return value is zero (0). To get extended error information, call GetLastError.
-        {
-            // GetLastError();
-            return 0;
-        }
-        
-        LARGE_INTEGER size;
-        size.HighPart = fileInfoWin.nFileSizeHigh;
-        size.LowPart = fileInfoWin.nFileSizeLow;
-        return size.QuadPart;
+        return 0;
     #else
-        struct stat stat_buf;
-        int rc = stat(aFilename, &stat_buf);
-        return (rc == 0) ? stat_buf.st_size : -1;
+        return -1;
     #endif
-
 }
 
 
@@ -176,6 +179,11 @@ inline bool cpccFileSystem::fileExists(const aPCharType *aFilename)
 {
     if (!aFilename)
         return false;
+
+    cpccFileInfo cached;
+    if (cpccStatCache::getInstance().lookup(aFilename, cached, false))
+        return cached.isFile();
+
     #ifdef _WIN32
         // _stat() does not work on WinXP.
         /*
@@ -192,7 +200,7 @@ inline bool cpccFileSystem::fileExists(const aPCharType *aFilename)
         DWORD dwAttrib = GetFileAttributes(aFilename);
         return (dwAttrib != INVALID_FILE_ATTRIBUTES && !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
 
-    #elif defined(__APPLE__)
+    #elif defined(__APPLE__) || defined(__linux__)
         struct stat fileinfo;
 
         // On success, zero is returned.
@@ -219,10 +227,13 @@ inline bool cpccFileSystem::renameFile(const aPCharType* filenameOld, const aPCh
     This creates issues when trying to write portable code.
     */
     #ifdef UNICODE
-        return (_trename(filenameOld, filenameNew)==0);
+        const bool result = (_trename(filenameOld, filenameNew)==0);
     #else
-        return (std::rename(filenameOld, filenameNew)==0);
+        const bool result = (std::rename(filenameOld, filenameNew)==0);
     #endif
+    cpccStatCache::getInstance().invalidate(filenameOld);
+    cpccStatCache::getInstance().invalidate(filenameNew);
+    return result;
 }
 
 
@@ -238,11 +249,12 @@ inline bool cpccFileSystem::deleteFile(const aPCharType* aFilename)
      this value can be printed to the standard error stream by a call to perror.
      */
     #ifdef UNICODE
-        return (_wremove(aFilename)==0);
+        const bool result = (_wremove(aFilename)==0);
     #else
-        return (remove(aFilename)==0);
+        const bool result = (remove(aFilename)==0);
     #endif
-
+    cpccStatCache::getInstance().invalidate(aFilename);
+    return result;
 }
 
 
@@ -254,15 +266,17 @@ inline bool cpccFileSystem::deleteFolder(const aPCharType * aFoldername)
     
     // Windows: To recursively delete the files in a directory, use the SHFileOperation function.
 	#ifdef UNICODE // for Unicode Windows 
-		return _wrmdir(aFoldername) == 0;
+		const bool result = (_wrmdir(aFoldername) == 0);
 	#else
         #ifdef _WIN32
             // 'rmdir': The POSIX name for this item is deprecated. Instead, use the ISO C and C++ conformant name: _rmdir.
-            return _rmdir(aFoldername) == 0;
+            const bool result = (_rmdir(aFoldername) == 0);
         #else
-            return rmdir(aFoldername) == 0;
+            const bool result = (rmdir(aFoldername) == 0);
         #endif
 	#endif
+    cpccStatCache::getInstance().invalidate(aFoldername);
+    return result;
 }
 
 
@@ -271,13 +285,18 @@ inline bool cpccFileSystem::folderExists(const aPCharType * aFoldername)
 {
     if (!aFoldername)
         return false;
+
+    cpccFileInfo cached;
+    if (cpccStatCache::getInstance().lookup(aFoldername, cached, false))
+        return cached.isFolder();
+
 #ifdef _WIN32
     DWORD attrib = GetFileAttributes(aFoldername);
     return (! ( attrib == 0xFFFFFFFF || !(attrib & FILE_ATTRIBUTE_DIRECTORY) ) );
     // Other way:
     // return (PathIsDirectory( aFilename ) == FILE_ATTRIBUTE_DIRECTORY);
     
-#elif defined(__APPLE__)
+#elif defined(__APPLE__) || defined(__linux__)
     struct stat fileinfo;
     if (stat(aFoldername, &fileinfo) == -1)
     {    // On success, zero is returned.
@@ -292,3 +311,45 @@ inline bool cpccFileSystem::folderExists(const aPCharType * aFoldername)
 #endif
     return false;
 }
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		cpccFileSystem::getFileInfo() testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccFileSystem_getFileInfo_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpcc_string folder(cpccUserFolders::getUsersTempDir());
+	cpccPathHelper::addTrailingPathDelimiter(folder);
+	const cpcc_string fn(folder + _T("cpccFileSystem_getFileInfo_test.tmp"));
+	#pragma warning(suppress : 4996)
+	FILE *fp = cpcc_fopen(fn.c_str(), _T("wb"));
+	if (fp)
+	{
+		fwrite("0123456789", 1, 10, fp);
+		fclose(fp);
+	}
+
+	// enough paths for several threads
+	std::vector<cpcc_string> paths;
+	for (int i = 0; i < 200; ++i)
+		paths.push_back((i % 3 == 0) ? fn : ((i % 3 == 1) ? folder : fn + _T(".missing")));
+	const std::vector<cpccFileInfo> infos(cpccFileSystem::getFileInfo(paths));
+	bool allOk = (infos.size() == paths.size());
+	for (size_t i = 0; allOk && (i < infos.size()); ++i)
+		allOk = (i % 3 == 0) ? (infos[i].size == 10) : ((i % 3 == 1) ? infos[i].isFolder() : !infos[i].exists());
+	TEST_EXPECT(allOk, _T("#7275c: cpccFileSystem::getFileInfo() of a list of paths"));
+
+	cpccFileSystem::deleteFile(fn.c_str());
+}
@@ -0,0 +1,437 @@
+/*  *****************************************
+ *  File:		fs.cpccStatCache.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				opt-in cache of the existence, size and date of files and folders
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <poll.h>
+	#include <unistd.h>
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+#include "fs.cpccFileInfo.h"
+#include "fs.cpccPathHelper.h"
+#include "fs.cpccUserFolders.h"
+
+/*
+	Usage:
+		cpccStatCache::getInstance().enable();		// e.g. at the start of the application
+
+	After that, cpccFileSystem::fileExists(), folderExists(), getFileSize() and getModificationDate()
+	answer repeated questions about the same path from a hash table, without a system call.
+
+	Coherency:
+		- the cpcc functions that create, write, rename or delete files update the cache at once.
+		- Linux: changes by other code or other processes are reported by inotify, which watches the
+		  folders of the cached paths. A background thread removes the changed entries, usually within
+		  a millisecond. Entries expire anyway after aWatchedTtlMsec, for changes inotify does not report
+		  (e.g. a parent of the watched folder was renamed).
+		- Windows, macOS: the entries expire after aTtlMsec.
+	Appending to a file keeps its "exists" answer in the cache and refreshes only its size and date,
+	so that the log can check its file on every line.
+	Only paths of cpcc_char are cached.
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccStatCache
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccStatCache
+{
+private:
+	typedef std::chrono::steady_clock tClock;
+
+	struct tEntry
+	{
+		cpccFileInfo		info;
+		bool				detailsAreValid;	// false after the file was written: size and date must be asked again
+		tClock::time_point	expires;
+	};
+
+	enum { maxEntries = 4096, maxWatchedFolders = 256 };
+
+	std::mutex								m_mutex;
+	std::atomic<bool>						m_enabled;
+	std::unordered_map<cpcc_string, tEntry>	m_entries;
+	std::chrono::milliseconds				m_ttl, m_watchedTtl;
+	uint64_t								m_generation = 0,	// increased by every invalidation
+											m_hits = 0,
+											m_misses = 0;
+
+#ifdef __linux__
+	int										m_inotifyFd = -1;
+	std::thread								*m_watcherThread = NULL;
+	std::atomic<bool>						m_stopWatcher;
+	std::map<cpcc_string, int>				m_watchOfFolder;	// folder prefix (with the trailing '/') -> watch descriptor
+	std::multimap<int, cpcc_string>			m_foldersOfWatch;	// several spellings of a folder can share a watch
+#endif
+
+	cpccStatCache(): m_enabled(false), m_ttl(1000), m_watchedTtl(60000)
+	#ifdef __linux__
+		, m_stopWatcher(false)
+	#endif
+	{ }
+
+	cpccStatCache(const cpccStatCache& x) = delete;
+	cpccStatCache& operator=(const cpccStatCache& x) = delete;
+
+public:
+
+	static cpccStatCache &getInstance(void)
+	{
+		static cpccStatCache* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccStatCache;
+		return *_instPtr;
+	}
+
+	void enable(const unsigned int aTtlMsec = 1000, const unsigned int aWatchedTtlMsec = 60000)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ttl = std::chrono::milliseconds(aTtlMsec);
+		m_watchedTtl = std::chrono::milliseconds(aWatchedTtlMsec);
+		m_entries.clear();
+		++m_generation;
+	#ifdef __linux__
+		if (m_inotifyFd < 0)
+		{
+			m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (m_inotifyFd >= 0)
+			{
+				m_stopWatcher = false;
+				m_watcherThread = new std::thread(&cpccStatCache::watcherThreadFunction, this);
+			}
+		}
+	#endif
+		m_enabled = true;
+	}
+
+	void disable(void)
+	{
+		m_enabled = false;
+	#ifdef __linux__
+		if (m_watcherThread)
+		{
+			m_stopWatcher = true;
+			m_watcherThread->join();
+			delete m_watcherThread;
+			m_watcherThread = NULL;
+		}
+	#endif
+		std::lock_guard<std::mutex> lock(m_mutex);
+	#ifdef __linux__
+		if (m_inotifyFd >= 0)
+			close(m_inotifyFd);	// removes the watches too
+		m_inotifyFd = -1;
+		m_watchOfFolder.clear();
+		m_foldersOfWatch.clear();
+	#endif
+		m_entries.clear();
+		++m_generation;
+	}
+
+	inline bool isEnabled(void) const { return m_enabled.load(std::memory_order_relaxed); }
+
+	uint64_t getHits(void) { std::lock_guard<std::mutex> lock(m_mutex); return m_hits; }
+	uint64_t getMisses(void) { std::lock_guard<std::mutex> lock(m_mutex); return m_misses; }
+
+	/// returns false if the cache is disabled; the caller then asks the OS itself.
+	/// aNeedsDetails: the size and the date are needed, not only the type.
+	template<typename aPCharType>
+	bool lookup(const aPCharType *, cpccFileInfo &, const bool = true) { return false; }
+
+	bool lookup(const cpcc_char *aPath, cpccFileInfo &aInfo, const bool aNeedsDetails = true)
+	{
+		if (!aPath || !isEnabled())
+			return false;
+
+		const cpcc_string path(aPath);
+		uint64_t generation;
+		bool watched = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			const auto it = m_entries.find(path);
+			if ((it != m_entries.end()) && (tClock::now() < it->second.expires) && (it->second.detailsAreValid || !aNeedsDetails))
+			{
+				++m_hits;
+				aInfo = it->second.info;
+				return true;
+			}
+			++m_misses;
+		#ifdef __linux__
+			// before asking the OS, so that a change after the question is reported
+			watched = watchFolderOf(path);
+		#endif
+			generation = m_generation;
+		}
+
+		aInfo = cpccFileInfo::query(aPath);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (isEnabled() && (generation == m_generation))	// else something changed meanwhile and the answer may be old
+		{
+			if (m_entries.size() >= maxEntries)
+				m_entries.clear();
+			tEntry &entry = m_entries[path];
+			entry.info = aInfo;
+			entry.detailsAreValid = true;
+			entry.expires = tClock::now() + (watched ? m_watchedTtl : m_ttl);
+		}
+		return true;
+	}
+
+	/// the path was created, deleted or renamed. For folders the paths inside it are forgotten too.
+	template<typename aPCharType>
+	void invalidate(const aPCharType *) { }
+
+	void invalidate(const cpcc_char *aPath)
+	{
+		if (!aPath || !isEnabled())
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		erasePath(aPath, true);
+	}
+
+	/// the file was written: its size and date changed. If it did not exist before, it was created.
+	template<typename aPCharType>
+	void contentChanged(const aPCharType *) { }
+
+	void contentChanged(const cpcc_char *aPath)
+	{
+		if (!aPath || !isEnabled())
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		markContentChanged(aPath);
+	}
+
+	void invalidateAll(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.clear();
+		++m_generation;
+	}
+
+private:
+
+	// call with m_mutex locked
+	void erasePath(const cpcc_string &aPath, const bool aAlsoInside)
+	{
+		++m_generation;
+		m_entries.erase(aPath);
+		if (!aAlsoInside)
+			return;
+		for (const cpcc_char *separator = separators(); *separator; ++separator)
+		{
+			cpcc_string prefix(aPath);
+			if (prefix.empty() || (prefix.back() != *separator))
+				prefix.push_back(*separator);
+			erasePrefix(prefix);
+		}
+	}
+
+	void erasePrefix(const cpcc_string &aPrefix)
+	{
+		++m_generation;
+		for (auto it = m_entries.begin(); it != m_entries.end(); )
+			if (it->first.compare(0, aPrefix.length(), aPrefix) == 0)
+				it = m_entries.erase(it);
+			else
+				++it;
+	}
+
+	void markContentChanged(const cpcc_string &aPath)
+	{
+		++m_generation;
+		const auto it = m_entries.find(aPath);
+		if (it == m_entries.end())
+			return;
+		if (it->second.info.isFile())
+			it->second.detailsAreValid = false;
+		else
+			m_entries.erase(it);
+	}
+
+	static const cpcc_char *separators(void)
+	{
+	#ifdef _WIN32
+		return _T("\\/");
+	#else
+		return _T("/");
+	#endif
+	}
+
+#ifdef __linux__
+
+	// call with m_mutex locked. Returns true if the folder of the path is watched.
+	bool watchFolderOf(const cpcc_string &aPath)
+	{
+		if (m_inotifyFd < 0)
+			return false;
+		const size_t slash = aPath.find_last_of(_T('/'));
+		if (slash == aPath.length() - 1)
+			return false;	// e.g. "/" or "folder/"
+		const cpcc_string prefix((slash == cpcc_string::npos) ? cpcc_string() : aPath.substr(0, slash + 1));
+		if (m_watchOfFolder.count(prefix))
+			return true;
+		if (m_watchOfFolder.size() >= maxWatchedFolders)
+			return false;
+
+		const uint32_t events = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+		const int wd = inotify_add_watch(m_inotifyFd, prefix.empty() ? "." : prefix.c_str(), events);
+		if (wd < 0)
+			return false;	// e.g. the folder does not exist
+		m_watchOfFolder[prefix] = wd;
+		m_foldersOfWatch.insert(std::make_pair(wd, prefix));
+		return true;
+	}
+
+	void watcherThreadFunction(void)
+	{
+		alignas(struct inotify_event) char buffer[16 * 1024];
+		while (!m_stopWatcher)
+		{
+			struct pollfd pfd = { m_inotifyFd, POLLIN, 0 };
+			if (poll(&pfd, 1, 200) <= 0)
+				continue;
+			const ssize_t n = read(m_inotifyFd, buffer, sizeof(buffer));
+			if (n <= 0)
+				continue;
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (ssize_t pos = 0; pos < n; )
+			{
+				const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + pos);
+				pos += sizeof(struct inotify_event) + event->len;
+				onEvent(*event);
+			}
+		}
+	}
+
+	// call with m_mutex locked
+	void onEvent(const struct inotify_event &anEvent)
+	{
+		if (anEvent.mask & IN_Q_OVERFLOW)
+		{
+			m_entries.clear();
+			++m_generation;
+			return;
+		}
+
+		const auto folders = m_foldersOfWatch.equal_range(anEvent.wd);
+		if (anEvent.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+		{	// the paths inside the folder now point to something else, or to nothing
+			for (auto it = folders.first; it != folders.second; ++it)
+				erasePrefix(it->second);
+			if (anEvent.mask & IN_IGNORED)
+			{	// the watch was removed by the kernel
+				for (auto it = folders.first; it != folders.second; ++it)
+					m_watchOfFolder.erase(it->second);
+				m_foldersOfWatch.erase(folders.first, folders.second);
+			}
+			return;
+		}
+		if (anEvent.len == 0)
+			return;
+
+		const bool existenceChanged = (anEvent.mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) != 0;
+		for (auto it = folders.first; it != folders.second; ++it)
+		{
+			const cpcc_string path(it->second + anEvent.name);
+			if (existenceChanged)
+				erasePath(path, (anEvent.mask & IN_ISDIR) != 0);
+			else
+				markContentChanged(path);
+		}
+	}
+
+#endif
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		cpccStatCache testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccStatCache_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpccStatCache &cache = cpccStatCache::getInstance();
+	const bool wasEnabled = cache.isEnabled();
+	cache.enable(100);
+
+	cpcc_string fn(cpccUserFolders::getUsersTempDir());
+	cpccPathHelper::addTrailingPathDelimiter(fn);
+	fn.append(_T("cpccStatCache_test.tmp"));
+	cpccFileInfo info;
+	TEST_EXPECT(cache.lookup(fn.c_str(), info) && !info.exists(), _T("#7274a: cpccStatCache: the file should not exist yet"));
+
+	// changes that the cache is told about, as the cpcc functions do, are seen at once
+	auto writeFile = [&fn](const bool aAppend, const char *aText)
+		{
+			#pragma warning(suppress : 4996)
+			FILE *fp = cpcc_fopen(fn.c_str(), aAppend ? _T("ab") : _T("wb"));
+			if (fp)
+			{
+				fwrite(aText, 1, strlen(aText), fp);
+				fclose(fp);
+			}
+		};
+	writeFile(false, "0123456789");
+	cache.contentChanged(fn.c_str());
+	TEST_EXPECT(cache.lookup(fn.c_str(), info) && info.isFile() && (info.size == 10), _T("#7274b: cpccStatCache after a new file"));
+	const uint64_t hits = cache.getHits();
+	TEST_EXPECT(cache.lookup(fn.c_str(), info) && cache.lookup(fn.c_str(), info, false) && (cache.getHits() == hits + 2), _T("#7274c: cpccStatCache hits"));
+	writeFile(true, "abc");
+	cache.contentChanged(fn.c_str());
+	TEST_EXPECT(cache.lookup(fn.c_str(), info) && (info.size == 13), _T("#7274d: cpccStatCache after appending"));
+
+	// changes by other code are seen after the inotify event or the TTL
+	writeFile(true, "xyz");
+	for (int i = 0; (i < 100) && cache.lookup(fn.c_str(), info) && (info.size != 16); ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	TEST_EXPECT(info.size == 16, _T("#7274e: cpccStatCache did not see the external change"));
+
+	cpcc_remove(fn.c_str());
+	cache.invalidate(fn.c_str());
+	TEST_EXPECT(cache.lookup(fn.c_str(), info) && !info.exists(), _T("#7274f: cpccStatCache after deleting the file"));
+
+	if (!wasEnabled)
+		cache.disable();
+}
@@ -55,6 +55,8 @@
 #include "fs.cpccPathHelper.h"
 #include "fs.cpccSystemFolders.h"
 #include "fs.cpccUserFolders.h"
+#include "fs.cpccFileCopy.h"
+#include "fs.cpccAtomicFile.h"
 #if defined(cpccFileSystemMini_DoSelfTest)
 	#include "cpcc_SelfTest.h"
 #endif
@@ -169,33 +171,18 @@ bool cpccFileSystemMini::copyFile(const cpcc_char * sourceFile, const cpcc_char
 }
 
 
-bool cpccFileSystemMini::writeTextFile(const cpcc_char* aFilename, const cpcc_char *aTxt, const bool inUTF8)
+bool cpccFileSystemMini::writeTextFile(const cpcc_char* aFilename, const cpcc_char *aTxt, const bool inUTF8, const bool aDurable)
 {
-    if (!aFilename)
+    if (!aFilename || !aTxt)
         return false;
 
-    cpcc_ofstream _file(aFilename);
-    if (!_file.good())
+    // a new file replaces the old one with one rename, so that a crash while saving does not leave a half written file
+    if (!cpccAtomicFile::replaceText(aFilename, aTxt, inUTF8, aDurable))
     {
 #pragma warning(suppress : 4996)
         cpcc_cerr << _T("Error saving file ") << aFilename << _T(" Error message:") << strerror(errno) << _T("\n");
         return false;
     }
-
-    if (inUTF8) // write the BOM of UTF-8 and set locale
-    {
-        // _file << UTF8_BOM;
-        //_file.write(BOM_UTF8, 3);
-
-        // http://www.cplusplus.com/forum/beginner/107125/
-        std::locale my_utf8_locale(std::locale(), new std::codecvt_utf8<wchar_t>);
-		std::locale namedObject_loc = _file.imbue(my_utf8_locale); // namedObject_loc is  to suppress warning C26444
-		
-        // _file << helper_to_utf8(aTxt, cpcc_strlen(aTxt));
-    }
-
-    _file << aTxt;
-    _file.close();
     return true;
 }
 
@@ -219,6 +206,7 @@ bool cpccFileSystemMini::appendTextFile(const cpcc_char* aFilename, const cpcc_c
 	if (!fp) return false;
 	cpcc_fprintf(fp,_T("%s"),txt);
 	fclose(fp);
+	cpccStatCache::getInstance().contentChanged(aFilename);
 	return true;
 #else
     // std::ofstream outfile("thefile.txt", std::ios_base::app | std::ios_base::out);
@@ -237,6 +225,7 @@ bool cpccFileSystemMini::appendTextFile(const cpcc_char* aFilename, const cpcc_c
     ofs << txt;
     // _f << fflush;
     ofs.close();
+    cpccStatCache::getInstance().contentChanged(aFilename);
     return true;
 #endif
 }
@@ -249,6 +238,7 @@ bool cpccFileSystemMini::createFolder(const cpcc_char * aFoldername)
 
 #ifdef _WIN32
 	::CreateDirectory(aFoldername, NULL);
+	cpccStatCache::getInstance().invalidate(aFoldername);
 #elif defined(__APPLE__)
     /* it will probably fail if the folder starts with tilde (~)
         expand the tilde before calling the function
@@ -272,10 +262,12 @@ bool cpccFileSystemMini::createFolder(const cpcc_char * aFoldername)
 	// full permissions for all
 	//mode_t p777 = S_IRWXU | S_IRWXG | S_IRWXO;
     #if TARGET_OS_IPHONE
-        return fileSystemOSX_helper::createFolder(finalPath.c_str(), parentPermissions);
+        const bool created = fileSystemOSX_helper::createFolder(finalPath.c_str(), parentPermissions);
     #elif TARGET_OS_MAC
-        return fileSystemOSX_helper::createFolder_Linux(finalPath.c_str(), parentPermissions);
+        const bool created = fileSystemOSX_helper::createFolder_Linux(finalPath.c_str(), parentPermissions);
     #endif
+    cpccStatCache::getInstance().invalidate(aFoldername);
+    return created;
     
 #endif
 
@@ -305,6 +297,10 @@ size_t	cpccFileSystemMini::writeToFile(const cpcc_char *aFilename, const char *b
 		res=-2;
 		
     fclose (pFile);
+    if (appendToFile)
+        cpccStatCache::getInstance().contentChanged(aFilename);
+    else
+        cpccStatCache::getInstance().invalidate(aFilename);
     return res;
 }
 	
@@ -333,35 +329,9 @@ size_t	cpccFileSystemMini::readFromFile(const cpcc_char *aFilename, char *buffer
 
 bool	cpccFileSystemMini::copyFileToaFile(const cpcc_char* sourceFile, const cpcc_char* destFile)
 {
-	// You may use std::fopen, std::fread, std::fwrite, and std::fclose, 
-	// all of which are part of the standard C++ library (#include <cstdio>, very portable)
-	// http://msdn.microsoft.com/en-us/library/yeby3zcb%28v=vs.90%29.aspx
-
-	char buf[4096];
-	size_t size;
-	
-	#ifdef _WIN32
-		#pragma warning( disable : 4996 )
-	#endif
-	FILE* source = cpcc_fopen(sourceFile, _T("rb")); // todo: unicode
-	if (!source) 
-		return false;
-	
-	FILE* dest = cpcc_fopen(destFile, _T("wb")); // todo: unicode
-	if (!dest) 
-	{
-		fclose(source);
-		return false;
-	}
-
-	bool errorOccured=false;
-	while ((!errorOccured) && (size = fread(buf, 1, BUFSIZ, source))) 
-		errorOccured = ( fwrite(buf, 1, size, dest) != size );
-	
-	fclose(source);
-	fclose(dest);
-	
-	return (!errorOccured);
+	// the kernel copies the data (CopyFileEx, copyfile, copy_file_range) and there is a buffered fallback.
+	// For progress reporting or keeping the times, call cpccFileCopy::copy() directly.
+	return cpccFileCopy::copy(sourceFile, destFile);
 }
 
 
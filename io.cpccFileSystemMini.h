@@ -16,10 +16,14 @@
 
 #include <string>
 #include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 
 #include "cpccUnicodeSupport.h"
 #include "fs.cpccFileSystem.h"
 #include "core.cpccIdeMacros.h" 
+#include "cpccTesting.h"
 
 
 #define 	cpccFileSystemMini_DoSelfTest	true
@@ -63,12 +67,18 @@ public:
 	static size_t	readFromFile(const cpcc_char *aFilename, char *buffer, const size_t bufSize);
 	
 
-	/// the destFile must be a file specification, not a folder specification
+	/// the destFile must be a file specification, not a folder specification. See also fs.cpccFileCopy.h
 	static bool copyFileToaFile(const cpcc_char* sourceFile, const cpcc_char* destFile);
 	static bool createEmptyFile(const cpcc_char * aFilename);
 	static bool appendTextFile(const cpcc_char* aFilename, const cpcc_char *txt);
-    static bool writeTextFile(const cpcc_char* aFilename, const cpcc_char *aTxt, const bool inUTF8);
+    /// replaces the file atomically. aDurable: the file also survives a power loss, see cpccAtomicFileGroup
+    static bool writeTextFile(const cpcc_char* aFilename, const cpcc_char *aTxt, const bool inUTF8, const bool aDurable = false);
     inline static bool fileContainsText(const cpcc_char *fn, const cpcc_char *txt);
+    /// searches for several texts with one pass over the file. aFound[i] is set if aTexts[i] was found.
+    /// aWindowBytes > 0: only the first and the last aWindowBytes are searched, so that the cost does not grow with the file size.
+    /// 0: the whole file is searched. The file is searched in chunks of aChunkBytes, so every page is read once,
+    /// and the pass stops when all the texts are found.
+    inline static void fileContainsTexts(const cpcc_char *fn, const char * const aTexts[], bool aFound[], const size_t nTexts, const size_t aWindowBytes = 0, const size_t aChunkBytes = 1024 * 1024);
 
 	#ifdef _WIN32
 	    #ifdef UNICODE
@@ -149,3 +159,152 @@ bool    cpccFileSystemMini::fileContainsText(const cpcc_char *fn, const cpcc_cha
     thefile.close();
     return false;
     }
+
+
+void    cpccFileSystemMini::fileContainsTexts(const cpcc_char *fn, const char * const aTexts[], bool aFound[], const size_t nTexts, const size_t aWindowBytes, const size_t aChunkBytes)
+{
+    size_t maxTextLength = 0, nFound = 0;
+    for (size_t i = 0; i < nTexts; ++i)
+    {
+        aFound[i] = false;
+        const size_t len = strlen(aTexts[i]);
+        if (len > maxTextLength)
+            maxTextLength = len;
+    }
+
+    if (!fn || (maxTextLength == 0))
+        return;
+
+    // Buffered reads, not a memory mapping: the previous log can be truncated by another instance
+    // while it is searched, and a truncated mapping crashes the reader (SIGBUS).
+    // The size is a snapshot; a file that shrinks meanwhile only ends the reading earlier.
+    const long long fileSize = cpccFileSystemMini::getFileSize(fn);
+    if (fileSize <= 0)
+        return;
+    #pragma warning(suppress : 4996)
+    FILE *fp = cpcc_fopen(fn, _T("rb"));
+    if (!fp)
+        return;
+
+    // the first window and the last one, or the whole file
+    const long long window = static_cast<long long>(aWindowBytes);
+    const bool inWindows = (window > 0) && (fileSize > 2 * window);
+    const long long rangeStart[2] = { 0, inWindows ? fileSize - window : fileSize };
+    const long long rangeEnd[2] = { inWindows ? window : fileSize, fileSize };
+    const size_t chunkBytes = (aChunkBytes > 0) ? aChunkBytes : 1;
+
+    std::string buffer;
+    buffer.reserve(chunkBytes + maxTextLength);
+    for (int range = 0; (range < 2) && (nFound < nTexts); ++range)
+    {
+        if (rangeStart[range] >= rangeEnd[range])
+            continue;
+        #ifdef _WIN32
+            if (_fseeki64(fp, rangeStart[range], SEEK_SET) != 0)
+        #else
+            if (fseeko(fp, static_cast<off_t>(rangeStart[range]), SEEK_SET) != 0)
+        #endif
+                break;
+
+        buffer.clear();
+        long long remaining = rangeEnd[range] - rangeStart[range];
+        while ((remaining > 0) && (nFound < nTexts))
+        {
+            // keep the last maxTextLength-1 bytes of the previous chunk, for a text that crosses into this one
+            if (buffer.length() >= maxTextLength)
+                buffer.erase(0, buffer.length() - (maxTextLength - 1));
+            const size_t keptBytes = buffer.length();
+            const size_t toRead = (remaining < static_cast<long long>(chunkBytes)) ? static_cast<size_t>(remaining) : chunkBytes;
+            buffer.resize(keptBytes + toRead);
+            const size_t nRead = fread(&buffer[keptBytes], 1, toRead, fp);
+            buffer.resize(keptBytes + nRead);
+            if (nRead == 0)
+                break;
+            remaining -= static_cast<long long>(nRead);
+
+            for (size_t i = 0; i < nTexts; ++i)
+                if (!aFound[i] && (buffer.find(aTexts[i]) != std::string::npos))
+                {
+                    aFound[i] = true;
+                    ++nFound;
+                }
+        }
+    }
+    fclose(fp);
+}
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		cpccFileSystemMini::fileContainsTexts() testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccFileSystemMini_fileContainsTexts_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	// chunks of 16 bytes: the texts are in the middle of the file and across a chunk boundary
+	const cpcc_string fn(cpccFileSystemMini::getTempFilename());
+	std::string text;
+	for (int i = 0; i < 100; ++i)
+		text.append((i == 50) ? "ERROR>\tsomething failed\n" : "Info>\tline\n");
+	text.append("closing stamp");
+	cpccFileSystemMini::writeToFile(fn.c_str(), text.c_str(), text.length(), false);
+
+	const char * const texts[4] = { "Info>", "ERROR>\t", "closing stamp", "not there" };
+	bool found[4];
+	cpccFileSystemMini::fileContainsTexts(fn.c_str(), texts, found, 4, 0, 16);
+	TEST_EXPECT(found[0] && found[1] && found[2] && !found[3], _T("#7283a: cpccFileSystemMini::fileContainsTexts() with small chunks"));
+	cpccFileSystemMini::fileContainsTexts(fn.c_str(), texts, found, 4);
+	TEST_EXPECT(found[0] && found[1] && found[2] && !found[3], _T("#7283b: cpccFileSystemMini::fileContainsTexts()"));
+
+	// windows of 100 bytes: the error line in the middle is not read
+	cpccFileSystemMini::fileContainsTexts(fn.c_str(), texts, found, 4, 100, 16);
+	TEST_EXPECT(found[0] && !found[1] && found[2] && !found[3], _T("#7283c: cpccFileSystemMini::fileContainsTexts() in the first and last bytes"));
+
+	cpccFileSystem::deleteFile(fn.c_str());
+}
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		cpccStatCache with the functions of cpccFileSystemMini that change files
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccFileSystemMini_statCache_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	// with a long TTL, the changes can only be seen because cpccFileSystemMini tells the cache
+	cpccStatCache &cache = cpccStatCache::getInstance();
+	const bool wasEnabled = cache.isEnabled();
+	cache.enable(60000, 60000);
+
+	const cpcc_string fn(cpccFileSystemMini::getTempFilename());
+	TEST_EXPECT(!cpccFileSystem::fileExists(fn.c_str()), _T("#7274g: cpccStatCache: the file should not exist yet"));
+	cpccFileSystemMini::writeToFile(fn.c_str(), "0123456789", 10, false);
+	TEST_EXPECT(cpccFileSystem::fileExists(fn.c_str()) && (cpccFileSystem::getFileSize(fn.c_str()) == 10), _T("#7274h: cpccStatCache after writeToFile()"));
+	cpccFileSystemMini::writeToFile(fn.c_str(), "abc", 3, true);
+	TEST_EXPECT(cpccFileSystem::getFileSize(fn.c_str()) == 13, _T("#7274i: cpccStatCache after appending"));
+	cpccFileSystem::deleteFile(fn.c_str());
+	TEST_EXPECT(!cpccFileSystem::fileExists(fn.c_str()), _T("#7274j: cpccStatCache after deleteFile()"));
+
+	if (!wasEnabled)
+		cache.disable();
+}
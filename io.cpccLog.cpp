@@ -24,13 +24,19 @@
 #include "cpcc_SelfTest.h"
 #include "core.cpccIdeMacros.h"
 #include "core.cpccTryAndCatch.h"
+#include "core.cpccStringUtil.h"
 #include "io.cpccLogFileWriterWithBuffer.h"
+#include "io.cpccLogTimestamp.h"
+#include "io.cpccLogFlightRecorder.h"
+#include "io.cpccLogProfiler.h"
 #include "fs.cpccUserFolders.h"
 
-#define cpccLogOpeningStamp		_T("cpccLog starting")
-#define cpccLogClosingStamp		_T("cpccLog closing. Bye bye...")
+#define cpccLogOpeningStampA	"cpccLog starting"
+#define cpccLogClosingStampA	"cpccLog closing. Bye bye..."
+#define cpccLogOpeningStamp		_T(cpccLogOpeningStampA)
+#define cpccLogClosingStamp		_T(cpccLogClosingStampA)
+#define cpccLogErrorMarkerExtension	_T(".errors")
 
-int		cpccLogFormatter::m_IdentLevel = 0;
 bool    cpccLogFormatter::m_enabled(true);
 
 
@@ -42,9 +48,10 @@ bool    cpccLogFormatter::m_enabled(true);
 ///////////////////////////////////////////////////////////////////////////////
 
 
-cpccLogFormatter::cpccLogFormatter(const cpcc_char *aTag, const bool disableIfFileDoesNotExist, const bool echoToConsole) :
+cpccLogFormatter::cpccLogFormatter(const cpcc_char *aTag, const bool disableIfFileDoesNotExist, const bool echoToConsole, const cpccLogLevel aLevel) :
 	m_tag(aTag ? aTag : _T("NULL aTag ")),
-	//m_IdentText(_T("| ")),
+	m_tagSite(m_tag.c_str()),
+	m_level(aLevel),
 	m_disableIfFileDoesNotExist(disableIfFileDoesNotExist),
 	m_echoToConsole(echoToConsole),
 	m_isEmpty(true)
@@ -55,11 +62,11 @@ cpccLogFormatter::cpccLogFormatter(const cpcc_char *aTag, const bool disableIfFi
 	
 }
 
-void cpccLogFormatter::add(const cpcc_char* txt)
+void cpccLogFormatter::write(const cpcc_char* txt)
 {
 	if (!txt)
 	{
-		std::cerr << "cpccLogFormatter::add(NULL)" << std::endl;
+		std::cerr << "cpccLogFormatter::write(NULL)" << std::endl;
 		return;
 	}
 
@@ -69,16 +76,14 @@ void cpccLogFormatter::add(const cpcc_char* txt)
 	if (!m_enabled)
 		return;
 
-	cpcc_string _fn(cpccLogFileWriterWithBuffer::getInstance().getFilename());
-
-
-	if ((_fn.length()>0) && !cpccFileSystemMini::fileExists(_fn.c_str()) && (!m_disableIfFileDoesNotExist))
-		cpccFileSystemMini::createEmptyFile(_fn.c_str());	// create a file so that the log can continue wrting on it.
-
-	cpcc_string m_outputBuffer;
-	if (moreThanOneSecondPassed())
+	// reused by every call from the same thread, so that building the line does not allocate memory
+	static thread_local cpcc_string m_outputBuffer;
+	m_outputBuffer.clear();
+	cpccLogTimestamp &timestamp = cpccLogTimestamp::getInstance();
+	const int64_t microseconds = timestamp.getMicrosecondsSinceStart();
+	if (timestamp.newSecondStarted(microseconds))
     {
-        m_outputBuffer.append( getCurrentTime(_T("     \t%F  %X")) );
+        timestamp.appendPrefix(m_outputBuffer);
         m_outputBuffer.append(_T("\n"));
     }
 
@@ -86,26 +91,71 @@ void cpccLogFormatter::add(const cpcc_char* txt)
     if (! (m_tag.length()>0) )
         std::cerr << "Error: #5613b: !(m_tag.length()>0) with text=" << txt << std::endl;
     
-    m_outputBuffer.append(m_tag);
+	appendLine(m_outputBuffer, microseconds, cpccLogContext::getThreadNo(), cpccLogContext::getScopePath(), cpccLogContext::getIndentLevel(), txt);
+	writeLine(m_outputBuffer);
+}
 
-	for (int i = 0; i<m_IdentLevel; ++i)
-		m_outputBuffer.append(m_IdentText);
-    
-	m_outputBuffer.append(txt);
-	m_outputBuffer.append(_T("\n"));
-	
-	// cpccFileSystemMini::appendTextFile(m_filename, m_outputBuffer);
-	cpccLogFileWriterWithBuffer::getInstance().add(m_outputBuffer.c_str());
+
+void cpccLogFormatter::appendLine(cpcc_string &aLine, const int64_t aMicroseconds, const uint32_t aThreadNo, const cpcc_string &aScopePath, const int aIndent, const cpcc_char* txt) const
+{
+	aLine.append(m_tag);
+	cpccLogTimestamp::appendOffset(aLine, aMicroseconds);	// seconds.microseconds since the log started
+	aLine.append(_T("\t"));
+	cpccLogContext::appendContext(aLine, aThreadNo, aScopePath);
+	cpccLogContext::appendIndent(aLine, aIndent);
+	aLine.append(txt);
+	aLine.append(_T("\n"));
+}
+
+
+void cpccLogFormatter::writeRecord(cpcc_string &aRecord)
+{
+	cpccLogRecordWriter &recordWriter = cpccLogRecordWriter::getInstance();
+	if (recordWriter.getOutput() == cpccLogRecordOutput::alongside)
+	{
+		recordWriter.write(aRecord);
+		noteWritten();
+		return;
+	}
+
+	aRecord.push_back(_T('\n'));
+	writeLine(aRecord);
+}
+
+
+void cpccLogFormatter::writeLine(const cpcc_string &aLine)
+{
+	const cpcc_string &_fn(cpccLogFileWriterWithBuffer::getInstance().getFilename());
+
+	if ((_fn.length()>0) && !cpccFileSystemMini::fileExists(_fn.c_str()) && (!m_disableIfFileDoesNotExist))
+		cpccFileSystemMini::createEmptyFile(_fn.c_str());	// create a file so that the log can continue wrting on it.
+
+	// cpccFileSystemMini::appendTextFile(m_filename, aLine);
+	cpccLogFileWriterWithBuffer &fileWriter = cpccLogFileWriterWithBuffer::getInstance();
+	fileWriter.add(aLine.c_str());
+
+	// in async mode the writer thread copies the lines to the flight recorder, after each batch
+	cpccLogFlightRecorder &flightRecorder = cpccLogFlightRecorder::getInstance();
+	if (flightRecorder.isEnabled() && !fileWriter.isAsyncMode())
+		flightRecorder.write(aLine);
 
 	if (m_echoToConsole)
 	{
-		cpcc_cout << m_outputBuffer;
+		cpcc_cout << aLine;
 	    #if defined(_WIN32)
-			OutputDebugString(m_outputBuffer.c_str());
+			OutputDebugString(aLine.c_str());
 	    #endif
 	}
 
+	noteWritten();
+}
+
+
+void cpccLogFormatter::noteWritten(void)
+{
 	m_isEmpty = false;
+	if (m_level == cpccLogLevel::error)
+		cpccLogManager::markErrors();
 }
 
 
@@ -120,7 +170,7 @@ cpcc_string cpccLogFormatter::toString(const cpcc_char* format, ...)
 	// vsprintf_s( buff, MAX_LOG_STRING, format, args);
 	CPCC_TRY_AND_CATCH_TO_CERR(_vstprintf_s(buff, MAX_LOG_STRING, format, args), "_vstprintf_s(buff, MAX_LOG_STRING, format, args)");
 #else
-	CPCC_TRY_AND_CATCH_TO_CERR( vsprintf(buff, format, args) , "vsprintf(buff, format, args)");
+	CPCC_TRY_AND_CATCH_TO_CERR( vsnprintf(buff, MAX_LOG_STRING, format, args) , "vsnprintf(buff, MAX_LOG_STRING, format, args)");
 #endif
 	va_end(args);
 	return buff;
@@ -131,35 +181,54 @@ cpcc_string cpccLogFormatter::toString(const cpcc_char* format, ...)
 #ifdef UNICODE
 
 void cpccLogFormatter::addf(const wchar_t* format, ...)
+{
+	if (!isEnabled())	// before formatting
+		return;
+
+	va_list args;
+	va_start(args, format);
+	writef(format, args);
+	va_end(args);
+}
+
+
+void cpccLogFormatter::writef(const wchar_t* format, va_list args)
 {
 // todo: Use toString()
 	const int MAX_LOG_STRING = 8000;
 	wchar_t buff[MAX_LOG_STRING + 1]; // = { 0 };
 
-	va_list args;
-	va_start(args, format);
 #if (_MSC_VER >= 1400) // Visual Studio 2005
 	// vsprintf_s( buff, MAX_LOG_STRING, format, args);
 	_vstprintf_s(buff, MAX_LOG_STRING, format, args);
 #else
 	vsprintf(buff, format, args);
 #endif
-	va_end(args);
 
-	add(buff);
+	write(buff);
 }
 
 #endif
 #endif
 
 void cpccLogFormatter::addf(const char* format, ...)
+{
+	if (!isEnabled())	// before formatting
+		return;
+
+	va_list args;
+	va_start(args, format);
+	writef(format, args);
+	va_end(args);
+}
+
+
+void cpccLogFormatter::writef(const char* format, va_list args)
 {
 // todo: Use toString()
 	const int MAX_LOG_STRING = 8000 ;
 	char buff[MAX_LOG_STRING + 1]; // = { 0 };
 
-	va_list args;
-	va_start(args, format);
 #if (_MSC_VER >= 1400) // Visual Studio 2005
 	// vsprintf_s( buff, MAX_LOG_STRING, format, args);
 	//  _vstprintf_s for automatic unicode/ non-unicode
@@ -167,11 +236,15 @@ void cpccLogFormatter::addf(const char* format, ...)
 	CPCC_TRY_AND_CATCH_TO_CERR( vsprintf_s(buff, MAX_LOG_STRING, format, args), "vsprintf_s(buff, MAX_LOG_STRING, format, args)");
 	// vsprintf_s(buff, MAX_LOG_STRING, format, args);
 #else
-	CPCC_TRY_AND_CATCH_TO_CERR( vsprintf(buff, format, args), "vsprintf(buff, format, args)");
+	CPCC_TRY_AND_CATCH_TO_CERR( vsnprintf(buff, MAX_LOG_STRING, format, args), "vsnprintf(buff, MAX_LOG_STRING, format, args)");
 #endif
-	va_end(args);
 
-	add(buff);
+#if defined(_WIN32) && defined(UNICODE)
+	wchar_from_char wtxt(buff);
+	write(wtxt.get());
+#else
+	write(buff);
+#endif
 }
 
 
@@ -183,15 +256,8 @@ const cpcc_string &	cpccLogFormatter::getFilename(void)
 
 bool    cpccLogFormatter::moreThanOneSecondPassed(void) // this is used to avoid writing the time for every log line
 {
-    static time_t previousLocalEpoch=0;
-    // The value returned generally represents the number of seconds since 00:00 hours, Jan 1, 1970 UTC
-    time_t localEpoch = time(NULL);
-    
-    if (localEpoch==previousLocalEpoch)
-        return false;
-    
-    previousLocalEpoch=localEpoch;
-    return true;
+    cpccLogTimestamp &timestamp = cpccLogTimestamp::getInstance();
+    return timestamp.newSecondStarted(timestamp.getMicrosecondsSinceStart());
 }
 
 
@@ -229,14 +295,15 @@ cpcc_string cpccLogFormatter::getCurrentTime(const cpcc_char * fmt)
 
 // constructor
 cpccLogManager::cpccLogManager(void):
-        error(_T("ERROR>\t"),  !config_CreateFileOnError, config_EchoToCOUT),
-        warning(_T("Warning>\t"), !config_CreateFileOnWarning, config_EchoToCOUT),
-        info(_T("Info>\t"),  !config_CreateFileOnInfo, config_EchoToCOUT)
+        error(_T("ERROR>\t"),  !config_CreateFileOnError, config_EchoToCOUT, cpccLogLevel::error),
+        warning(_T("Warning>\t"), !config_CreateFileOnWarning, config_EchoToCOUT, cpccLogLevel::warning),
+        info(_T("Info>\t"),  !config_CreateFileOnInfo, config_EchoToCOUT, cpccLogLevel::info),
+        debug(_T("Debug>\t"),  !config_CreateFileOnInfo, config_EchoToCOUT, cpccLogLevel::debug)
 {
 #ifdef cpccDEBUG
 	cpcc_cout << _T("cpccLogManager constructor\n");
 #endif
-    info.add(cpccLogOpeningStamp);
+    info.write(cpccLogOpeningStamp);	// the stamps are not filtered, because the next run looks for them
 #ifdef cpccDEBUG
     info.add(_T("Compiled in DEBUG mode"));
 #else
@@ -254,7 +321,10 @@ cpccLogManager::cpccLogManager(void):
 cpccLogManager::~cpccLogManager()    // in MSVC, this destructor is not called
 {
     //cpccFileSystemMini::appendTextFile("c:\\tmp\\a.txt", cpcc_string("this is the end"));
-    info.add(cpccLogClosingStamp);
+    cpccLogRateLimiters::getInstance().flushSummaries();
+    info.write(cpccLogClosingStamp);
+    flush();
+    cpccLogFlightRecorder::getInstance().close();	// marks the run as complete
     if (hasErrors())
         copyToDesktop();
 }
@@ -273,7 +343,7 @@ cpccLogManager &cpccLogManager::getInst(void)
 }
 
 
-void cpccLogManager::initialize(const cpcc_char *appNameStem, const cpcc_char *macBundleId, const bool checkForIncompleteLog)
+void cpccLogManager::initialize(const cpcc_char *appNameStem, const cpcc_char *macBundleId, const bool checkForIncompleteLog, const cpccLogOutputFormat outputFormat)
 	{
 		// info.addf("cpccLogManager::initialize() called");
 		const cpcc_char *bundleID = NULL; // ignored in Windows
@@ -283,22 +353,81 @@ void cpccLogManager::initialize(const cpcc_char *appNameStem, const cpcc_char *m
 
 		info.addf("Compiler C/C++ standard:%s", cppcIDE::getCompilerVersion());
 		cpcc_string fn = getAutoFullpathFilename(appNameStem, bundleID);
+		const cpcc_string ringFn(getSiblingFilename(fn, _T(".ring")));
+
 		// check previous run
-		if ((checkForIncompleteLog && logfileIsIncomplete(fn.c_str()))
-			||
-            (config_CheckIfLogHasErrors && cpccFileSystemMini::fileContainsText(fn.c_str(), _T("ERROR>\t")))
-			)
+		bool previousLogIsIncomplete = false, previousLogHasErrors = false;
+		scanPreviousLog(fn.c_str(), previousLogIsIncomplete, previousLogHasErrors);
+
+		bool previousRunIsIncomplete = false;
+		if (checkForIncompleteLog)
+			previousRunIsIncomplete = (m_flightRecorderBytes > 0) ? cpccLogFlightRecorderReader::wasIncomplete(ringFn.c_str()) : previousLogIsIncomplete;
+
+		if (previousRunIsIncomplete || (config_CheckIfLogHasErrors && previousLogHasErrors))
 			copyToDesktop();
+
+		// the ring has the last lines of the crashed run, even those that did not reach the text log
+		if (previousRunIsIncomplete && (m_flightRecorderBytes > 0))
+		{
+			const cpcc_string ringTextFn(getSiblingFilename(fn, _T(".ring.txt")));
+			if (cpccLogFlightRecorderReader::extractToTextFile(ringFn.c_str(), ringTextFn.c_str()))
+				cpccFileSystemMini::copyFile(ringTextFn.c_str(), cpccUserFolders::getDesktop().c_str());
+		}
 		
 		// empty the file
 		if (cpccFileSystemMini::fileExists(fn.c_str()))
 			cpccFileSystemMini::createEmptyFile(fn.c_str());
+		if (previousLogHasErrors)
+			cpccFileSystemMini::deleteFile(getSiblingFilename(fn, cpccLogErrorMarkerExtension).c_str());
 
 		cpccLogFileWriterWithBuffer::getInstance().setFilename(fn.c_str());
+		if (hasErrors())	// before initialize()
+			markErrors();
 
 		
 		consolePut(_T("Log filename:") << fn);
 		info.addf(_T("Log filename:%s"), fn.c_str());
+
+		if (m_liveTapBytes > 0)
+		{
+			const cpcc_string tapName(appNameStem ? cpcc_string(appNameStem) : cpccFileSystemMini::getAppFilename());
+			if (cpccLogFileWriterWithBuffer::getInstance().setLiveTap(tapName.c_str(), m_liveTapBytes))
+				info.addf(_T("Live log tap:%s"), tapName.c_str());
+			else
+				warning.addf(_T("#4738: could not create the live log tap:%s"), tapName.c_str());
+		}
+
+		if (m_flightRecorderBytes > 0)
+		{
+			if (cpccLogFlightRecorder::getInstance().open(ringFn.c_str(), m_flightRecorderBytes))
+				info.addf(_T("Flight recorder filename:%s"), ringFn.c_str());
+			else
+				warning.addf(_T("#4733: could not create the flight recorder file:%s"), ringFn.c_str());
+		}
+
+	#ifdef cpccPROFILING
+		// the reports of the cpccPROFILE_SCOPE() calls are written at exit
+		cpccProfiler::getInstance().setOutputFiles(getSiblingFilename(fn, _T(".trace.json")).c_str(), getSiblingFilename(fn, _T(".profile.txt")).c_str());
+	#endif
+
+		cpccLogRecordWriter &recordWriter = cpccLogRecordWriter::getInstance();
+		if (recordWriter.getOutput() == cpccLogRecordOutput::alongside)
+		{
+			const cpcc_string recordsFn(getSiblingFilename(fn, (recordWriter.getFormat() == cpccLogRecordFormat::logfmt) ? _T(".logfmt") : _T(".jsonl")));
+			if (recordWriter.open(recordsFn.c_str()))
+				info.addf(_T("Structured log filename:%s"), recordsFn.c_str());
+			else
+				warning.addf(_T("#4734: could not create the structured log file:%s"), recordsFn.c_str());
+		}
+
+		if (outputFormat == cpccLogOutputFormat::binary)
+		{
+			const cpcc_string binaryFn(getSiblingFilename(fn, _T(".bin")));
+			if (cpccBinaryLogWriter::getInstance().open(binaryFn.c_str()))
+				info.addf(_T("Binary log filename:%s"), binaryFn.c_str());
+			else
+				warning.addf(_T("#4722: could not create the binary log file:%s"), binaryFn.c_str());
+		}
         
         cpcc_string appfilename(cpccFileSystemMini::getAppFullPathFilename());
         consolePut(_T("c Initialize with App filename:") << appfilename);
@@ -343,15 +472,83 @@ cpcc_string cpccLogManager::getAutoFullpathFilename(const cpcc_char *aFilename,
 }
 	
 
+
+cpcc_string cpccLogManager::getSiblingFilename(const cpcc_string &aLogFilename, const cpcc_char *aNewExtension)
+{
+	cpcc_string result(aLogFilename);
+	if (stringUtils::stringEndsWith(result, _T(".txt")))
+		result.erase(result.length() - 4);
+	result.append(aNewExtension);
+	return result;
+}
+
+
+void cpccLogManager::setAsyncWriting(const bool enable, const int flushIntervalMsec, const size_t maxQueuedLines)
+{
+	cpccLogFileWriterWithBuffer::getInstance().setAsyncMode(enable, flushIntervalMsec, maxQueuedLines);
+}
+
+
+cpccLogFormatter &cpccLogManager::getFormatter(const cpccLogLevel aLevel)
+{
+	switch (aLevel)
+	{
+		case cpccLogLevel::error:	return getError();
+		case cpccLogLevel::warning:	return getWarning();
+		case cpccLogLevel::debug:	return getDebug();
+		default:					return getInfo();
+	}
+}
+
+
+void cpccLogManager::setRotation(const size_t maxSegmentBytes, const int maxSegments, const int maxSegmentAgeSeconds)
+{
+	cpccLogFileWriterWithBuffer::getInstance().setRotation(maxSegmentBytes, maxSegments, maxSegmentAgeSeconds);
+}
+
+
+void cpccLogManager::flush(void)
+{
+	cpccLogRateLimiters::getInstance().flushSummaries();
+	cpccLogFileWriterWithBuffer::getInstance().flush();
+	cpccBinaryLogWriter::getInstance().flush();
+	cpccLogRecordWriter::getInstance().flush();
+}
+
     
-bool    cpccLogManager::logfileIsIncomplete(const cpcc_char *fn)
+void    cpccLogManager::scanPreviousLog(const cpcc_char *fn, bool &isIncomplete, bool &hasErrors) const
 {
-    return (cpccFileSystemMini::fileContainsText(fn, cpccLogOpeningStamp) && !cpccFileSystemMini::fileContainsText(fn, cpccLogClosingStamp));
+    hasErrors = cpccFileSystemMini::fileExists(getSiblingFilename(fn, cpccLogErrorMarkerExtension).c_str());
+
+    // the stamps are at the beginning and at the end of the file, so only its head and tail are read.
+    // The full scan also searches the whole file for the errors, which can be cpccLOG_KV() records that replaced the text lines.
+    const char * const texts[5] = { cpccLogOpeningStampA, cpccLogClosingStampA, "ERROR>\t", "\"level\":\"error\"", " level=error " };
+    bool found[5];
+    const size_t stampWindowBytes = 64 * 1024;
+    cpccFileSystemMini::fileContainsTexts(fn, texts, found, m_fullScanOfPreviousLog ? 5 : 2, m_fullScanOfPreviousLog ? 0 : stampWindowBytes);
+    isIncomplete = found[0] && !found[1];
+    if (m_fullScanOfPreviousLog)
+        hasErrors = hasErrors || found[2] || found[3] || found[4];
+}
+
+
+void    cpccLogManager::markErrors(void)
+{
+    static std::atomic<bool> _marked(false);
+    if (_marked.load(std::memory_order_relaxed))
+        return;
+
+    const cpcc_string &fn(cpccLogFileWriterWithBuffer::getInstance().getFilename());
+    if (fn.empty())
+        return;	// before initialize(), which calls it again
+    if (!_marked.exchange(true))
+        cpccFileSystemMini::createEmptyFile(getSiblingFilename(fn, cpccLogErrorMarkerExtension).c_str());
 }
     
     
 void    cpccLogManager::copyToDesktop(void)
 {
+    cpccLogFileWriterWithBuffer::getInstance().flush();
     const cpcc_char *fn = cpccLogFileWriterWithBuffer::getInstance().getFilename().c_str();
     if (!cpccFileSystemMini::fileExists(fn))
         return;
@@ -23,32 +23,41 @@
 // #include <assert.h>
 #include <string> 
 #include <atomic>
+#include <cstdarg>
 
 #include "core.cpccIdeMacros.h"
 #include "cpccUnicodeSupport.h"
+#include "io.cpccLogFormat.h"
+#include "io.cpccLogContext.h"
+#include "io.cpccLogBinary.h"
+#include "io.cpccLogRateLimit.h"
+#include "io.cpccLogFilter.h"
+#include "io.cpccLogStructured.h"
 
 
 class cpccLogFormatter
 {
-	
+	friend class cpccLogModuleWriter;
+	friend class cpccLogManager;
+
 private:
 
-	const cpcc_char *	m_IdentText = _T("| "); 
-	// const cpcc_string	m_IdentText;   	
 	const cpcc_string	m_tag;  // m_tag gets empty in winXP
+	cpccLogSite			m_tagSite;	// the tag, as it is registered in the binary log
+	const cpccLogLevel	m_level;
 
 	bool  				m_isEmpty,
 						m_disableIfFileDoesNotExist,
 						m_echoToConsole;
-	static int			m_IdentLevel;
 	
 	// static std::atomic<bool> & isEnabled(void) { static std::atomic<bool> _enabled(true); return _enabled; };
 	// static bool	& 	isEnabled(void) { static bool _enabled(true); return _enabled; };
 	static bool			m_enabled;
 	
 public:
-	static void		 increaseIdent(void) { ++m_IdentLevel; /* assert(m_IdentLevel > 0 && "#9541a: increased log ident to <=0"); */ }
-	static void		 decreaseIdent(void) { --m_IdentLevel; /* assert(m_IdentLevel >= 0 && "#9541b: reducing log ident to <0"); */ }
+	// the indentation is per thread. See cpccLogContext
+	static void		 increaseIdent(void) { cpccLogContext::increaseIndent(); }
+	static void		 decreaseIdent(void) { cpccLogContext::decreaseIndent(); }
 	static void		 setEnabled(const bool enabled) { m_enabled = enabled;  }
 
 public: // constructor / destructor
@@ -62,13 +71,16 @@ public: // constructor / destructor
 	cpccLogFormatter(const cpccLogFormatter& x) = delete;
 	cpccLogFormatter& operator=(const cpccLogFormatter& x) = delete;
 
-	explicit cpccLogFormatter(const cpcc_char *aTag, const bool disableIfFileDoesNotExist, const bool echoToConsole);
+	explicit cpccLogFormatter(const cpcc_char *aTag, const bool disableIfFileDoesNotExist, const bool echoToConsole, const cpccLogLevel aLevel = cpccLogLevel::info);
 	
 public: // functions
 	bool 				isEmpty(void) const { return m_isEmpty; }
+	/// false if the log is disabled or the level of this formatter is above the default threshold of cpccLogFilter.
+	/// It is checked before any formatting.
+	inline bool			isEnabled(void) const { return m_enabled && cpccLogFilter::getInstance().isEnabled(m_level); }
 	static const cpcc_string &	getFilename(void);
 	inline void			add(const cpcc_string &txt) { add(txt.c_str()); }
-	void 				add(const cpcc_char* txt);
+	inline void 		add(const cpcc_char* txt) { if (isEnabled()) write(txt); }
 
 
 #ifdef _WIN32
@@ -79,6 +91,79 @@ public: // functions
 #endif
 	void 				addf(const char* format, ...);
 
+	/// type-safe formatting with {} placeholders, e.g. infoLog().fmt(_T("x={} y={}"), x, y);
+	/// The message is built in a buffer of the calling thread that is reused, so no memory is allocated.
+	template <typename... tArgs>
+	void				fmt(const cpcc_char *format, const tArgs&... args)
+	{
+		if (isEnabled())
+			writeFormatted(format, args...);
+	}
+
+	/// called by the cpccLOGF() macro. In binary mode the arguments are stored without formatting.
+	/// Errors and warnings are also written to the text log, so that the error marker, the previous log scan,
+	/// the flight recorder and the live tap see them, and an error flushes the binary log.
+	template <typename... tArgs>
+	void				fmtSite(cpccLogSite &site, const tArgs&... args)
+	{
+		if (!isEnabled())
+			return;
+		cpccBinaryLogWriter &binaryLog = cpccBinaryLogWriter::getInstance();
+		if (!binaryLog.isEnabled())
+		{
+			writeFormatted(site.getFormat(), args...);
+			return;
+		}
+		binaryLog.write(site, m_tagSite, args...);
+		m_isEmpty = false;
+		if (m_level > cpccLogLevel::warning)
+			return;
+		writeFormatted(site.getFormat(), args...);
+		if (m_level == cpccLogLevel::error)
+			binaryLog.flush();
+	}
+
+	/// renders a message to the line that the text mode writes, with the time and thread context given.
+	/// write() uses the same steps with the current context. The tests compare the binary log with it.
+	template <typename... tArgs>
+	void				appendTextLine(cpcc_string &aLine, const int64_t aMicroseconds, const uint32_t aThreadNo, const cpcc_string &aScopePath, const int aIndent,
+										const cpcc_char *format, const tArgs&... args) const
+	{
+		cpcc_string message;
+		cpccLogFormat::format(message, format, args...);
+		appendLine(aLine, aMicroseconds, aThreadNo, aScopePath, aIndent, message.c_str());
+	}
+
+	/// the tag, as it is registered in the binary log
+	const cpccLogSite &	getTagSite(void) const { return m_tagSite; }
+
+	/// called by the cpccLOG_KV() macro. The fields are written to the text line and/or
+	/// as a JSON or logfmt record, see cpccLogManager::setStructuredOutput()
+	template <typename... tArgs>
+	void				record(const cpccLogRecordSite &site, const tArgs&... args)
+	{
+		if (!isEnabled())
+			return;
+		const cpccLogRecordWriter &recordWriter = cpccLogRecordWriter::getInstance();
+		const cpccLogRecordOutput output = recordWriter.getOutput();
+		if (output != cpccLogRecordOutput::instead)
+		{
+			cpcc_string &line = cpccLogFormat::threadBuffer();
+			line.clear();
+			cpccLogRecordEncoder::appendTextLine(line, site, args...);
+			write(line.c_str());
+		}
+		if (output == cpccLogRecordOutput::textOnly)
+			return;
+
+		cpcc_string &buffer = cpccLogRecordEncoder::threadBuffer();
+		buffer.clear();
+		cpccLogTimestamp &timestamp = cpccLogTimestamp::getInstance();
+		cpccLogRecordEncoder::appendRecord(buffer, recordWriter.getFormat(), site, m_level,
+			timestamp.getEpochMicroseconds(timestamp.getMicrosecondsSinceStart()), cpccLogContext::getThreadNo(), cpccLogContext::getScopePath(), args...);
+		writeRecord(buffer);
+	}
+
 	// void				markLogClosure(void);
 	static cpcc_string 	toString(const cpcc_char* format, ...);
     
@@ -91,9 +176,73 @@ public: // functions
 	*/
 	static cpcc_string 	getCurrentTime(const cpcc_char * fmt);
     static bool         moreThanOneSecondPassed(void);
+
+private:	// the writing functions, after the level has been checked
+	void 				write(const cpcc_char* txt);
+	void				appendLine(cpcc_string &aLine, const int64_t aMicroseconds, const uint32_t aThreadNo, const cpcc_string &aScopePath, const int aIndent, const cpcc_char* txt) const;
+	void				writeRecord(cpcc_string &aRecord);
+	void				writeLine(const cpcc_string &aLine);	// to the text log, the flight recorder and the console
+	void				noteWritten(void);	// after every line or record. The first error of the run creates the error marker
+	void				writef(const char* format, va_list args);
+#ifdef _WIN32
+#ifdef UNICODE
+	void				writef(const wchar_t* format, va_list args);
+#endif
+#endif
+
+	template <typename... tArgs>
+	void				writeFormatted(const cpcc_char *format, const tArgs&... args)
+	{
+		if (!format)
+			return;
+		cpcc_string &buffer = cpccLogFormat::threadBuffer();
+		buffer.clear();
+		cpccLogFormat::format(buffer, format, args...);
+		write(buffer.c_str());
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogModuleWriter
+//
+//	Returned by the cpccLOG_MODULE() macro, after the threshold of the module has been checked.
+//  It writes to the formatter of the level without checking the default threshold.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogModuleWriter
+{
+private:
+	cpccLogFormatter &m_log;
+
+public:
+	explicit cpccLogModuleWriter(cpccLogFormatter &aLog) : m_log(aLog) { }
+
+	inline void			add(const cpcc_char* txt) { m_log.write(txt); }
+	inline void			add(const cpcc_string &txt) { m_log.write(txt.c_str()); }
+	void				addf(const char* format, ...) { va_list args; va_start(args, format); m_log.writef(format, args); va_end(args); }
+#ifdef _WIN32
+#ifdef UNICODE
+	void				addf(const wchar_t* format, ...) { va_list args; va_start(args, format); m_log.writef(format, args); va_end(args); }
+#endif
+#endif
+
+	template <typename... tArgs>
+	void				fmt(const cpcc_char *format, const tArgs&... args) { m_log.writeFormatted(format, args...); }
 };
 
 
+// e.g. cpccLOG_MODULE(networkLog, debug).fmt(_T("received {} bytes"), n);
+// When the level is filtered out, the arguments are not even evaluated.
+#define cpccLOG_MODULE(aModule, aLevel)	\
+	if (!(aModule).isEnabled(cpccLogLevel::aLevel)) ; else cpccLogModuleWriter(cpccLogManager::getFormatter(cpccLogLevel::aLevel))
+
+// the same with the default threshold, e.g. cpccLOG(info).addf(_T("x=%d"), x);
+#define cpccLOG(aLevel)	\
+	if (!cpccLogFilter::getInstance().isEnabled(cpccLogLevel::aLevel)) ; else cpccLogModuleWriter(cpccLogManager::getFormatter(cpccLogLevel::aLevel))
+
+
 // aliases for the 3 log levels
 cpccLogFormatter			&infoLog(void);
 cpccLogFormatter			&warningLog(void);
@@ -101,7 +250,7 @@ cpccLogFormatter			&errorLog(void);
 #ifndef cpccDEBUG
     #define debugLog()	if (false) infoLog()
 #else
-	#define debugLog()	infoLog()
+	#define debugLog()	cpccLogManager::getDebug()
 #endif
 
 
@@ -111,10 +260,17 @@ cpccLogFormatter			&errorLog(void);
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+// text:	every line is formatted when it is logged (default)
+// binary:	the cpccLOGF() calls are stored unformatted in a .cpccLog.bin file next to the text log.
+//			Render it to text with cpccBinaryLogDecoder::decodeFile()
+//			The errors and warnings are written to the text log as well.
+enum class cpccLogOutputFormat { text = 0, binary };
+
 
 
 class cpccLogManager
 {
+	friend class cpccLogFormatter;
 	
 
 private: // configuation
@@ -131,7 +287,10 @@ private: // configuation
 
 
 private: 	// data
-	cpccLogFormatter	error, warning, info;
+	cpccLogFormatter	error, warning, info, debug;
+	size_t				m_flightRecorderBytes = 0,
+						m_liveTapBytes = 0;
+	bool				m_fullScanOfPreviousLog = false;
 
 private:
 	// this is private because only &getInst() should create this object as singleton
@@ -146,10 +305,40 @@ public:
     static cpccLogFormatter &getInfo(void) { return getInst().info; }
     static cpccLogFormatter &getWarning(void) { return getInst().warning; }
     static cpccLogFormatter &getError(void) { return getInst().error; }
+    static cpccLogFormatter &getDebug(void) { return getInst().debug; }
+    static cpccLogFormatter &getFormatter(const cpccLogLevel aLevel);
     
 public: // functions
 
-	void initialize(const cpcc_char *appNameStem, const cpcc_char *macBundleId, const bool checkForIncompleteLog);
+	void initialize(const cpcc_char *appNameStem, const cpcc_char *macBundleId, const bool checkForIncompleteLog, const cpccLogOutputFormat outputFormat = cpccLogOutputFormat::text);
+
+	// write the log lines from a background thread to a file that stays open. See cpccLogFileWriterWithBuffer::setAsyncMode()
+	void setAsyncWriting(const bool enable, const int flushIntervalMsec = 200, const size_t maxQueuedLines = 10000);
+	// write any queued log lines to the file. Call it before exiting and from crash handlers.
+	void flush(void);
+
+	// the runtime log levels, e.g. "warning,network=debug". Read the text from cpccSettings. See cpccLogFilter::configure()
+	bool setLogLevels(const cpcc_char *aSpec) { return cpccLogFilter::getInstance().configure(aSpec); }
+
+	// move the log to numbered, compressed segments when it grows too big or old. See cpccLogFileWriterWithBuffer::setRotation()
+	void setRotation(const size_t maxSegmentBytes, const int maxSegments = 5, const int maxSegmentAgeSeconds = 0);
+
+	// keep the last log lines also in a memory-mapped .cpccLog.ring file that survives a crash (see cpccLogFlightRecorder).
+	// Call it before initialize(). Then the check for an incomplete previous run reads the header of the ring file
+	// instead of the whole text log. 0 disables it.
+	void setFlightRecorder(const size_t ringSizeBytes = 1024 * 1024) { m_flightRecorderBytes = ringSizeBytes; }
+
+	// mirror the log lines into a shared-memory ring named after the application, for a viewer such as tools/io.cpccLogTail.cpp.
+	// Call it before initialize(). 0 disables it. See cpccLogLiveTap
+	void setLiveTap(const size_t ringSizeBytes = 256 * 1024) { m_liveTapBytes = ringSizeBytes; }
+
+	// where the cpccLOG_KV() records are written. With alongside, initialize() creates the .jsonl or .logfmt file next to the text log.
+	void setStructuredOutput(const cpccLogRecordOutput anOutput, const cpccLogRecordFormat aFormat = cpccLogRecordFormat::jsonLines) { cpccLogRecordWriter::getInstance().configure(anOutput, aFormat); }
+
+	// initialize() knows that the previous run had errors from the .cpccLog.errors marker file that its first error created,
+	// and reads only the head and the tail of the previous log for the stamps. With the full scan, it also searches
+	// the whole previous log for error lines, e.g. of a log written by an older version. Its cost grows with the size of the log.
+	void setFullScanOfPreviousLog(const bool enable) { m_fullScanOfPreviousLog = enable; }
 
     // static bool    fileContainsText(const cpcc_char *fn, const cpcc_char *txt);
 
@@ -160,8 +349,15 @@ private:
 
 	static cpcc_string getAutoFullpathFilename(const cpcc_char *aFilename, const cpcc_char *aBundleID);
 
+	// e.g. app.cpccLog.txt -> app.cpccLog.bin
+	static cpcc_string getSiblingFilename(const cpcc_string &aLogFilename, const cpcc_char *aNewExtension);
+
 	
-	static bool    logfileIsIncomplete(const cpcc_char *fn);
+	// the previous log is incomplete if it has the opening stamp but not the closing stamp
+	void    scanPreviousLog(const cpcc_char *fn, bool &isIncomplete, bool &hasErrors) const;
+
+	// creates the marker file at the first error of the run, so that the next run does not have to search the log
+	static void    markErrors(void);
 
 	void    copyToDesktop(void);
 
@@ -196,13 +392,13 @@ protected:
     {
         infoLog().addf(_T("%s: %s"), startTag.c_str(), tag.c_str());
 		
-        cpccLogFormatter::increaseIdent();
+        cpccLogContext::enterScope(tag.c_str());
     }
     
 public:
     virtual ~logBlockOfCode(void)
     {
-        cpccLogFormatter::decreaseIdent();
+        cpccLogContext::leaveScope();
         infoLog().addf(_T("%s: %s\n"), endTag.c_str(), tag.c_str());
     }
 };
@@ -244,3 +440,50 @@ public:
 };
 
 
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		binary log round trip testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccBinaryLog_roundTrip_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	// the calls through the formatter of the text mode, with the time and the thread injected
+	static cpccLogFormatter formatter(_T("Info>\t"), false, false);
+	static cpccLogSite site1(_T("frame {} took {} ms, name={} ok={} {{literal}}"));
+	static cpccLogSite site2(_T("no arguments"));
+	static cpccLogSite site3(_T("{} {} {}"));
+	const int64_t t = 12000345;
+	const cpcc_string noScope, scope(_T("main/load"));
+
+	cpcc_string expected;
+	formatter.appendTextLine(expected, t, 1, noScope, 0, site1.getFormat(), 12345u, 16.6, _T("main"), false);
+	formatter.appendTextLine(expected, t, 2, scope, 2, site2.getFormat());
+	formatter.appendTextLine(expected, t, 1, noScope, 0, site3.getFormat(), -7, _T('x'));
+
+	// the same calls through the binary encoding
+	std::string bytes;
+	cpccBinaryLogCodec::putHeader(bytes, cpccLogTimestamp::getInstance().getEpochMicrosecondsBase());
+	cpccBinaryLogCodec::putSiteDefinition(bytes, formatter.getTagSite());
+	cpccBinaryLogCodec::putSiteDefinition(bytes, site1);
+	cpccBinaryLogCodec::putSiteDefinition(bytes, site2);
+	cpccBinaryLogCodec::putSiteDefinition(bytes, site3);
+	cpccBinaryLogCodec::putMessage(bytes, site1, formatter.getTagSite(), 0, 1, noScope, t, 12345u, 16.6, _T("main"), false);
+	cpccBinaryLogCodec::putMessage(bytes, site2, formatter.getTagSite(), 2, 2, scope, t);
+	cpccBinaryLogCodec::putMessage(bytes, site3, formatter.getTagSite(), 0, 1, noScope, t, -7, _T('x'));
+
+	cpcc_string decoded;
+	const bool ok = cpccBinaryLogDecoder::decode(bytes, decoded, false);
+	TEST_EXPECT(ok, _T("#7262a: cpccBinaryLogDecoder::decode() failed"));
+	TEST_EXPECT(decoded.compare(expected) == 0, _T("#7262b: decoded binary log differs from the text mode"));
+}
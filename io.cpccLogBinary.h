@@ -0,0 +1,564 @@
+/*  *****************************************
+ *  File:		io.cpccLogBinary.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				binary log mode: the arguments are stored unformatted and
+ *				the text is produced afterwards by cpccBinaryLogDecoder
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <locale>
+#include <codecvt>
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccLogFormat.h"
+#include "io.cpccLogTimestamp.h"
+#include "io.cpccLogContext.h"
+#include "cpccTesting.h"
+
+/*
+	Usage:
+		cpccLOGF(infoLog(), _T("frame {} took {} ms"), frameNo, msec);
+
+	In text mode (the default) this is the same as infoLog().fmt(...).
+	In binary mode (see cpccLogManager::initialize) the call site is registered once in the binary stream
+	with its format string and every call only writes the site id, the monotonic timestamp and the raw argument bytes.
+	cpccBinaryLogDecoder renders the binary stream to the same text lines that the text mode writes.
+
+	Stream layout (native byte order, it is decoded on the same kind of machine):
+		header:		"cpccBLOG", u8 version, u8 sizeof(cpcc_char), i64 microseconds since 1970 when the log started
+		record:		u8 recordTimeBase, i64 microseconds since 1970 when the log started, after a resync with the system clock
+		record:		u8 recordSiteDefinition, u32 siteId, u32 nChars, nChars * cpcc_char
+		record:		u8 recordMessage, u32 siteId, u32 tagSiteId, u16 indent, u32 threadNo, u32 nChars + scope path chars, i64 microseconds since the log started, u8 nArgs, args
+		arg:		u8 argType, payload (i64, u64, f64, u8, cpcc_char, or u32 nChars + chars for strings)
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogSite
+//
+//	A static object per call site (created by the cpccLOGF macro) that holds the format string.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogSite
+{
+private:
+	const cpcc_char		*m_format;
+	const uint32_t		m_id;
+
+public:
+	uint32_t			m_definedInStream = 0; // guarded by the mutex of cpccBinaryLogWriter
+
+private:
+	static uint32_t nextId(void)
+	{
+		static std::atomic<uint32_t> _lastId(0);
+		return ++_lastId;
+	}
+
+public:
+	explicit cpccLogSite(const cpcc_char *aFormat): m_format(aFormat ? aFormat : _T("")), m_id(nextId()) { }
+	cpccLogSite(const cpccLogSite& x) = delete;
+	cpccLogSite& operator=(const cpccLogSite& x) = delete;
+
+	const cpcc_char *getFormat(void) const { return m_format; }
+	uint32_t		getId(void) const { return m_id; }
+};
+
+
+#define cpccLOGF(aLogFormatter, aFormat, ...)	\
+	do { static cpccLogSite _cpccLogSite(aFormat); (aLogFormatter).fmtSite(_cpccLogSite, ##__VA_ARGS__); } while (0)
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccBinaryLogCodec
+//
+//	The record and argument encoding shared by the writer and the decoder
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccBinaryLogCodec
+{
+public:
+	enum { version = 4 };
+	enum { headerSize = 8 + 1 + 1 + sizeof(int64_t) };
+	enum tRecordType : uint8_t { recordSiteDefinition = 1, recordMessage = 2, recordTimeBase = 3 };
+	enum tArgType : uint8_t { argInt = 1, argUInt, argDouble, argBool, argChar, argString, argPointer };
+
+	static const char *getMagic(void) { return "cpccBLOG"; }
+
+	static void putHeader(std::string &out, const int64_t aEpochMicrosecondsAtStart)
+	{
+		out.append(getMagic(), 8);
+		putU8(out, version);
+		putU8(out, sizeof(cpcc_char));
+		putRaw(out, aEpochMicrosecondsAtStart);
+	}
+
+	template <typename T>
+	static void putRaw(std::string &out, const T aValue) { out.append(reinterpret_cast<const char *>(&aValue), sizeof(aValue)); }
+	static void putU8(std::string &out, const uint8_t aValue) { out.push_back(static_cast<char>(aValue)); }
+
+	static void putString(std::string &out, const cpcc_char *aStr, const size_t nChars)
+	{
+		putRaw(out, static_cast<uint32_t>(nChars));
+		out.append(reinterpret_cast<const char *>(aStr), nChars * sizeof(cpcc_char));
+	}
+
+	static void putTimeBase(std::string &out, const int64_t aEpochMicrosecondsAtStart)
+	{
+		putU8(out, recordTimeBase);
+		putRaw(out, aEpochMicrosecondsAtStart);
+	}
+
+	static void putSiteDefinition(std::string &out, const cpccLogSite &aSite)
+	{
+		putU8(out, recordSiteDefinition);
+		putRaw(out, aSite.getId());
+		const cpcc_char *format = aSite.getFormat();
+		putString(out, format, cpcc_strlen(format));
+	}
+
+public: // argument encoding
+
+	static void encodeArgs(std::string &) { }
+
+	template <typename tArg, typename... tArgs>
+	static void encodeArgs(std::string &out, const tArg &aArg, const tArgs&... aArgs)
+	{
+		encodeArg(out, aArg);
+		encodeArgs(out, aArgs...);
+	}
+
+	static void encodeArg(std::string &out, const cpcc_char *aValue)
+	{
+		if (!aValue)
+			aValue = _T("(null)");
+		putU8(out, argString);
+		putString(out, aValue, cpcc_strlen(aValue));
+	}
+	static void encodeArg(std::string &out, cpcc_char *aValue) { encodeArg(out, (const cpcc_char *) aValue); }
+	static void encodeArg(std::string &out, const cpcc_string &aValue) { putU8(out, argString); putString(out, aValue.c_str(), aValue.length()); }
+	static void encodeArg(std::string &out, const bool aValue) { putU8(out, argBool); putU8(out, aValue ? 1 : 0); }
+	static void encodeArg(std::string &out, const cpcc_char aValue) { putU8(out, argChar); putRaw(out, aValue); }
+
+	template <size_t N>
+	static void encodeArg(std::string &out, const cpcc_char (&aValue)[N]) { encodeArg(out, (const cpcc_char *)aValue); }
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && !std::is_same<T, cpcc_char>::value>::type
+		encodeArg(std::string &out, const T aValue) { putU8(out, argInt); putRaw(out, static_cast<int64_t>(aValue)); }
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, cpcc_char>::value>::type
+		encodeArg(std::string &out, const T aValue) { putU8(out, argUInt); putRaw(out, static_cast<uint64_t>(aValue)); }
+
+	template <typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+		encodeArg(std::string &out, const T aValue) { putU8(out, argDouble); putRaw(out, static_cast<double>(aValue)); }
+
+	template <typename T>
+	static void encodeArg(std::string &out, const T *aPointer) { putU8(out, argPointer); putRaw(out, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(aPointer))); }
+
+	template <typename... tArgs>
+	static void putMessage(std::string &out, const cpccLogSite &aSite, const cpccLogSite &aTagSite, const int aIndent,
+							const uint32_t aThreadNo, const cpcc_string &aScopePath, const int64_t aMicroseconds, const tArgs&... aArgs)
+	{
+		putU8(out, recordMessage);
+		putRaw(out, aSite.getId());
+		putRaw(out, aTagSite.getId());
+		putRaw(out, static_cast<uint16_t>(aIndent > 0 ? aIndent : 0));
+		putRaw(out, aThreadNo);
+		putString(out, aScopePath.c_str(), aScopePath.length());
+		putRaw(out, aMicroseconds);
+		putU8(out, static_cast<uint8_t>(sizeof...(aArgs)));
+		encodeArgs(out, aArgs...);
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccBinaryLogWriter
+//
+//	Appends the binary records to a file. The records are encoded on the calling thread
+//  in a reused buffer, and written under a short lock to a FILE with a large stdio buffer.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccBinaryLogWriter
+{
+private:
+	FILE			*m_fp = NULL;
+	std::mutex		m_mutex;
+	uint32_t		m_streamNo = 0;	// increased on every open(), so that the sites are defined again in a new file
+	int64_t			m_epochMicrosecondsBase = 0;	// the last one written to the stream
+	int64_t			m_lastSecond = -1;				// when the epoch base was last resynced
+	std::atomic<bool> m_enabled;
+
+	cpccBinaryLogWriter(): m_enabled(false) { }
+	cpccBinaryLogWriter(const cpccBinaryLogWriter& x) = delete;
+	cpccBinaryLogWriter& operator=(const cpccBinaryLogWriter& x) = delete;
+
+public:
+	~cpccBinaryLogWriter() { close(); }
+
+	static cpccBinaryLogWriter &getInstance(void)
+	{
+		static cpccBinaryLogWriter* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccBinaryLogWriter;
+		return *_instPtr;
+	}
+
+	bool isEnabled(void) const { return m_enabled; }
+
+	/// creates (or empties) the binary log file and starts writing the cpccLOGF calls to it
+	bool open(const cpcc_char *aFilename)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_fp)
+			fclose(m_fp);
+		#pragma warning(suppress : 4996)
+		m_fp = aFilename ? cpcc_fopen(aFilename, _T("wb")) : NULL;
+		if (!m_fp)
+		{
+			m_enabled = false;
+			return false;
+		}
+		setvbuf(m_fp, NULL, _IOFBF, 64 * 1024);
+
+		std::string header;
+		m_epochMicrosecondsBase = cpccLogTimestamp::getInstance().getEpochMicrosecondsBase();
+		cpccBinaryLogCodec::putHeader(header, m_epochMicrosecondsBase);
+		fwrite(header.data(), 1, header.size(), m_fp);
+		++m_streamNo;
+		m_enabled = true;
+		return true;
+	}
+
+	void close(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_enabled = false;
+		if (m_fp)
+			fclose(m_fp);
+		m_fp = NULL;
+	}
+
+	void flush(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_fp)
+			fflush(m_fp);
+	}
+
+	template <typename... tArgs>
+	void write(cpccLogSite &aSite, cpccLogSite &aTagSite, const tArgs&... aArgs)
+	{
+		static thread_local std::string _record;
+		_record.clear();
+		cpccLogTimestamp &timestamp = cpccLogTimestamp::getInstance();
+		const int64_t microseconds = timestamp.getMicrosecondsSinceStart();
+		cpccBinaryLogCodec::putMessage(_record, aSite, aTagSite, cpccLogContext::getIndentLevel(), cpccLogContext::getThreadNo(), cpccLogContext::getScopePath(),
+			microseconds, aArgs...);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_fp)
+			return;
+		// once per second, like the date/time lines of the text mode
+		if (timestamp.getEpochMicroseconds(microseconds) / 1000000 > m_lastSecond)
+			m_lastSecond = timestamp.resync(microseconds);
+		writeTimeBase(timestamp.getEpochMicrosecondsBase());
+		defineSite(aTagSite);
+		defineSite(aSite);
+		fwrite(_record.data(), 1, _record.size(), m_fp);
+	}
+
+private:
+	void writeTimeBase(const int64_t aEpochMicrosecondsBase)
+	{
+		if (aEpochMicrosecondsBase == m_epochMicrosecondsBase)
+			return;
+		std::string record;
+		cpccBinaryLogCodec::putTimeBase(record, aEpochMicrosecondsBase);
+		fwrite(record.data(), 1, record.size(), m_fp);
+		m_epochMicrosecondsBase = aEpochMicrosecondsBase;
+	}
+
+	void defineSite(cpccLogSite &aSite)
+	{
+		if (aSite.m_definedInStream == m_streamNo)
+			return;
+		std::string definition;
+		cpccBinaryLogCodec::putSiteDefinition(definition, aSite);
+		fwrite(definition.data(), 1, definition.size(), m_fp);
+		aSite.m_definedInStream = m_streamNo;
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccBinaryLogDecoder
+//
+//	Renders a binary log to the text lines that the text mode would have written:
+//		tag + time offset + thread and scope path + indentation + formatted message
+//  and, optionally, the date/time line that cpccLogFormatter writes when a new second starts.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccBinaryLogDecoder
+{
+private:
+	struct tArg
+	{
+		uint8_t		type = 0;
+		int64_t		i = 0;
+		uint64_t	u = 0;
+		double		d = 0;
+		cpcc_char	c = 0;
+		cpcc_string	s;
+	};
+
+	class tReader
+	{
+	private:
+		const std::string &m_bytes;
+		size_t m_pos = 0;
+		bool m_ok = true;
+
+	public:
+		explicit tReader(const std::string &aBytes): m_bytes(aBytes) { }
+		bool ok(void) const { return m_ok; }
+		bool atEnd(void) const { return m_pos >= m_bytes.size(); }
+
+		template <typename T>
+		T get(void)
+		{
+			T value = T();
+			if (m_pos + sizeof(T) > m_bytes.size())
+				m_ok = false;
+			else
+				memcpy(&value, m_bytes.data() + m_pos, sizeof(T));
+			m_pos += sizeof(T);
+			return value;
+		}
+
+		cpcc_string getString(void)
+		{
+			const uint32_t nChars = get<uint32_t>();
+			if (!m_ok || (m_pos + nChars * sizeof(cpcc_char) > m_bytes.size()))
+			{
+				m_ok = false;
+				return cpcc_string();
+			}
+			cpcc_string result(nChars, _T(' '));
+			if (nChars)
+				memcpy(&result[0], m_bytes.data() + m_pos, nChars * sizeof(cpcc_char));
+			m_pos += nChars * sizeof(cpcc_char);
+			return result;
+		}
+	};
+
+	static void appendArg(cpcc_string &aBuffer, const tArg &aArg)
+	{
+		switch (aArg.type)
+		{
+			case cpccBinaryLogCodec::argInt:		cpccLogFormat::appendValue(aBuffer, static_cast<long long>(aArg.i)); break;
+			case cpccBinaryLogCodec::argUInt:		cpccLogFormat::appendValue(aBuffer, static_cast<unsigned long long>(aArg.u)); break;
+			case cpccBinaryLogCodec::argDouble:		cpccLogFormat::appendValue(aBuffer, aArg.d); break;
+			case cpccBinaryLogCodec::argBool:		cpccLogFormat::appendValue(aBuffer, aArg.u != 0); break;
+			case cpccBinaryLogCodec::argChar:		cpccLogFormat::appendValue(aBuffer, aArg.c); break;
+			case cpccBinaryLogCodec::argString:		cpccLogFormat::appendValue(aBuffer, aArg.s); break;
+			case cpccBinaryLogCodec::argPointer:	cpccLogFormat::appendValue(aBuffer, reinterpret_cast<const void *>(static_cast<uintptr_t>(aArg.u))); break;
+			default: break;
+		}
+	}
+
+public:
+
+	/// decodes the bytes of a binary log. Returns false if the stream is not a binary log or is truncated.
+	static bool decode(const std::string &aBytes, cpcc_string &aText, const bool withTimestampLines = true)
+	{
+		if ((aBytes.size() < cpccBinaryLogCodec::headerSize) || (aBytes.compare(0, 8, cpccBinaryLogCodec::getMagic()) != 0))
+			return false;
+		if ((aBytes[8] != cpccBinaryLogCodec::version) || (aBytes[9] != sizeof(cpcc_char)))
+			return false;
+
+		std::string body(aBytes, 10);
+		tReader reader(body);
+		int64_t epochMicrosecondsAtStart = reader.get<int64_t>();
+		std::map<uint32_t, cpcc_string> sites;
+		std::vector<tArg> args;
+		int64_t previousSecond = -1;
+
+		while (!reader.atEnd() && reader.ok())
+		{
+			const uint8_t recordType = reader.get<uint8_t>();
+			if (recordType == cpccBinaryLogCodec::recordSiteDefinition)
+			{
+				const uint32_t id = reader.get<uint32_t>();
+				sites[id] = reader.getString();
+				continue;
+			}
+			if (recordType == cpccBinaryLogCodec::recordTimeBase)
+			{
+				epochMicrosecondsAtStart = reader.get<int64_t>();
+				continue;
+			}
+			if (recordType != cpccBinaryLogCodec::recordMessage)
+				return false;
+
+			const uint32_t siteId = reader.get<uint32_t>();
+			const uint32_t tagId = reader.get<uint32_t>();
+			const uint16_t indent = reader.get<uint16_t>();
+			const uint32_t threadNo = reader.get<uint32_t>();
+			const cpcc_string scopePath(reader.getString());
+			const int64_t microseconds = reader.get<int64_t>();
+			const uint8_t nArgs = reader.get<uint8_t>();
+
+			args.resize(nArgs);
+			for (auto &arg : args)
+			{
+				arg.type = reader.get<uint8_t>();
+				switch (arg.type)
+				{
+					case cpccBinaryLogCodec::argInt:		arg.i = reader.get<int64_t>(); break;
+					case cpccBinaryLogCodec::argUInt:
+					case cpccBinaryLogCodec::argPointer:	arg.u = reader.get<uint64_t>(); break;
+					case cpccBinaryLogCodec::argDouble:		arg.d = reader.get<double>(); break;
+					case cpccBinaryLogCodec::argBool:		arg.u = reader.get<uint8_t>(); break;
+					case cpccBinaryLogCodec::argChar:		arg.c = reader.get<cpcc_char>(); break;
+					case cpccBinaryLogCodec::argString:		arg.s = reader.getString(); break;
+					default: return false;
+				}
+			}
+			if (!reader.ok())
+				return false;
+
+			const int64_t second = (epochMicrosecondsAtStart + microseconds) / 1000000;
+			if (withTimestampLines && (second != previousSecond))
+			{
+				cpccLogTimestamp::appendDateTime(aText, static_cast<time_t>(second));
+				aText.append(_T("\n"));
+			}
+			previousSecond = second;
+
+			aText.append(sites[tagId]);
+			cpccLogTimestamp::appendOffset(aText, microseconds);
+			aText.append(_T("\t"));
+			cpccLogContext::appendContext(aText, threadNo, scopePath);
+			cpccLogContext::appendIndent(aText, indent);
+
+			const cpcc_string &format = sites[siteId];
+			const cpcc_char *p = format.c_str();
+			for (const auto &arg : args)
+				if (cpccLogFormat::appendUntilPlaceholder(aText, p))
+					appendArg(aText, arg);
+			cpccLogFormat::format(aText, p);
+			aText.append(_T("\n"));
+		}
+		return reader.ok();
+	}
+
+	/// the offline decoder: renders a binary log file to a text log file
+	static bool decodeFile(const cpcc_char *aBinaryFilename, const cpcc_char *aTextFilename)
+	{
+		if (!aBinaryFilename || !aTextFilename)
+			return false;
+
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aBinaryFilename, _T("rb"));
+		if (!fp)
+			return false;
+		std::string bytes;
+		char buffer[64 * 1024];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+			bytes.append(buffer, n);
+		fclose(fp);
+
+		cpcc_string text;
+		const bool decodedOk = decode(bytes, text);
+
+		#pragma warning(suppress : 4996)
+		fp = cpcc_fopen(aTextFilename, _T("wb"));
+		if (!fp)
+			return false;
+	#ifdef UNICODE
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		const std::string utf8(converter.to_bytes(text));
+	#else
+		const std::string &utf8 = text;
+	#endif
+		const bool writtenOk = (fwrite(utf8.data(), 1, utf8.size(), fp) == utf8.size());
+		fclose(fp);
+		return decodedOk && writtenOk;
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccBinaryLogDecoder testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccBinaryLogDecoder_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	// the round trip against the text mode is tested in io.cpccLog.h, with the real formatter
+	static cpccLogSite tagSite(_T("Info>\t"));
+	static cpccLogSite site(_T("{} {}"));
+	const int64_t t = 12000345;
+	const cpcc_string noScope;
+
+	std::string bytes;
+	cpccBinaryLogCodec::putHeader(bytes, 0);
+	cpccBinaryLogCodec::putSiteDefinition(bytes, tagSite);
+	cpccBinaryLogCodec::putSiteDefinition(bytes, site);
+	cpccBinaryLogCodec::putMessage(bytes, site, tagSite, 0, 1, noScope, t, -7, _T("x"));
+
+	// a truncated stream must be rejected
+	cpcc_string decoded;
+	TEST_EXPECT(cpccBinaryLogDecoder::decode(bytes, decoded, false), _T("#7262e: cpccBinaryLogDecoder::decode() failed"));
+	decoded.clear();
+	TEST_EXPECT(!cpccBinaryLogDecoder::decode(bytes.substr(0, bytes.size() - 3), decoded, false), _T("#7262c: truncated binary log accepted"));
+
+	// a resync of the epoch base moves the date/time lines that follow it
+	cpccBinaryLogCodec::putTimeBase(bytes, 3600 * int64_t(1000000));
+	cpccBinaryLogCodec::putMessage(bytes, site, tagSite, 0, 1, noScope, t, -7, _T("x"));
+	cpcc_string dateLine1, dateLine2;
+	cpccLogTimestamp::appendDateTime(dateLine1, 12);
+	cpccLogTimestamp::appendDateTime(dateLine2, 3600 + 12);
+	decoded.clear();
+	TEST_EXPECT(cpccBinaryLogDecoder::decode(bytes, decoded) && (decoded.find(dateLine1) == 0) && (decoded.find(dateLine2) != cpcc_string::npos),
+		_T("#7262d: cpccBinaryLogDecoder ignores the resync of the epoch base"));
+}
@@ -0,0 +1,162 @@
+/*  *****************************************
+ *  File:		io.cpccLogContext.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				per-thread indentation and scope path of the log lines
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccLogFormat.h"
+#include "cpccTesting.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogContext
+//
+//	Every thread has its own indentation level and scope path (the tags of the open logBlockOfCode objects),
+//  so concurrent scopes do not change the indentation of each other and no locking is needed.
+//  Every thread also gets a small number (T1, T2, ...) in the order it first writes to the log.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogContext
+{
+public:
+	enum { maxIndentLevel = 32 };
+
+private:
+	struct tThreadContext
+	{
+		int					indentLevel = 0;
+		uint32_t			threadNo = 0;
+		cpcc_string			scopePath;
+		std::vector<size_t>	scopePathLengths;	// the length of scopePath before each enterScope()
+	};
+
+	static tThreadContext &thisThread(void)
+	{
+		static thread_local tThreadContext _context;
+		if (_context.threadNo == 0)
+		{
+			static std::atomic<uint32_t> _lastThreadNo(0);
+			_context.threadNo = ++_lastThreadNo;
+		}
+		return _context;
+	}
+
+public:
+
+	static inline int			getIndentLevel(void) { return thisThread().indentLevel; }
+	static inline uint32_t		getThreadNo(void) { return thisThread().threadNo; }
+	static inline const cpcc_string &getScopePath(void) { return thisThread().scopePath; }
+
+	static inline void			increaseIndent(void) { ++thisThread().indentLevel; }
+	static inline void			decreaseIndent(void)
+	{
+		tThreadContext &context = thisThread();
+		if (context.indentLevel > 0)
+			--context.indentLevel;
+	}
+
+	/// indents the lines and adds aName to the scope path, until leaveScope()
+	static void enterScope(const cpcc_char *aName)
+	{
+		tThreadContext &context = thisThread();
+		context.scopePathLengths.push_back(context.scopePath.length());
+		if (!context.scopePath.empty())
+			context.scopePath.push_back(_T('/'));
+		if (aName)
+			context.scopePath.append(aName);
+		++context.indentLevel;
+	}
+
+	static void leaveScope(void)
+	{
+		tThreadContext &context = thisThread();
+		if (context.indentLevel > 0)
+			--context.indentLevel;
+		if (context.scopePathLengths.empty())
+			return;
+		context.scopePath.resize(context.scopePathLengths.back());
+		context.scopePathLengths.pop_back();
+	}
+
+public: // rendering, shared by the text log and the binary log decoder
+
+	/// e.g. "T2 main/loadSettings\t"
+	static void appendContext(cpcc_string &aBuffer, const uint32_t aThreadNo, const cpcc_string &aScopePath)
+	{
+		aBuffer.push_back(_T('T'));
+		cpccLogFormat::appendValue(aBuffer, aThreadNo);
+		if (!aScopePath.empty())
+		{
+			aBuffer.push_back(_T(' '));
+			aBuffer.append(aScopePath);
+		}
+		aBuffer.push_back(_T('\t'));
+	}
+
+	static void appendIndent(cpcc_string &aBuffer, int aLevel)
+	{
+		// precomputed: maxIndentLevel times "| "
+		static const cpcc_char _indent[] = _T("| | | | | | | | | | | | | | | | | | | | | | | | | | | | | | | | ");
+		static_assert(sizeof(_indent) / sizeof(_indent[0]) == 2 * maxIndentLevel + 1, "#4741: the indent text must have maxIndentLevel levels");
+		if (aLevel > maxIndentLevel)
+			aLevel = maxIndentLevel;
+		if (aLevel > 0)
+			aBuffer.append(_indent, 2 * static_cast<size_t>(aLevel));
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogContext testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogContext_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	const int level = cpccLogContext::getIndentLevel();
+	const cpcc_string path(cpccLogContext::getScopePath());
+
+	cpccLogContext::enterScope(_T("outer"));
+	cpccLogContext::enterScope(_T("inner"));
+	cpcc_string expectedPath(path);
+	if (!expectedPath.empty())
+		expectedPath.push_back(_T('/'));
+	expectedPath.append(_T("outer/inner"));
+	TEST_EXPECT(cpccLogContext::getScopePath() == expectedPath, _T("#7267a: cpccLogContext scope path"));
+	TEST_EXPECT(cpccLogContext::getIndentLevel() == level + 2, _T("#7267b: cpccLogContext indent level"));
+	cpccLogContext::leaveScope();
+	cpccLogContext::leaveScope();
+	TEST_EXPECT((cpccLogContext::getScopePath() == path) && (cpccLogContext::getIndentLevel() == level), _T("#7267c: cpccLogContext::leaveScope()"));
+
+	cpcc_string text;
+	cpccLogContext::appendContext(text, 3, _T("a/b"));
+	cpccLogContext::appendIndent(text, 2);
+	TEST_EXPECT(text.compare(_T("T3 a/b\t| | ")) == 0, _T("#7267d: cpccLogContext rendering"));
+}
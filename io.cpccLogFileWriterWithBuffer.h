@@ -13,16 +13,201 @@
  *	*****************************************
  */
 
+#pragma once
+
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <locale>
+#include <codecvt>
 
 #include "cpccUnicodeSupport.h"
 #include "io.cpccFileSystemMini.h"
 #include "fs.cpccPathHelper.h"
 #include "core.cpccIdeMacros.h"
 #include "core.cpccTryAndCatch.h"
+#include "io.cpccLogThreadBuffers.h"
+#include "data.cpccLZ.h"
+#include "io.cpccLogLiveTap.h"
+#include "io.cpccLogFlightRecorder.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogFileHandle
+//
+//	Keeps the log file open between writes, instead of the open/imbue/write/close
+//  cycle of cpccFileSystemMini::appendTextFile().
+//  The text is written as UTF-8 bytes, the same as appendTextFile() produces.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogFileHandle
+{
+private:
+	FILE	*m_fp = NULL;
+
+public:
+	cpccLogFileHandle() { }
+	cpccLogFileHandle(const cpccLogFileHandle& x) = delete;
+	cpccLogFileHandle& operator=(const cpccLogFileHandle& x) = delete;
+	~cpccLogFileHandle() { close(); }
+
+	bool isOpen(void) const { return (m_fp != NULL); }
+
+	// opens the file for appending. The file is not created if it does not exist.
+	bool open(const cpcc_char *aFilename)
+	{
+		close();
+		if (!aFilename || !cpccFileSystemMini::fileExists(aFilename))
+			return false;
+		#pragma warning(suppress : 4996)
+		m_fp = cpcc_fopen(aFilename, _T("ab"));
+		return isOpen();
+	}
+
+	void close(void)
+	{
+		if (m_fp)
+			fclose(m_fp);
+		m_fp = NULL;
+	}
+
+	/// returns the number of bytes written
+	size_t write(const cpcc_string &txt)
+	{
+		if (!m_fp)
+			return 0;
+	#ifdef UNICODE
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		const std::string bytes(converter.to_bytes(txt));
+		return fwrite(bytes.data(), 1, bytes.size(), m_fp);
+	#else
+		return fwrite(txt.data(), 1, txt.size(), m_fp);
+	#endif
+	}
+
+	void flush(void) { if (m_fp) fflush(m_fp); }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogRotation
+//
+//	Keeps the log file under a size (and age) limit by moving it to numbered, compressed segments:
+//	app.cpccLog.txt -> app.cpccLog.txt.1.lz -> app.cpccLog.txt.2.lz ... up to maxSegments.
+//  The caller renames the full file and starts a new one. The compression of the renamed file
+//  runs on a background thread. Nobody waits for it: while it runs, the rotation is not due,
+//  so the file grows a little more until the compression of the previous segment ends.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogRotation
+{
+private:
+	size_t		m_maxSegmentBytes = 0;	// 0: no rotation
+	int			m_maxSegments = 5;
+	int			m_maxSegmentAgeSeconds = 0;	// 0: no age limit
+	long long	m_segmentBytes = 0;
+	std::chrono::steady_clock::time_point	m_segmentStart;
+	std::thread	*m_compressorThread = NULL;
+	std::atomic<bool>	m_compressing;	// the compressor thread has not finished yet
+
+public:
+	cpccLogRotation() : m_segmentStart(std::chrono::steady_clock::now()), m_compressing(false) { }
+	cpccLogRotation(const cpccLogRotation& x) = delete;
+	cpccLogRotation& operator=(const cpccLogRotation& x) = delete;
+	~cpccLogRotation() { waitForCompressor(); }
+
+	void configure(const size_t maxSegmentBytes, const int maxSegments, const int maxSegmentAgeSeconds)
+	{
+		m_maxSegmentBytes = maxSegmentBytes;
+		m_maxSegments = (maxSegments > 0) ? maxSegments : 1;
+		m_maxSegmentAgeSeconds = (maxSegmentAgeSeconds > 0) ? maxSegmentAgeSeconds : 0;
+	}
+
+	inline bool isEnabled(void) const { return (m_maxSegmentBytes > 0) || (m_maxSegmentAgeSeconds > 0); }
+
+	/// a new (or emptied) log file starts a new segment
+	void startSegment(const long long aCurrentBytes)
+	{
+		m_segmentBytes = aCurrentBytes;
+		m_segmentStart = std::chrono::steady_clock::now();
+	}
+
+	inline void addBytes(const size_t nBytes) { m_segmentBytes += static_cast<long long>(nBytes); }
+
+	bool isDue(void) const
+	{
+		if (m_compressing)
+			return false;
+		if ((m_maxSegmentBytes > 0) && (m_segmentBytes >= static_cast<long long>(m_maxSegmentBytes)))
+			return true;
+		return (m_maxSegmentAgeSeconds > 0) && (m_segmentBytes > 0) &&
+			(std::chrono::steady_clock::now() - m_segmentStart >= std::chrono::seconds(m_maxSegmentAgeSeconds));
+	}
+
+	static cpcc_string getSegmentFilename(const cpcc_string &aLogFilename, const int aSegmentNo)
+	{
+		cpcc_string result(aLogFilename);
+		result.push_back(_T('.'));
+		result.append(cpcc_to_string(aSegmentNo));
+		result.append(_T(".lz"));
+		return result;
+	}
+
+	/// moves the (closed) log file to segment 1 and creates an empty log file. The caller must not write to the file meanwhile.
+	/// Call it only when isDue(), so that the compression of the previous segment has finished and this does not wait for it.
+	bool rotate(const cpcc_string &aLogFilename)
+	{
+		// segment 1 is written by the previous compression. Its thread has ended, so the join returns at once.
+		waitForCompressor();
+
+		const cpcc_string oldest(getSegmentFilename(aLogFilename, m_maxSegments));
+		if (cpccFileSystemMini::fileExists(oldest.c_str()))
+			cpccFileSystemMini::deleteFile(oldest.c_str());
+		for (int i = m_maxSegments - 1; i >= 1; --i)
+		{
+			const cpcc_string from(getSegmentFilename(aLogFilename, i));
+			if (cpccFileSystemMini::fileExists(from.c_str()))
+				cpccFileSystemMini::renameFile(from.c_str(), getSegmentFilename(aLogFilename, i + 1).c_str());
+		}
+
+		const cpcc_string uncompressed(aLogFilename + _T(".1.tmp"));
+		const bool renamed = cpccFileSystemMini::renameFile(aLogFilename.c_str(), uncompressed.c_str());
+		cpccFileSystemMini::createEmptyFile(aLogFilename.c_str());
+		startSegment(0);
+		if (!renamed)
+			return false;
+
+		const cpcc_string compressed(getSegmentFilename(aLogFilename, 1));
+		m_compressing = true;
+		m_compressorThread = new std::thread([this, uncompressed, compressed]()
+			{
+				if (cpccLZ::compressFile(uncompressed.c_str(), compressed.c_str()))
+					cpccFileSystemMini::deleteFile(uncompressed.c_str());
+				m_compressing = false;
+			});
+		return true;
+	}
+
+	void waitForCompressor(void)
+	{
+		if (!m_compressorThread)
+			return;
+		if (m_compressorThread->joinable())
+			m_compressorThread->join();
+		delete m_compressorThread;
+		m_compressorThread = NULL;
+	}
+};
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -38,6 +223,21 @@
 //
 //  If the file specified does not exist, logging is disabled. This is a way for the application to enable/disable the logging.
 //  To enable the logging, the application must first create the file (unless it already exists) before calling setFilename()
+//
+//  Async mode (see setAsyncMode()):
+//  add() only copies the line in the ring buffer of the calling thread (see cpccLogThreadRing), without taking any lock.
+//  A background writer thread wakes up every flushIntervalMsec (or earlier if a ring is half full)
+//  and writes the buffered lines in one batch to a file handle that stays open,
+//  and to the live tap and the flight recorder, so that the producers do not wait for their locks.
+//  If the ring of a thread is full, that thread writes the backlog itself, so no lines are lost.
+//  Threads that are shutting down (and cannot use their ring any more) use a bounded queue instead.
+//  Call flush() before the application terminates or from a crash handler. It writes the queued lines
+//  from the calling thread, so it does not depend on the writer thread being alive.
+//
+//  Rotation (see setRotation()):
+//  When the file reaches the size or age limit, it is moved to a numbered segment and compressed in the background.
+//  In async mode only the writer thread rotates, between two batches, so add() and flush() are never delayed by it.
+//  In synchronous mode the thread that fills the file rotates it. Nobody waits for the compression (see cpccLogRotation).
 //   
 ///////////////////////////////////////////////////////////////////////////////
 class  cpccLogFileWriterWithBuffer
@@ -48,6 +248,20 @@ private:
 	int maxBufferedLines;
 	std::mutex file_write_mutex;
 
+private:	// async mode
+	std::atomic<bool>		m_asyncMode, m_stopWriter;
+	std::deque<cpcc_string>	m_queue;
+	size_t					m_maxQueuedLines = 10000;
+	int						m_flushIntervalMsec = 200;
+	std::mutex				m_queueMutex,
+							m_fileMutex;	// serializes the batches written to m_file
+	std::condition_variable m_queueHasData, m_queueHasRoom;
+	cpccLogFileHandle		m_file;
+	std::thread				*m_writerThread = NULL;
+	cpccLogThreadRings		m_threadRings;
+	cpccLogRotation			m_rotation;		// guarded by m_fileMutex. Rotated by the writer thread in async mode.
+	cpccLogLiveTap			m_liveTap;
+
 private:
 	/* 
 	Always declare a copy constructor and assignment operator
@@ -58,10 +272,17 @@ private:
 	cpccLogFileWriterWithBuffer(const cpccLogFileWriterWithBuffer& x) = delete;
 	cpccLogFileWriterWithBuffer& operator=(const cpccLogFileWriterWithBuffer& x) = delete;
 
-	explicit cpccLogFileWriterWithBuffer(): maxBufferedLines(200), m_filename(_T("")) 	{  add( _T("cpccLogFileWriterWithBuffer starting.\n")); }
+	explicit cpccLogFileWriterWithBuffer(): maxBufferedLines(200), m_filename(_T("")), m_asyncMode(false), m_stopWriter(false)
+	{  add( _T("cpccLogFileWriterWithBuffer starting.\n")); }
 
 public:
-	virtual ~cpccLogFileWriterWithBuffer()  { 	add( _T("cpccLogFileWriterWithBuffer closing.\n")); }
+	virtual ~cpccLogFileWriterWithBuffer()
+	{
+		add( _T("cpccLogFileWriterWithBuffer closing.\n"));
+		stopWriterThread();
+		flush();
+		m_rotation.waitForCompressor();	// without the file lock. Nothing rotates any more.
+	}
 	
 public:
 
@@ -80,7 +301,13 @@ public:
             warningLog().add(_T("#4721: cpccLogFileWriterWithBuffer.setFilename() already called."));
 		
 		if (aFilename)
+		{
+			flush();
+			std::lock_guard<std::mutex> lock(m_fileMutex);
+			m_file.close();	// the writer will open the new file
 			m_filename = aFilename;
+			m_rotation.startSegment(0);
+		}
 		else
 			return;
 
@@ -95,6 +322,12 @@ public:
     
 	void add(const cpcc_char* txt) 
 	{
+		if (m_asyncMode && (m_filename.length() > 0))
+		{
+			addToThisThreadRing(txt);
+			return;
+		}
+
 		// experimental: lock
 		// creating here the static variable crashes, probably because add() is called during the constructor.
 		// I moved the variable as a class member
@@ -115,6 +348,18 @@ public:
                     std::cerr << "Exception in cpccLogFileWriterWithBuffer.add(""" << txt << """)" << std::endl;
                     throw std::runtime_error("Exception #6246 in cpccLogFileWriterWithBuffer.add() when calling cpccFileSystemMini::appendTextFile()");
                 }
+
+				if (m_liveTap.isOpen())
+					m_liveTap.write(txt);
+
+				std::lock_guard<std::mutex> fileLock(m_fileMutex);
+				if (m_rotation.isEnabled())
+				{	// without async mode, the thread that fills the file renames it. The compression is still in the background.
+					// The size of the text is an upper limit of the UTF-8 bytes that appendTextFile() writes.
+					m_rotation.addBytes(cpcc_strlen(txt) * sizeof(cpcc_char));
+					if (m_rotation.isDue())
+						m_rotation.rotate(m_filename);
+				}
             }
 		}
 		else
@@ -127,5 +372,186 @@ public:
 		}
 	}
 
-};
+public: // async mode
+
+	/// Switches between synchronous writing (the default) and writing from a background thread.
+	/// @param flushIntervalMsec  the maximum time a line stays in the queue before it is written
+	/// @param maxQueuedLines     the capacity of the queue. When it is full, add() waits.
+	void setAsyncMode(const bool enable, const int flushIntervalMsec = 200, const size_t maxQueuedLines = 10000)
+	{
+		if (!enable)
+		{
+			m_asyncMode = false;
+			stopWriterThread();
+			flush();
+			std::lock_guard<std::mutex> lock(m_fileMutex);
+			m_file.close();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_flushIntervalMsec = (flushIntervalMsec > 0) ? flushIntervalMsec : 1;
+			m_maxQueuedLines = (maxQueuedLines > 1) ? maxQueuedLines : 2;
+		}
+
+		if (!m_writerThread)
+		{
+			static bool atExitRegistered = false;
+			if (!atExitRegistered)
+				atExitRegistered = (std::atexit(flushAtExit) == 0);
+
+			m_stopWriter = false;
+			m_writerThread = new std::thread(&cpccLogFileWriterWithBuffer::writerThreadLoop, this);
+		}
+		m_asyncMode = true;
+	}
+
+	bool isAsyncMode(void) const { return m_asyncMode; }
+
+	/// Moves the log file to numbered, compressed segments when it reaches maxSegmentBytes
+	/// or when it is older than maxSegmentAgeSeconds (0 for no limit). Only the last maxSegments are kept.
+	void setRotation(const size_t maxSegmentBytes, const int maxSegments = 5, const int maxSegmentAgeSeconds = 0)
+	{
+		std::lock_guard<std::mutex> lock(m_fileMutex);
+		m_rotation.configure(maxSegmentBytes, maxSegments, maxSegmentAgeSeconds);
+		if (m_filename.length() > 0)
+			m_rotation.startSegment(cpccFileSystemMini::getFileSize(m_filename.c_str()));
+	}
+
+	/// Mirrors the lines that are written to the file into a shared-memory ring (see cpccLogLiveTap),
+	/// so that another process can follow the log without reading the file, e.g. with tools/io.cpccLogTail.cpp.
+	/// A 0 capacity closes the tap.
+	bool setLiveTap(const cpcc_char *aTapName, const size_t aCapacityBytes = 256 * 1024)
+	{
+		if (aCapacityBytes == 0)
+		{
+			m_liveTap.close();
+			return true;
+		}
+		return m_liveTap.open(aTapName, aCapacityBytes);
+	}
+
+	/// writes any queued lines to the file and flushes the OS buffers of the file handle.
+	/// It does not rotate the file, so a producer whose ring is full is not delayed by the rotation.
+	void flush(void) { writeQueuedLines(); }
+
+private:
+
+	static void flushAtExit(void) { getInstance().flush(); }
 
+	void addToThisThreadRing(const cpcc_char* txt)
+	{
+		if (!txt)
+			return;
+
+		cpccLogThreadRing *ring = m_threadRings.getThisThreadRing();
+		if (!ring)
+		{
+			addToQueue(txt);
+			return;
+		}
+
+		while (!ring->push(txt))
+			flush();	// the ring is full: write the backlog from this thread
+
+		if (ring->size() == cpccLogThreadRing::capacity / 2) // wake the writer earlier than the flush interval
+			m_queueHasData.notify_one();
+	}
+
+	void addToQueue(const cpcc_char* txt)
+	{
+		if (!txt)
+			return;
+
+		std::unique_lock<std::mutex> lock(m_queueMutex);
+		if (m_queue.size() >= m_maxQueuedLines)
+		{
+			m_queueHasData.notify_one();
+			m_queueHasRoom.wait(lock, [this] { return (m_queue.size() < m_maxQueuedLines) || m_stopWriter; });
+		}
+		m_queue.emplace_back(txt);
+		if (m_queue.size() == m_maxQueuedLines / 2) // wake the writer earlier than the flush interval
+			m_queueHasData.notify_one();
+	}
+
+	void writeQueuedLines(void)
+	{
+		// lock the file first, so that the batches are written in the order they were taken from the queue
+		std::lock_guard<std::mutex> fileLock(m_fileMutex);
+		std::deque<cpcc_string> batch;
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			batch.swap(m_queue);
+		}
+		m_queueHasRoom.notify_all();
+
+		if ((m_filename.length() > 0) && !m_file.isOpen())
+			m_file.open(m_filename.c_str());	// if the file does not exist, logging is disabled and the lines are discarded
+
+		size_t nBytes = 0;
+		const bool toLiveTap = m_liveTap.isOpen();
+		cpccLogFlightRecorder &flightRecorder = cpccLogFlightRecorder::getInstance();
+		const bool toFlightRecorder = flightRecorder.isEnabled();
+		auto writeLine = [this, &nBytes, toLiveTap, &flightRecorder, toFlightRecorder](const cpcc_string &line)
+			{
+				nBytes += m_file.write(line);
+				if (toLiveTap)
+					m_liveTap.write(line);
+				if (toFlightRecorder)
+					flightRecorder.write(line);
+			};
+		for (const auto &line : batch)
+			writeLine(line);
+		const size_t nFromRings = m_threadRings.drainAll(writeLine);
+
+		if (!batch.empty() || (nFromRings > 0))
+			m_file.flush();
+
+		if (m_rotation.isEnabled())
+			m_rotation.addBytes(nBytes);
+	}
+
+	// only the writer thread calls it
+	void rotateIfDue(void)
+	{
+		std::lock_guard<std::mutex> fileLock(m_fileMutex);
+		if (!m_rotation.isEnabled() || !m_file.isOpen() || !m_rotation.isDue())
+			return;
+		m_file.close();
+		m_rotation.rotate(m_filename);
+		m_file.open(m_filename.c_str());
+	}
+
+	void writerThreadLoop(void)
+	{
+		while (!m_stopWriter)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_queueMutex);
+				m_queueHasData.wait_for(lock, std::chrono::milliseconds(m_flushIntervalMsec),
+					[this] { return m_stopWriter || (m_queue.size() >= m_maxQueuedLines / 2); });
+			}
+			writeQueuedLines();
+			rotateIfDue();
+		}
+	}
+
+	void stopWriterThread(void)
+	{
+		if (!m_writerThread)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_stopWriter = true;
+		}
+		m_queueHasData.notify_all();
+		m_queueHasRoom.notify_all();
+		if (m_writerThread->joinable())
+			m_writerThread->join();
+		delete m_writerThread;
+		m_writerThread = NULL;
+	}
+
+};
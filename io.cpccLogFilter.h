@@ -0,0 +1,288 @@
+/*  *****************************************
+ *  File:		io.cpccLogFilter.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				runtime log levels per module
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+
+/*
+	Usage:
+		static cpccLogModule networkLog(_T("network"));
+		...
+		cpccLOG_MODULE(networkLog, debug).fmt(_T("received {} bytes"), n);
+		cpccLOG(debug).fmt(_T("cache has {} items"), countItems());	// the default threshold
+
+		// e.g. from cpccSettings: "info,network=debug,render=off"
+		cpccLogFilter::getInstance().configure(settings.get(_T("logLevels"), _T("info")).c_str());
+
+	A line is written if its level is not above the threshold of its module.
+	Modules without their own threshold follow the default threshold, which also filters
+	infoLog(), warningLog() etc. With the macros the check is a relaxed atomic load before
+	the arguments are evaluated; infoLog().fmt() checks it before formatting.
+*/
+
+enum class cpccLogLevel : int { off = 0, error, warning, info, debug };
+
+
+class cpccLogModule;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogFilter
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogFilter
+{
+private:
+	std::mutex					m_mutex;
+	std::atomic<int>			m_defaultThreshold;
+	std::map<cpcc_string, int>	m_moduleThresholds;
+	std::vector<cpccLogModule *> m_modules;
+
+	cpccLogFilter():
+	#ifdef cpccDEBUG
+		m_defaultThreshold(static_cast<int>(cpccLogLevel::debug))
+	#else
+		m_defaultThreshold(static_cast<int>(cpccLogLevel::info))
+	#endif
+	{ }
+
+	cpccLogFilter(const cpccLogFilter& x) = delete;
+	cpccLogFilter& operator=(const cpccLogFilter& x) = delete;
+
+	inline void updateModule(cpccLogModule &aModule);	// call with m_mutex locked
+
+public:
+
+	static cpccLogFilter &getInstance(void)
+	{
+		static cpccLogFilter* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccLogFilter;
+		return *_instPtr;
+	}
+
+	inline bool isEnabled(const cpccLogLevel aLevel) const
+	{
+		return static_cast<int>(aLevel) <= m_defaultThreshold.load(std::memory_order_relaxed);
+	}
+
+	inline cpccLogLevel getDefaultLevel(void) const { return static_cast<cpccLogLevel>(m_defaultThreshold.load(std::memory_order_relaxed)); }
+
+	void setDefaultLevel(const cpccLogLevel aLevel)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_defaultThreshold = static_cast<int>(aLevel);
+		for (auto module : m_modules)
+			updateModule(*module);
+	}
+
+	void setModuleLevel(const cpcc_char *aModuleName, const cpccLogLevel aLevel)
+	{
+		if (!aModuleName)
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_moduleThresholds[aModuleName] = static_cast<int>(aLevel);
+		for (auto module : m_modules)
+			updateModule(*module);
+	}
+
+	/// the module follows the default level again
+	void clearModuleLevel(const cpcc_char *aModuleName)
+	{
+		if (!aModuleName)
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_moduleThresholds.erase(aModuleName);
+		for (auto module : m_modules)
+			updateModule(*module);
+	}
+
+	/// sets the levels from a text like "warning,network=debug,render=off".
+	/// An item without '=' is the default level. Returns false if some item was not understood.
+	bool configure(const cpcc_char *aSpec)
+	{
+		if (!aSpec)
+			return false;
+		bool allOk = true;
+		const cpcc_string spec(aSpec);
+		size_t start = 0;
+		while (start <= spec.length())
+		{
+			size_t end = spec.find(_T(','), start);
+			if (end == cpcc_string::npos)
+				end = spec.length();
+			const cpcc_string item(trim(spec.substr(start, end - start)));
+			start = end + 1;
+			if (item.empty())
+				continue;
+
+			const size_t equal = item.find(_T('='));
+			cpccLogLevel level;
+			if (!parseLevel(trim(equal == cpcc_string::npos ? item : item.substr(equal + 1)), level))
+			{
+				allOk = false;
+				continue;
+			}
+			if (equal == cpcc_string::npos)
+				setDefaultLevel(level);
+			else
+				setModuleLevel(trim(item.substr(0, equal)).c_str(), level);
+		}
+		return allOk;
+	}
+
+	static const cpcc_char *getLevelName(const cpccLogLevel aLevel)
+	{
+		const int i = static_cast<int>(aLevel);
+		return ((i >= 0) && (i < nLevels)) ? levelNames()[i] : _T("");
+	}
+
+	static bool parseLevel(const cpcc_string &aText, cpccLogLevel &aLevel)
+	{
+		for (int i = 0; i < nLevels; ++i)
+			if (aText.compare(levelNames()[i]) == 0)
+			{
+				aLevel = static_cast<cpccLogLevel>(i);
+				return true;
+			}
+		return false;
+	}
+
+	inline void registerModule(cpccLogModule &aModule);
+	inline void unregisterModule(cpccLogModule &aModule);
+
+private:
+	enum { nLevels = 5 };
+
+	static const cpcc_char * const *levelNames(void)
+	{
+		static const cpcc_char * const _names[nLevels] = { _T("off"), _T("error"), _T("warning"), _T("info"), _T("debug") };
+		return _names;
+	}
+
+	static cpcc_string trim(const cpcc_string &aText)
+	{
+		const size_t first = aText.find_first_not_of(_T(" \t"));
+		if (first == cpcc_string::npos)
+			return cpcc_string();
+		return aText.substr(first, aText.find_last_not_of(_T(" \t")) - first + 1);
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogModule
+//
+//	A static object per module (e.g. per source file or subsystem) with the threshold of the module.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogModule
+{
+	friend class cpccLogFilter;
+
+private:
+	const cpcc_string	m_name;
+	std::atomic<int>	m_threshold;	// set by cpccLogFilter
+
+public:
+	explicit cpccLogModule(const cpcc_char *aName): m_name(aName ? aName : _T("")), m_threshold(static_cast<int>(cpccLogLevel::info))
+	{
+		cpccLogFilter::getInstance().registerModule(*this);
+	}
+
+	~cpccLogModule() { cpccLogFilter::getInstance().unregisterModule(*this); }
+
+	cpccLogModule(const cpccLogModule& x) = delete;
+	cpccLogModule& operator=(const cpccLogModule& x) = delete;
+
+	inline const cpcc_string &getName(void) const { return m_name; }
+
+	inline bool isEnabled(const cpccLogLevel aLevel) const
+	{
+		return static_cast<int>(aLevel) <= m_threshold.load(std::memory_order_relaxed);
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogFilter implementation
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+void cpccLogFilter::updateModule(cpccLogModule &aModule)
+{
+	const auto it = m_moduleThresholds.find(aModule.m_name);
+	aModule.m_threshold = (it != m_moduleThresholds.end()) ? it->second : m_defaultThreshold.load();
+}
+
+
+void cpccLogFilter::registerModule(cpccLogModule &aModule)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_modules.push_back(&aModule);
+	updateModule(aModule);
+}
+
+
+void cpccLogFilter::unregisterModule(cpccLogModule &aModule)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_modules.erase(std::remove(m_modules.begin(), m_modules.end(), &aModule), m_modules.end());
+}
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogFilter testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogFilter_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpccLogFilter &filter = cpccLogFilter::getInstance();
+	const cpccLogLevel savedLevel = filter.getDefaultLevel();
+
+	cpccLogModule moduleA(_T("cpccLogFilter_testA")), moduleB(_T("cpccLogFilter_testB"));
+	TEST_EXPECT(filter.configure(_T("warning, cpccLogFilter_testA = debug")), _T("#7269a: cpccLogFilter::configure()"));
+	TEST_EXPECT(moduleA.isEnabled(cpccLogLevel::debug) && !moduleB.isEnabled(cpccLogLevel::info) && moduleB.isEnabled(cpccLogLevel::warning),
+		_T("#7269b: cpccLogModule thresholds"));
+	TEST_EXPECT(!filter.isEnabled(cpccLogLevel::info) && filter.isEnabled(cpccLogLevel::error), _T("#7269c: cpccLogFilter default threshold"));
+	TEST_EXPECT(!filter.configure(_T("loud")), _T("#7269d: cpccLogFilter::configure() accepted an unknown level"));
+
+	filter.clearModuleLevel(_T("cpccLogFilter_testA"));
+	TEST_EXPECT(!moduleA.isEnabled(cpccLogLevel::info), _T("#7269e: cpccLogFilter::clearModuleLevel()"));
+	filter.setDefaultLevel(savedLevel);
+}
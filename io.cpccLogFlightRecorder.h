@@ -0,0 +1,394 @@
+/*  *****************************************
+ *  File:		io.cpccLogFlightRecorder.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				crash-safe log ring in a memory-mapped file
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <locale>
+#include <codecvt>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#elif defined(__linux__) || defined(__APPLE__)
+	#include <sys/mman.h>
+	#include <sys/types.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#else
+	#error #4731: Unsupported platform for io.cpccLogFlightRecorder.h
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccFileSystemMini.h"
+#include "cpccTesting.h"
+
+/*
+	The flight recorder keeps the last log lines in a fixed-size file that is mapped in memory.
+	Every line is copied straight into the mapping, so the OS writes it to the disk even if the process crashes.
+	The small header at the beginning of the file has the run state: it is set to 'running' when the
+	recorder opens and to 'clean' when it closes (or at exit()). If the header still says 'running'
+	when the next run starts, the previous run did not end normally.
+
+	File layout (native byte order):
+		header:		cpccLogFlightRecorderHeader
+		data:		capacity bytes, used as a ring of cpcc_char text. writePos is the total number of bytes ever written.
+*/
+
+
+struct cpccLogFlightRecorderHeader
+{
+	enum { version = 1 };
+	enum tRunState : uint32_t { runStateClean = 0, runStateRunning = 1 };
+
+	char		magic[8];	// "cpccRING"
+	uint32_t	version_;
+	uint32_t	charSize;
+	uint64_t	capacity;
+	uint64_t	writePos;
+	uint32_t	runState;
+	uint32_t	reserved;
+
+	static const char *getMagic(void) { return "cpccRING"; }
+
+	bool isValid(void) const
+	{
+		return (memcmp(magic, getMagic(), sizeof(magic)) == 0) && (version_ == version) && (charSize == sizeof(cpcc_char));
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogFlightRecorder
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogFlightRecorder
+{
+private:
+	std::mutex						m_mutex;
+	cpccLogFlightRecorderHeader		*m_header = NULL;
+	char							*m_data = NULL;
+	size_t							m_mappedSize = 0;
+	std::atomic<bool>				m_enabled;
+
+	#ifdef _WIN32
+		HANDLE						m_hFile = INVALID_HANDLE_VALUE;
+		HANDLE						m_hMapping = NULL;
+	#else
+		int							m_fd = -1;
+	#endif
+
+	cpccLogFlightRecorder(): m_enabled(false) { }
+	cpccLogFlightRecorder(const cpccLogFlightRecorder& x) = delete;
+	cpccLogFlightRecorder& operator=(const cpccLogFlightRecorder& x) = delete;
+
+	static void markCleanAtExit(void) { getInstance().close(); }
+
+public:
+
+	static cpccLogFlightRecorder &getInstance(void)
+	{
+		static cpccLogFlightRecorder* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccLogFlightRecorder;
+		return *_instPtr;
+	}
+
+	inline bool isEnabled(void) const { return m_enabled; }
+
+	/// creates (or resets) the ring file and maps it in memory. The previous contents are discarded,
+	/// so read them with cpccLogFlightRecorderReader before calling open().
+	bool open(const cpcc_char *aFilename, const size_t aCapacityBytes)
+	{
+		close();
+		if (!aFilename)
+			return false;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const size_t capacity = (aCapacityBytes / sizeof(cpcc_char)) * sizeof(cpcc_char);
+		if (capacity == 0)
+			return false;
+		m_mappedSize = sizeof(cpccLogFlightRecorderHeader) + capacity;
+
+		if (!mapFile(aFilename))
+		{
+			cpcc_cerr << _T("#4732: cpccLogFlightRecorder could not map the file:") << aFilename << std::endl;
+			unmapFile();
+			return false;
+		}
+
+		m_data = reinterpret_cast<char *>(m_header) + sizeof(cpccLogFlightRecorderHeader);
+		memcpy(m_header->magic, cpccLogFlightRecorderHeader::getMagic(), sizeof(m_header->magic));
+		m_header->version_ = cpccLogFlightRecorderHeader::version;
+		m_header->charSize = sizeof(cpcc_char);
+		m_header->capacity = capacity;
+		m_header->writePos = 0;
+		m_header->reserved = 0;
+		m_header->runState = cpccLogFlightRecorderHeader::runStateRunning;
+
+		static bool _atExitRegistered = false;
+		if (!_atExitRegistered)
+			_atExitRegistered = (atexit(markCleanAtExit) == 0);
+
+		m_enabled = true;
+		return true;
+	}
+
+	/// marks the run as clean and unmaps the file
+	void close(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_enabled = false;
+		if (m_header)
+			m_header->runState = cpccLogFlightRecorderHeader::runStateClean;
+		unmapFile();
+	}
+
+	void write(const cpcc_string &aText)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_header)
+			return;
+
+		const uint64_t capacity = m_header->capacity;
+		const char *src = reinterpret_cast<const char *>(aText.data());
+		size_t nBytes = aText.length() * sizeof(cpcc_char);
+		if (nBytes > capacity)
+		{	// keep only the end of a line that does not fit in the ring
+			src += nBytes - capacity;
+			nBytes = static_cast<size_t>(capacity);
+		}
+
+		const size_t pos = static_cast<size_t>(m_header->writePos % capacity);
+		const size_t firstPart = (nBytes < capacity - pos) ? nBytes : static_cast<size_t>(capacity - pos);
+		memcpy(m_data + pos, src, firstPart);
+		memcpy(m_data, src + firstPart, nBytes - firstPart);
+		// the position moves after the bytes are copied, so a crash leaves at most a partial last line
+		m_header->writePos += nBytes;
+	}
+
+private:
+
+	#ifdef _WIN32
+
+	bool mapFile(const cpcc_char *aFilename)
+	{
+		m_hFile = CreateFile(aFilename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+		const uint64_t size = m_mappedSize;
+		m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), NULL);
+		if (!m_hMapping)
+			return false;
+		m_header = static_cast<cpccLogFlightRecorderHeader *>(MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, m_mappedSize));
+		return (m_header != NULL);
+	}
+
+	void unmapFile(void)
+	{
+		if (m_header)
+			UnmapViewOfFile(m_header);
+		if (m_hMapping)
+			CloseHandle(m_hMapping);
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+		m_header = NULL;
+		m_data = NULL;
+		m_hMapping = NULL;
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+
+	#else	// POSIX: Linux and macOS
+
+	bool mapFile(const cpcc_char *aFilename)
+	{
+		m_fd = ::open(aFilename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0)
+			return false;
+		if (ftruncate(m_fd, static_cast<off_t>(m_mappedSize)) != 0)
+			return false;
+		void *p = mmap(NULL, m_mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (p == MAP_FAILED)
+			return false;
+		m_header = static_cast<cpccLogFlightRecorderHeader *>(p);
+		return true;
+	}
+
+	void unmapFile(void)
+	{
+		if (m_header)
+		{
+			msync(m_header, m_mappedSize, MS_ASYNC);
+			munmap(m_header, m_mappedSize);
+		}
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_header = NULL;
+		m_data = NULL;
+		m_fd = -1;
+	}
+
+	#endif
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogFlightRecorderReader
+//
+//	Reads a ring file (e.g. of the previous run) without mapping it.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogFlightRecorderReader
+{
+private:
+	static bool readHeader(FILE *fp, cpccLogFlightRecorderHeader &aHeader)
+	{
+		return (fread(&aHeader, sizeof(aHeader), 1, fp) == 1) && aHeader.isValid() && (aHeader.capacity > 0);
+	}
+
+public:
+
+	/// true if the ring file exists and its run did not close normally
+	static bool wasIncomplete(const cpcc_char *aFilename)
+	{
+		if (!aFilename || !cpccFileSystem::fileExists(aFilename))
+			return false;
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aFilename, _T("rb"));
+		if (!fp)
+			return false;
+		cpccLogFlightRecorderHeader header;
+		const bool result = readHeader(fp, header) && (header.runState == cpccLogFlightRecorderHeader::runStateRunning);
+		fclose(fp);
+		return result;
+	}
+
+	/// extracts the lines in the ring, oldest first, in the text format of the log file.
+	/// When the ring has wrapped around, the first (partial) line is skipped.
+	static bool read(const cpcc_char *aFilename, cpcc_string &aText)
+	{
+		if (!aFilename)
+			return false;
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aFilename, _T("rb"));
+		if (!fp)
+			return false;
+
+		cpccLogFlightRecorderHeader header;
+		if (!readHeader(fp, header))
+		{
+			fclose(fp);
+			return false;
+		}
+
+		std::string data(static_cast<size_t>(header.capacity), '\0');
+		const bool readOk = (fread(&data[0], 1, data.size(), fp) == data.size());
+		fclose(fp);
+		if (!readOk)
+			return false;
+
+		const bool wrapped = (header.writePos > header.capacity);
+		const size_t nBytes = static_cast<size_t>(wrapped ? header.capacity : header.writePos);
+		const size_t start = static_cast<size_t>(wrapped ? header.writePos % header.capacity : 0);
+
+		std::string bytes(data, start);
+		bytes.append(data, 0, start);
+		bytes.resize(nBytes);
+
+		cpcc_string text(reinterpret_cast<const cpcc_char *>(bytes.data()), bytes.size() / sizeof(cpcc_char));
+		if (wrapped)
+		{
+			const size_t lineEnd = text.find(_T('\n'));
+			text.erase(0, (lineEnd == cpcc_string::npos) ? text.length() : lineEnd + 1);
+		}
+		aText.append(text);
+		return true;
+	}
+
+	/// renders a ring file to a text file (UTF-8)
+	static bool extractToTextFile(const cpcc_char *aRingFilename, const cpcc_char *aTextFilename)
+	{
+		cpcc_string text;
+		if (!aTextFilename || !read(aRingFilename, text))
+			return false;
+
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aTextFilename, _T("wb"));
+		if (!fp)
+			return false;
+	#ifdef UNICODE
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		const std::string utf8(converter.to_bytes(text));
+	#else
+		const std::string &utf8 = text;
+	#endif
+		const bool writtenOk = (fwrite(utf8.data(), 1, utf8.size(), fp) == utf8.size());
+		fclose(fp);
+		return writtenOk;
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogFlightRecorder testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogFlightRecorder_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	const cpcc_string fn(cpccFileSystemMini::getTempFilename() + _T(".ring"));
+	cpccLogFlightRecorder &recorder = cpccLogFlightRecorder::getInstance();
+	const bool wasEnabled = recorder.isEnabled();
+	if (wasEnabled)
+	{
+		TEST_ADDNOTE("cpccLogFlightRecorder is in use by the log. Test skipped");
+		return;
+	}
+
+	// a ring of 64 characters with lines of 10 characters
+	TEST_EXPECT(recorder.open(fn.c_str(), 64 * sizeof(cpcc_char)), _T("#7264a: cpccLogFlightRecorder::open()"));
+	for (int i = 0; i < 10; ++i)
+	{
+		cpcc_string line(_T("line 0000\n"));
+		line[8] = static_cast<cpcc_char>(_T('0') + i);
+		recorder.write(line);
+	}
+	TEST_EXPECT(cpccLogFlightRecorderReader::wasIncomplete(fn.c_str()), _T("#7264b: open ring not marked as running"));
+
+	cpcc_string text;
+	TEST_EXPECT(cpccLogFlightRecorderReader::read(fn.c_str(), text), _T("#7264c: cpccLogFlightRecorderReader::read()"));
+	TEST_EXPECT(text.compare(_T("line 0004\nline 0005\nline 0006\nline 0007\nline 0008\nline 0009\n")) == 0, _T("#7264d: wrong ring contents"));
+
+	recorder.close();
+	TEST_EXPECT(!cpccLogFlightRecorderReader::wasIncomplete(fn.c_str()), _T("#7264e: closed ring still marked as running"));
+	cpccFileSystem::deleteFile(fn.c_str());
+}
@@ -0,0 +1,283 @@
+/*  *****************************************
+ *  File:		io.cpccLogFormat.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				type-safe formatting of log messages without memory allocations
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogFormat
+//
+//	Formats a message with {} placeholders, e.g.
+//		cpccLogFormat::format(buffer, _T("x={} y={}"), x, y);
+//  Use {{ and }} for literal braces.
+//  The text is appended to the buffer. The buffer is a string that keeps its capacity
+//  between calls (see threadBuffer()) so the heap is used only when a message
+//  is larger than any previous message of the same thread.
+//  Numbers are converted with a small digit loop (integers) or snprintf into a stack buffer (floats),
+//  instead of the ostringstream or the 8000-char buffer of cpccLogFormatter::addf().
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogFormat
+{
+public:
+	enum { initialBufferCapacity = 1024 };
+
+	/// a buffer per thread that is reused by every formatting call of that thread
+	static cpcc_string &threadBuffer(void)
+	{
+		static thread_local cpcc_string _buffer;
+		if (_buffer.capacity() < initialBufferCapacity)
+			_buffer.reserve(initialBufferCapacity);
+		return _buffer;
+	}
+
+	static void format(cpcc_string &aBuffer, const cpcc_char *aFormat)
+	{
+		if (!aFormat)
+			return;
+		const cpcc_char *p = aFormat;
+		while (appendUntilPlaceholder(aBuffer, p))
+			aBuffer.append(_T("{}"));	// more placeholders than arguments
+	}
+
+	template <typename tArg, typename... tArgs>
+	static void format(cpcc_string &aBuffer, const cpcc_char *aFormat, const tArg &aArg, const tArgs&... aArgs)
+	{
+		if (!aFormat)
+			return;
+		const cpcc_char *p = aFormat;
+		if (appendUntilPlaceholder(aBuffer, p))
+		{
+			appendValue(aBuffer, aArg);
+			format(aBuffer, p, aArgs...);
+		}
+		// else: more arguments than placeholders. The extra ones are ignored.
+	}
+
+public: // value converters
+
+	static void appendValue(cpcc_string &aBuffer, const cpcc_char *aValue) { aBuffer.append(aValue ? aValue : _T("(null)")); }
+	static void appendValue(cpcc_string &aBuffer, cpcc_char *aValue) { appendValue(aBuffer, (const cpcc_char *) aValue); }
+	static void appendValue(cpcc_string &aBuffer, const cpcc_string &aValue) { aBuffer.append(aValue); }
+	static void appendValue(cpcc_string &aBuffer, const bool aValue) { aBuffer.append(aValue ? _T("true") : _T("false")); }
+	static void appendValue(cpcc_string &aBuffer, const cpcc_char aValue) { aBuffer.push_back(aValue); }
+
+	template <size_t N>
+	static void appendValue(cpcc_string &aBuffer, const cpcc_char (&aValue)[N]) { appendValue(aBuffer, (const cpcc_char *)aValue); }
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, cpcc_char>::value>::type
+		appendValue(cpcc_string &aBuffer, const T aValue)
+	{
+		// unsigned arithmetic, so that the minimum value of a signed type does not overflow
+		typedef typename std::make_unsigned<T>::type tUnsigned;
+		tUnsigned magnitude = static_cast<tUnsigned>(aValue);
+		if (aValue < 0)
+		{
+			aBuffer.push_back(_T('-'));
+			magnitude = static_cast<tUnsigned>(0) - magnitude;
+		}
+
+		cpcc_char digits[24];
+		int pos = sizeof(digits) / sizeof(digits[0]);
+		do
+		{
+			digits[--pos] = static_cast<cpcc_char>(_T('0') + (magnitude % 10));
+			magnitude /= 10;
+		} while (magnitude);
+		aBuffer.append(digits + pos, digits + sizeof(digits) / sizeof(digits[0]));
+	}
+
+	template <typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+		appendValue(cpcc_string &aBuffer, const T aValue)
+	{
+		if (appendFixedPoint(aBuffer, static_cast<double>(aValue)))
+			return;
+		char tmp[32];
+		#pragma warning(suppress : 4996)
+		const int n = snprintf(tmp, sizeof(tmp), "%g", static_cast<double>(aValue));
+		for (int i = 0; (i < n) && (i < (int) sizeof(tmp) - 1); ++i)
+			aBuffer.push_back(static_cast<cpcc_char>(tmp[i]));
+	}
+
+	template <typename T>
+	static void appendValue(cpcc_string &aBuffer, const T *aPointer)
+	{
+		aBuffer.append(_T("0x"));
+		uintptr_t value = reinterpret_cast<uintptr_t>(aPointer);
+		cpcc_char digits[2 * sizeof(uintptr_t)];
+		int pos = sizeof(digits) / sizeof(digits[0]);
+		do
+		{
+			digits[--pos] = _T("0123456789abcdef")[value & 0xF];
+			value >>= 4;
+		} while (value);
+		aBuffer.append(digits + pos, digits + sizeof(digits) / sizeof(digits[0]));
+	}
+
+private:
+
+	// The same text as "%g" for the common values (6 significant digits, -4 <= exponent < 6),
+	// with integer arithmetic instead of snprintf. Returns false for the other values
+	// and when the value is too close to a rounding tie to be sure of the digits.
+	static bool appendFixedPoint(cpcc_string &aBuffer, const double aValue)
+	{
+		static const double powersOf10[] = { 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6 };
+		static const double scales[] = { 1e9, 1e8, 1e7, 1e6, 1e5, 1e4, 1e3, 1e2, 1e1, 1e0 };	// 10^(5 - exponent)
+
+		const double magnitude = (aValue < 0) ? -aValue : aValue;
+		if (aValue == 0)
+		{
+			aBuffer.append(std::signbit(aValue) ? _T("-0") : _T("0"));
+			return true;
+		}
+		if (!(magnitude >= 1e-4) || !(magnitude < 999999.5))	// also false for nan and inf
+			return false;
+
+		int k = 0;
+		while (magnitude >= powersOf10[k + 1])
+			++k;
+		int exponent = k - 4;	// 10^exponent <= magnitude < 10^(exponent + 1)
+
+		const double scaled = magnitude * scales[exponent + 4];
+		uint64_t digits = static_cast<uint64_t>(scaled);
+		const double fraction = scaled - static_cast<double>(digits);
+		if ((fraction > 0.5 - 1e-6) && (fraction < 0.5 + 1e-6))
+			return false;	// snprintf knows the exact binary value
+		if (fraction > 0.5)
+			++digits;
+		if (digits >= 1000000)	// rounded up to the next power of 10
+		{
+			if (++exponent >= 6)
+				return false;
+			digits /= 10;
+		}
+
+		int decimals = 5 - exponent;
+		while ((decimals > 0) && (digits % 10 == 0))
+		{
+			digits /= 10;
+			--decimals;
+		}
+
+		cpcc_char text[24];
+		int pos = sizeof(text) / sizeof(text[0]);
+		for (int i = 0; i < decimals; ++i)
+		{
+			text[--pos] = static_cast<cpcc_char>(_T('0') + (digits % 10));
+			digits /= 10;
+		}
+		if (decimals > 0)
+			text[--pos] = _T('.');
+		do
+		{
+			text[--pos] = static_cast<cpcc_char>(_T('0') + (digits % 10));
+			digits /= 10;
+		} while (digits);
+		if (aValue < 0)
+			text[--pos] = _T('-');
+		aBuffer.append(text + pos, text + sizeof(text) / sizeof(text[0]));
+		return true;
+	}
+
+public:	// also used by cpccBinaryLogDecoder that formats the arguments at runtime
+
+	// appends the literal text up to the next {} and moves aPos after it.
+	// Returns false if the end of the format was reached without finding a placeholder.
+	static bool appendUntilPlaceholder(cpcc_string &aBuffer, const cpcc_char *&aPos)
+	{
+		const cpcc_char *p = aPos;
+		while (*p)
+		{
+			if ((p[0] == _T('{')) && (p[1] == _T('}')))
+			{
+				aBuffer.append(aPos, p);
+				aPos = p + 2;
+				return true;
+			}
+
+			if (((p[0] == _T('{')) && (p[1] == _T('{'))) || ((p[0] == _T('}')) && (p[1] == _T('}'))))
+			{
+				aBuffer.append(aPos, p + 1);	// keep one of the two braces
+				p += 2;
+				aPos = p;
+				continue;
+			}
+			++p;
+		}
+
+		aBuffer.append(aPos, p);
+		aPos = p;
+		return false;
+	}
+
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogFormat testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogFormat_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpcc_string buf;
+	cpccLogFormat::format(buf, _T("x={} y={} name={} ok={}"), 12, -345L, _T("abc"), true);
+	TEST_EXPECT(buf.compare(_T("x=12 y=-345 name=abc ok=true")) == 0, _T("#7261a: cpccLogFormat basic"));
+
+	buf.clear();
+	cpccLogFormat::format(buf, _T("{} {} {}"), (long long) -9223372036854775807LL - 1, 0u, 2.5);
+	TEST_EXPECT(buf.compare(_T("-9223372036854775808 0 2.5")) == 0, _T("#7261b: cpccLogFormat limits"));
+
+	buf.clear();
+	cpccLogFormat::format(buf, _T("{{literal}} {} {}"), 1);
+	TEST_EXPECT(buf.compare(_T("{literal} 1 {}")) == 0, _T("#7261c: cpccLogFormat braces and missing arguments"));
+
+	// the fast path of the floats must give the same text as "%g"
+	bool sameAsPrintf = true;
+	const double samples[] = { 0.0, -0.0, 1.0, 0.25, -2.5, 0.1, 1.0 / 3, 123456.4, 999999.4, 999999.6, 0.000123456789, 9.9999996e-5, 1e-5, 3.14159265, -42.0, 1e20 };
+	for (const double sample : samples)
+	{
+		cpcc_string fast;
+		cpccLogFormat::appendValue(fast, sample);
+		char expected[32];
+		#pragma warning(suppress : 4996)
+		snprintf(expected, sizeof(expected), "%g", sample);
+		sameAsPrintf = sameAsPrintf && (fast == cpcc_string(expected, expected + strlen(expected)));
+	}
+	TEST_EXPECT(sameAsPrintf, _T("#7261d: cpccLogFormat floats differ from %g"));
+}
@@ -0,0 +1,549 @@
+/*  *****************************************
+ *  File:		io.cpccLogLiveTap.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				shared-memory ring of the log lines, for watching a running application
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <new>
+#include <locale>
+#include <codecvt>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#elif defined(__APPLE__) || defined(__linux__)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/types.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <signal.h>
+	#include <cerrno>
+#else
+	#error #4736: Unsupported platform for io.cpccLogLiveTap.h
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+
+/*
+	The live tap is a ring of the log text (UTF-8) in named shared memory: shm_open() on macOS and Linux,
+	a named file mapping on Windows. The log writer copies every line into it and a viewer in another process
+	(e.g. tools/io.cpccLogTail.cpp) attaches to the same name and follows the text.
+
+	The producer never waits for the readers: a reader that falls more than the capacity behind
+	loses the overwritten text and continues from the next complete line.
+	Only one producer writes to a tap name: while it runs (and has not closed the tap), open() with the same name fails.
+	A tap left by a closed or crashed producer is replaced.
+
+	Shared memory layout (native byte order):
+		header:		cpccLogLiveTapHeader
+		data:		capacity bytes, used as a ring. The positions are the total number of bytes ever written.
+
+	The producer moves reservePos before it copies a line and writePos after it.
+	A reader copies up to writePos and then checks reservePos, to drop any bytes that were overwritten during the copy.
+*/
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "#4737: the live tap needs lock-free 64bit atomics to share them between processes");
+
+
+struct cpccLogLiveTapHeader
+{
+	enum { version = 1 };
+
+	char					magic[8];	// "cpccTAP1"
+	uint32_t				version_;
+	uint32_t				ownerPid;	// the process of the producer
+	uint64_t				capacity;
+	uint64_t				sessionId;	// different every time a producer creates the tap
+	std::atomic<uint64_t>	reservePos, writePos;
+	std::atomic<uint32_t>	closed;
+
+	static const char *getMagic(void) { return "cpccTAP1"; }
+
+	bool isValid(void) const { return (memcmp(magic, getMagic(), sizeof(magic)) == 0) && (version_ == version) && (capacity > 0); }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogLiveTapMapping
+//
+//	The named shared memory, created by the producer or opened read-only by a reader.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogLiveTapMapping
+{
+private:
+	cpcc_string		m_name;
+	void			*m_address = NULL;
+	size_t			m_size = 0;
+	bool			m_isOwner = false;
+
+	#ifdef _WIN32
+		HANDLE		m_hMapping = NULL;
+	#endif
+
+public:
+	cpccLogLiveTapMapping() { }
+	cpccLogLiveTapMapping(const cpccLogLiveTapMapping& x) = delete;
+	cpccLogLiveTapMapping& operator=(const cpccLogLiveTapMapping& x) = delete;
+	~cpccLogLiveTapMapping() { close(); }
+
+	inline void		*getAddress(void) const { return m_address; }
+	inline size_t	getSize(void) const { return m_size; }
+
+	/// the name of the shared memory object for a tap name, e.g. "/cpccLogTap.MyApp"
+	static cpcc_string getSharedName(const cpcc_char *aTapName)
+	{
+		cpcc_string name(aTapName ? aTapName : _T(""));
+		for (auto &c : name)
+			if ((c == _T('/')) || (c == _T('\\')) || (c == _T(' ')))
+				c = _T('_');
+	#ifdef _WIN32
+		return cpcc_string(_T("Local\\cpccLogTap.")) + name;
+	#else
+		// macOS allows 31 characters. A longer name keeps its start and a hash of the whole name,
+		// so that the names with a long common prefix do not collide.
+		const size_t maxLength = 18;
+		if (name.length() > maxLength)
+		{
+			uint32_t hash = 2166136261u;	// FNV-1a
+			for (const auto c : name)
+				hash = (hash ^ static_cast<uint32_t>(c)) * 16777619u;
+			name.resize(maxLength - 9);
+			name.push_back(_T('.'));
+			for (int shift = 28; shift >= 0; shift -= 4)
+				name.push_back(_T("0123456789abcdef")[(hash >> shift) & 0xF]);
+		}
+		return cpcc_string(_T("/cpccLogTap.")) + name;
+	#endif
+	}
+
+	#ifdef _WIN32
+
+	bool create(const cpcc_char *aTapName, const size_t aSize)
+	{
+		close();
+		m_name = getSharedName(aTapName);
+		m_hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(aSize) >> 32), static_cast<DWORD>(aSize & 0xFFFFFFFF), m_name.c_str());
+		if (!m_hMapping)
+			return false;
+		if (GetLastError() == ERROR_ALREADY_EXISTS)
+		{	// another instance of the application writes to this tap
+			CloseHandle(m_hMapping);
+			m_hMapping = NULL;
+			return false;
+		}
+		m_address = MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, aSize);
+		m_size = aSize;
+		m_isOwner = true;
+		return (m_address != NULL);
+	}
+
+	bool openForReading(const cpcc_char *aTapName)
+	{
+		close();
+		m_name = getSharedName(aTapName);
+		m_hMapping = OpenFileMapping(FILE_MAP_READ, FALSE, m_name.c_str());
+		if (!m_hMapping)
+			return false;
+		m_address = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		if (!m_address)
+			return false;
+		MEMORY_BASIC_INFORMATION info;
+		m_size = VirtualQuery(m_address, &info, sizeof(info)) ? info.RegionSize : 0;
+		return true;
+	}
+
+	void close(void)
+	{
+		if (m_address)
+			UnmapViewOfFile(m_address);
+		if (m_hMapping)
+			CloseHandle(m_hMapping);	// the mapping is deleted with its last handle
+		m_address = NULL;
+		m_hMapping = NULL;
+		m_size = 0;
+		m_isOwner = false;
+	}
+
+	#else
+
+	bool create(const cpcc_char *aTapName, const size_t aSize)
+	{
+		close();
+		m_name = getSharedName(aTapName);
+		if (producerIsRunning(m_name))
+			return false;	// another instance of the application writes to this tap
+		shm_unlink(m_name.c_str());	// a tap left by a closed or crashed run
+		const int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0)
+			return false;
+		m_isOwner = true;
+		if (ftruncate(fd, static_cast<off_t>(aSize)) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void *p = mmap(NULL, aSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		m_address = p;
+		m_size = aSize;
+		return true;
+	}
+
+	bool openForReading(const cpcc_char *aTapName)
+	{
+		close();
+		m_name = getSharedName(aTapName);
+		const int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		void *p = MAP_FAILED;
+		if ((fstat(fd, &info) == 0) && (info.st_size > 0))
+			p = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		m_address = p;
+		m_size = static_cast<size_t>(info.st_size);
+		return true;
+	}
+
+	/// true if the shared memory exists and its producer has not closed it and is still running
+	static bool producerIsRunning(const cpcc_string &aSharedName)
+	{
+		const int fd = shm_open(aSharedName.c_str(), O_RDONLY, 0);
+		if (fd < 0)
+			return false;
+		bool isRunning = false;
+		struct stat info;
+		if ((fstat(fd, &info) == 0) && (static_cast<size_t>(info.st_size) >= sizeof(cpccLogLiveTapHeader)))
+		{
+			void *p = mmap(NULL, sizeof(cpccLogLiveTapHeader), PROT_READ, MAP_SHARED, fd, 0);
+			if (p != MAP_FAILED)
+			{
+				const cpccLogLiveTapHeader *header = static_cast<const cpccLogLiveTapHeader *>(p);
+				const pid_t pid = static_cast<pid_t>(header->ownerPid);
+				isRunning = header->isValid() && (header->closed.load(std::memory_order_acquire) == 0) &&
+							(pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+				munmap(p, sizeof(cpccLogLiveTapHeader));
+			}
+		}
+		::close(fd);
+		return isRunning;
+	}
+
+	void close(void)
+	{
+		if (m_address)
+			munmap(m_address, m_size);
+		if (m_isOwner)
+			shm_unlink(m_name.c_str());	// readers that are attached keep their mapping
+		m_address = NULL;
+		m_size = 0;
+		m_isOwner = false;
+	}
+
+	#endif
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogLiveTap
+//
+//	The producer side, used by cpccLogFileWriterWithBuffer. See setLiveTap() there.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogLiveTap
+{
+private:
+	std::mutex				m_mutex;	// between the threads of the producer only. The readers do not lock.
+	cpccLogLiveTapMapping	m_mapping;
+	cpccLogLiveTapHeader	*m_header = NULL;
+	char					*m_data = NULL;
+	std::atomic<bool>		m_isOpen;
+
+public:
+	cpccLogLiveTap(): m_isOpen(false) { }
+	cpccLogLiveTap(const cpccLogLiveTap& x) = delete;
+	cpccLogLiveTap& operator=(const cpccLogLiveTap& x) = delete;
+	~cpccLogLiveTap() { close(); }
+
+	inline bool isOpen(void) const { return m_isOpen.load(std::memory_order_relaxed); }
+
+	bool open(const cpcc_char *aTapName, const size_t aCapacityBytes)
+	{
+		close();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!aTapName || (aCapacityBytes == 0) || !m_mapping.create(aTapName, sizeof(cpccLogLiveTapHeader) + aCapacityBytes))
+		{
+			m_mapping.close();
+			return false;
+		}
+
+		m_header = new (m_mapping.getAddress()) cpccLogLiveTapHeader;
+		m_data = static_cast<char *>(m_mapping.getAddress()) + sizeof(cpccLogLiveTapHeader);
+		m_header->version_ = cpccLogLiveTapHeader::version;
+	#ifdef _WIN32
+		m_header->ownerPid = static_cast<uint32_t>(GetCurrentProcessId());
+	#else
+		m_header->ownerPid = static_cast<uint32_t>(getpid());
+	#endif
+		m_header->capacity = aCapacityBytes;
+		m_header->sessionId = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()) ^ reinterpret_cast<uintptr_t>(this);
+		m_header->reservePos.store(0);
+		m_header->writePos.store(0);
+		m_header->closed.store(0);
+		// the magic last, so a reader never attaches to a half-initialized header
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(m_header->magic, cpccLogLiveTapHeader::getMagic(), sizeof(m_header->magic));
+		m_isOpen = true;
+		return true;
+	}
+
+	void close(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isOpen = false;
+		if (m_header)
+			m_header->closed.store(1, std::memory_order_release);
+		m_mapping.close();
+		m_header = NULL;
+		m_data = NULL;
+	}
+
+	void write(const cpcc_string &aText)
+	{
+	#ifdef UNICODE
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		const std::string bytes(converter.to_bytes(aText));
+	#else
+		const cpcc_string &bytes = aText;
+	#endif
+		write(bytes.data(), bytes.size());
+	}
+
+	void write(const char *aBytes, size_t aSize)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_header || !aBytes)
+			return;
+
+		const uint64_t capacity = m_header->capacity;
+		if (aSize > capacity)
+		{	// keep only the end of a line that does not fit in the ring
+			aBytes += aSize - capacity;
+			aSize = static_cast<size_t>(capacity);
+		}
+
+		const uint64_t writePos = m_header->writePos.load(std::memory_order_relaxed);
+		m_header->reservePos.store(writePos + aSize, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);	// the readers see the reservation before the overwritten bytes
+
+		const size_t pos = static_cast<size_t>(writePos % capacity);
+		const size_t firstPart = (aSize < capacity - pos) ? aSize : static_cast<size_t>(capacity - pos);
+		memcpy(m_data + pos, aBytes, firstPart);
+		memcpy(m_data, aBytes + firstPart, aSize - firstPart);
+		m_header->writePos.store(writePos + aSize, std::memory_order_release);
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogLiveTapReader
+//
+//	Follows a live tap from any process, without blocking the producer.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogLiveTapReader
+{
+private:
+	cpccLogLiveTapMapping		m_mapping;
+	const cpccLogLiveTapHeader	*m_header = NULL;
+	const char					*m_data = NULL;
+	uint64_t					m_readPos = 0,
+								m_sessionId = 0;
+	bool						m_atLineStart = true;
+
+public:
+	cpccLogLiveTapReader() { }
+	cpccLogLiveTapReader(const cpccLogLiveTapReader& x) = delete;
+	cpccLogLiveTapReader& operator=(const cpccLogLiveTapReader& x) = delete;
+
+	inline bool		isAttached(void) const { return (m_header != NULL); }
+	inline uint64_t	getSessionId(void) const { return m_sessionId; }
+
+	/// true if the producer has closed the tap. Attach again to follow its next run.
+	inline bool		isClosed(void) const { return !m_header || (m_header->closed.load(std::memory_order_acquire) != 0); }
+
+	/// attaches to the tap. The reading starts from the oldest text in the ring,
+	/// or from the end with fromTheEnd (only the new lines).
+	bool attach(const cpcc_char *aTapName, const bool fromTheEnd = false)
+	{
+		detach();
+		if (!m_mapping.openForReading(aTapName) || (m_mapping.getSize() < sizeof(cpccLogLiveTapHeader)))
+			return false;
+
+		m_header = static_cast<const cpccLogLiveTapHeader *>(m_mapping.getAddress());
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (!m_header->isValid() || (sizeof(cpccLogLiveTapHeader) + m_header->capacity > m_mapping.getSize()))
+		{
+			detach();
+			return false;
+		}
+		m_data = static_cast<const char *>(m_mapping.getAddress()) + sizeof(cpccLogLiveTapHeader);
+		m_sessionId = m_header->sessionId;
+		const uint64_t writePos = m_header->writePos.load(std::memory_order_acquire);
+		const bool wrapped = (writePos > m_header->capacity);
+		m_readPos = fromTheEnd ? writePos : (wrapped ? writePos - m_header->capacity : 0);
+		m_atLineStart = fromTheEnd || !wrapped;	// the oldest text of a full ring starts with a partial line
+		return true;
+	}
+
+	void detach(void)
+	{
+		m_mapping.close();
+		m_header = NULL;
+		m_data = NULL;
+		m_readPos = 0;
+	}
+
+	/// appends the text written since the previous call. aLostBytes counts the text that was overwritten
+	/// before it could be read; the partial line after such a gap is skipped.
+	/// Returns the number of bytes appended.
+	size_t read(std::string &aText, uint64_t *aLostBytes = NULL)
+	{
+		if (aLostBytes)
+			*aLostBytes = 0;
+		if (!m_header)
+			return 0;
+
+		const uint64_t capacity = m_header->capacity;
+		const uint64_t writePos = m_header->writePos.load(std::memory_order_acquire);
+		if (writePos <= m_readPos)
+			return 0;
+
+		uint64_t start = m_readPos;
+		if (writePos - start > capacity)
+			start = writePos - capacity;
+
+		std::string &chunk = buffer();
+		chunk.resize(static_cast<size_t>(writePos - start));
+		const size_t pos = static_cast<size_t>(start % capacity);
+		const size_t firstPart = (chunk.size() < capacity - pos) ? chunk.size() : static_cast<size_t>(capacity - pos);
+		memcpy(&chunk[0], m_data + pos, firstPart);
+		memcpy(&chunk[0] + firstPart, m_data, chunk.size() - firstPart);
+
+		// the producer may have overwritten the oldest bytes while they were copied
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t reservePos = m_header->reservePos.load(std::memory_order_relaxed);
+		size_t skip = 0;
+		if (reservePos - start > capacity)
+			skip = static_cast<size_t>((reservePos - capacity) - start);
+		if (skip > chunk.size())
+			skip = chunk.size();
+
+		const uint64_t lost = (start - m_readPos) + skip;
+		if ((lost > 0) || !m_atLineStart)
+		{	// continue from the next complete line
+			const size_t lineEnd = chunk.find('\n', skip);
+			skip = (lineEnd == std::string::npos) ? chunk.size() : lineEnd + 1;
+		}
+		if (aLostBytes)
+			*aLostBytes = lost;
+
+		m_readPos = writePos;
+		m_atLineStart = true;
+		aText.append(chunk, skip, std::string::npos);
+		return chunk.size() - skip;
+	}
+
+private:
+	static std::string &buffer(void)
+	{
+		static thread_local std::string _buffer;
+		return _buffer;
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogLiveTap testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogLiveTap_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpcc_string tapName(_T("cpccTapTest"));
+	tapName.append(cpcc_to_string(static_cast<long long>(std::chrono::steady_clock::now().time_since_epoch().count() % 1000000)));
+
+	// 64 bytes with lines of 10 bytes
+	cpccLogLiveTap tap;
+	TEST_EXPECT(tap.open(tapName.c_str(), 64), _T("#7271a: cpccLogLiveTap::open()"));
+
+	cpccLogLiveTapReader reader;
+	TEST_EXPECT(reader.attach(tapName.c_str()), _T("#7271b: cpccLogLiveTapReader::attach()"));
+	tap.write("line 0000\n", 10);
+	tap.write("line 0001\n", 10);
+	std::string text;
+	reader.read(text);
+	TEST_EXPECT(text.compare("line 0000\nline 0001\n") == 0, _T("#7271c: cpccLogLiveTapReader::read()"));
+
+	// the reader falls behind: the overwritten lines are lost and the reading continues from a complete line
+	char line[] = "line 0000\n";
+	for (int i = 2; i < 12; ++i)
+	{
+		line[7] = static_cast<char>('0' + i / 10);
+		line[8] = static_cast<char>('0' + i % 10);
+		tap.write(line, 10);
+	}
+	text.clear();
+	uint64_t lost = 0;
+	reader.read(text, &lost);
+	TEST_EXPECT((lost == 36) && (text.compare("line 0006\nline 0007\nline 0008\nline 0009\nline 0010\nline 0011\n") == 0), _T("#7271d: cpccLogLiveTapReader after an overrun"));
+
+	// a second producer with the same name must not take over the tap
+	cpccLogLiveTap secondTap;
+	TEST_EXPECT(!secondTap.open(tapName.c_str(), 64) && !reader.isClosed(), _T("#7271f: cpccLogLiveTap::open() took over a running tap"));
+
+	tap.close();
+	TEST_EXPECT(reader.isClosed(), _T("#7271e: cpccLogLiveTapReader::isClosed()"));
+
+	// long names with a common start get different shared names
+	const cpcc_string name1(cpccLogLiveTapMapping::getSharedName(_T("StarMessage Screensaver Preview"))),
+					  name2(cpccLogLiveTapMapping::getSharedName(_T("StarMessage Screensaver Settings")));
+	TEST_EXPECT(name1 != name2, _T("#7271g: cpccLogLiveTapMapping::getSharedName() of long names"));
+}
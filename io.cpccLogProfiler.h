@@ -0,0 +1,369 @@
+/*  *****************************************
+ *  File:		io.cpccLogProfiler.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				hierarchical scope profiler with chrome trace output
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <locale>
+#include <codecvt>
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccLogFormat.h"
+#include "io.cpccLogTimestamp.h"
+#include "cpccTesting.h"
+
+/*
+	Usage:
+		void drawFrame(void)
+		{
+			cpccPROFILE_SCOPE(_T("drawFrame"));
+			...
+		}
+
+	The macro is compiled only when cpccPROFILING is defined. Otherwise it expands to nothing.
+	Every scope records its begin/end time (see cpccLogTimestamp) in a buffer of the calling thread.
+	At exit (or with writeReports()) the profiler writes
+		- a Chrome trace-event JSON file: open it in chrome://tracing or https://ui.perfetto.dev
+		- a flat summary with the calls, total and self time of every scope.
+	The scope name must be a string literal (or live as long as the profiler): only its pointer is stored.
+*/
+
+#define cpccPROFILE_CONCAT2(a, b)	a##b
+#define cpccPROFILE_CONCAT(a, b)	cpccPROFILE_CONCAT2(a, b)
+
+#ifdef cpccPROFILING
+	#define cpccPROFILE_SCOPE(aName)	cpccProfiledScope cpccPROFILE_CONCAT(_cpccProfiledScope, __LINE__)(aName)
+#else
+	#define cpccPROFILE_SCOPE(aName)	((void)0)
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccProfiler
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccProfiler
+{
+public:
+	enum { maxEventsPerThread = 1000000 };	// for the trace file. The summary counts every call.
+
+	struct tEvent
+	{
+		const cpcc_char	*name;
+		int64_t			beginMicroseconds,
+						endMicroseconds;
+	};
+
+	struct tTotals
+	{
+		uint64_t		calls = 0;
+		int64_t			totalMicroseconds = 0,
+						selfMicroseconds = 0;
+	};
+
+private:
+	struct tThreadData
+	{
+		std::mutex		mutex;	// taken by the own thread, and by the reports. Practically never contended.
+		uint32_t		threadNo = 0;
+		std::vector<tEvent>	events;
+		std::unordered_map<const cpcc_char *, tTotals> totals;
+		std::vector<int64_t> childMicroseconds;	// the stack of the open scopes of the thread
+	};
+
+	std::mutex									m_registryMutex;
+	std::vector<std::shared_ptr<tThreadData>>	m_threads;
+	cpcc_string									m_traceFilename, m_summaryFilename;
+
+	cpccProfiler() { }
+	cpccProfiler(const cpccProfiler& x) = delete;
+	cpccProfiler& operator=(const cpccProfiler& x) = delete;
+
+	static void writeReportsAtExit(void) { getInstance().writeReports(); }
+
+	tThreadData &getThisThreadData(void)
+	{
+		static thread_local std::shared_ptr<tThreadData> _data;
+		if (!_data)
+		{
+			_data = std::make_shared<tThreadData>();
+			_data->events.reserve(4096);
+			std::lock_guard<std::mutex> lock(m_registryMutex);
+			_data->threadNo = static_cast<uint32_t>(m_threads.size() + 1);
+			m_threads.push_back(_data);
+		}
+		return *_data;
+	}
+
+public:
+
+	static cpccProfiler &getInstance(void)
+	{
+		static cpccProfiler* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccProfiler;
+		return *_instPtr;
+	}
+
+	/// the reports are written to these files at exit()
+	void setOutputFiles(const cpcc_char *aTraceFilename, const cpcc_char *aSummaryFilename)
+	{
+		std::lock_guard<std::mutex> lock(m_registryMutex);
+		m_traceFilename = aTraceFilename ? aTraceFilename : _T("");
+		m_summaryFilename = aSummaryFilename ? aSummaryFilename : _T("");
+
+		static bool _atExitRegistered = false;
+		if (!_atExitRegistered)
+			_atExitRegistered = (atexit(writeReportsAtExit) == 0);
+	}
+
+	void beginScope(void)
+	{
+		tThreadData &data = getThisThreadData();
+		std::lock_guard<std::mutex> lock(data.mutex);
+		data.childMicroseconds.push_back(0);
+	}
+
+	void endScope(const cpcc_char *aName, const int64_t aBeginMicroseconds, const int64_t aEndMicroseconds)
+	{
+		tThreadData &data = getThisThreadData();
+		std::lock_guard<std::mutex> lock(data.mutex);
+		const int64_t duration = aEndMicroseconds - aBeginMicroseconds;
+		int64_t childTime = 0;
+		if (!data.childMicroseconds.empty())
+		{
+			childTime = data.childMicroseconds.back();
+			data.childMicroseconds.pop_back();
+		}
+		if (!data.childMicroseconds.empty())
+			data.childMicroseconds.back() += duration;
+
+		tTotals &totals = data.totals[aName];
+		++totals.calls;
+		totals.totalMicroseconds += duration;
+		totals.selfMicroseconds += duration - childTime;
+
+		if (data.events.size() < maxEventsPerThread)
+			data.events.push_back({ aName, aBeginMicroseconds, aEndMicroseconds });
+	}
+
+	/// removes the totals and the trace events of a scope name, e.g. the ones that the self-test recorded
+	void removeScope(const cpcc_char *aName)
+	{
+		std::lock_guard<std::mutex> lock(m_registryMutex);
+		for (const auto &thread : m_threads)
+		{
+			std::lock_guard<std::mutex> threadLock(thread->mutex);
+			thread->totals.erase(aName);
+			thread->events.erase(std::remove_if(thread->events.begin(), thread->events.end(), [aName](const tEvent &e) { return e.name == aName; }),
+				thread->events.end());
+		}
+	}
+
+public: // reports
+
+	/// the totals of all threads, per scope name
+	std::map<cpcc_string, tTotals> getTotals(void)
+	{
+		std::map<cpcc_string, tTotals> result;
+		std::lock_guard<std::mutex> lock(m_registryMutex);
+		for (const auto &thread : m_threads)
+		{
+			std::lock_guard<std::mutex> threadLock(thread->mutex);
+			for (const auto &entry : thread->totals)
+			{
+				tTotals &totals = result[entry.first];
+				totals.calls += entry.second.calls;
+				totals.totalMicroseconds += entry.second.totalMicroseconds;
+				totals.selfMicroseconds += entry.second.selfMicroseconds;
+			}
+		}
+		return result;
+	}
+
+	/// a table with the scopes sorted by their self time
+	cpcc_string getSummary(void)
+	{
+		const std::map<cpcc_string, tTotals> totals(getTotals());
+		std::vector<std::pair<cpcc_string, tTotals>> rows(totals.begin(), totals.end());
+		std::sort(rows.begin(), rows.end(), [](const std::pair<cpcc_string, tTotals> &a, const std::pair<cpcc_string, tTotals> &b)
+			{ return a.second.selfMicroseconds > b.second.selfMicroseconds; });
+
+		cpcc_string result(_T("calls\ttotal ms\tself ms\tscope\n"));
+		for (const auto &row : rows)
+			cpccLogFormat::format(result, _T("{}\t{}\t{}\t{}\n"), row.second.calls,
+				row.second.totalMicroseconds / 1000.0, row.second.selfMicroseconds / 1000.0, row.first);
+		return result;
+	}
+
+	/// the events in the Chrome trace-event format (complete events, timestamps in microseconds)
+	cpcc_string getChromeTrace(void)
+	{
+		cpcc_string result(_T("{\"traceEvents\":[\n"));
+		bool first = true;
+		std::lock_guard<std::mutex> lock(m_registryMutex);
+		for (const auto &thread : m_threads)
+		{
+			std::lock_guard<std::mutex> threadLock(thread->mutex);
+			for (const auto &e : thread->events)
+			{
+				if (!first)
+					result.append(_T(",\n"));
+				first = false;
+				result.append(_T("{\"name\":\""));
+				appendJsonEscaped(result, e.name);
+				cpccLogFormat::format(result, _T("\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{},\"dur\":{}}"),
+					thread->threadNo, e.beginMicroseconds, e.endMicroseconds - e.beginMicroseconds);
+			}
+		}
+		result.append(_T("\n]}\n"));
+		return result;
+	}
+
+	void writeReports(void)
+	{
+		cpcc_string traceFilename, summaryFilename;
+		{
+			std::lock_guard<std::mutex> lock(m_registryMutex);
+			traceFilename = m_traceFilename;
+			summaryFilename = m_summaryFilename;
+		}
+		if (traceFilename.length() > 0)
+			writeUtf8File(traceFilename.c_str(), getChromeTrace());
+		if (summaryFilename.length() > 0)
+			writeUtf8File(summaryFilename.c_str(), getSummary());
+	}
+
+	static void appendJsonEscaped(cpcc_string &aBuffer, const cpcc_char *aText)
+	{
+		for (const cpcc_char *p = aText; p && *p; ++p)
+		{
+			if ((*p == _T('"')) || (*p == _T('\\')))
+				aBuffer.push_back(_T('\\'));
+			if ((*p >= 0) && (*p < 0x20))
+				aBuffer.push_back(_T(' '));
+			else
+				aBuffer.push_back(*p);
+		}
+	}
+
+private:
+
+	static bool writeUtf8File(const cpcc_char *aFilename, const cpcc_string &aText)
+	{
+		#pragma warning(suppress : 4996)
+		FILE *fp = cpcc_fopen(aFilename, _T("wb"));
+		if (!fp)
+			return false;
+	#ifdef UNICODE
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		const std::string utf8(converter.to_bytes(aText));
+	#else
+		const std::string &utf8 = aText;
+	#endif
+		const bool writtenOk = (fwrite(utf8.data(), 1, utf8.size(), fp) == utf8.size());
+		fclose(fp);
+		return writtenOk;
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccProfiledScope
+//
+//	The profiling variant of logBlockOfCode: it records the begin and end time of the scope,
+//  without writing any log lines. Use it via the cpccPROFILE_SCOPE() macro.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccProfiledScope
+{
+private:
+	const cpcc_char	*m_name;
+	int64_t			m_beginMicroseconds;
+
+public:
+	explicit cpccProfiledScope(const cpcc_char *aName) : m_name(aName ? aName : _T("null-name-at-cpccProfiledScope"))
+	{
+		cpccProfiler::getInstance().beginScope();
+		m_beginMicroseconds = cpccLogTimestamp::getInstance().getMicrosecondsSinceStart();
+	}
+
+	~cpccProfiledScope()
+	{
+		const int64_t endMicroseconds = cpccLogTimestamp::getInstance().getMicrosecondsSinceStart();
+		cpccProfiler::getInstance().endScope(m_name, m_beginMicroseconds, endMicroseconds);
+	}
+
+	cpccProfiledScope(const cpccProfiledScope& x) = delete;
+	cpccProfiledScope& operator=(const cpccProfiledScope& x) = delete;
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccProfiler testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccProfiler_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	static const cpcc_char *outerName = _T("cpccProfiler_test outer");
+	static const cpcc_char *innerName = _T("cpccProfiler_test inner");
+	cpccProfiler &profiler = cpccProfiler::getInstance();
+
+	// outer: 0..100, with two inner scopes of 30 and 20 microseconds
+	profiler.beginScope();
+	profiler.beginScope();
+	profiler.endScope(innerName, 10, 40);
+	profiler.beginScope();
+	profiler.endScope(innerName, 50, 70);
+	profiler.endScope(outerName, 0, 100);
+
+	std::map<cpcc_string, cpccProfiler::tTotals> totals(profiler.getTotals());
+	const cpccProfiler::tTotals &outer = totals[outerName];
+	const cpccProfiler::tTotals &inner = totals[innerName];
+	TEST_EXPECT((outer.calls == 1) && (outer.totalMicroseconds == 100) && (outer.selfMicroseconds == 50), _T("#7266a: cpccProfiler outer scope totals"));
+	TEST_EXPECT((inner.calls == 2) && (inner.totalMicroseconds == 50) && (inner.selfMicroseconds == 50), _T("#7266b: cpccProfiler inner scope totals"));
+
+	const cpcc_string trace(profiler.getChromeTrace());
+	TEST_EXPECT(trace.find(_T("{\"name\":\"cpccProfiler_test outer\",\"ph\":\"X\",\"pid\":1,\"tid\":")) != cpcc_string::npos, _T("#7266c: cpccProfiler chrome trace event"));
+
+	// the profiler is the one of the application, so the test scopes must not reach its reports
+	profiler.removeScope(outerName);
+	profiler.removeScope(innerName);
+	totals = profiler.getTotals();
+	TEST_EXPECT((totals.count(outerName) == 0) && (totals.count(innerName) == 0) && (profiler.getChromeTrace().find(_T("cpccProfiler_test")) == cpcc_string::npos),
+		_T("#7266d: cpccProfiler::removeScope()"));
+}
@@ -0,0 +1,254 @@
+/*  *****************************************
+ *  File:		io.cpccLogRateLimit.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				rate limiting of log lines per call site
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccLogTimestamp.h"
+#include "cpccTesting.h"
+
+/*
+	Usage, e.g. inside a frame loop:
+		cpccLOGF_LIMITED(warningLog(), 5, 10, _T("frame {} could not be drawn"), frameNo);
+		cpccLOG_ADDF_LIMITED(warningLog(), 5, 10, _T("frame %d could not be drawn"), frameNo);
+
+	Every call site writes at most 5 lines per 10 seconds. The next occurrence after the 10 seconds
+	first writes a summary line, e.g. "repeated 595 times in 10.0003 s: frame {} could not be drawn".
+	A suppressed call costs a clock read and one atomic increment; its arguments are not formatted.
+	A call site that suppressed lines is registered in cpccLogRateLimiters, so that cpccLogManager::flush()
+	and the end of the log write the summaries of the sites that did not fire again.
+*/
+
+#define cpccLOG_LIMITED_STATEMENT(aLogFormatter, aMaxLines, aPeriodSeconds, aFormat, aStatement)	\
+	do { static cpccLogRateLimiter _cpccLogRateLimiter((aMaxLines), (aPeriodSeconds));			\
+		 if (_cpccLogRateLimiter.allow((aLogFormatter), (aFormat))) { aStatement; } } while (0)
+
+#define cpccLOGF_LIMITED(aLogFormatter, aMaxLines, aPeriodSeconds, aFormat, ...)	\
+	cpccLOG_LIMITED_STATEMENT(aLogFormatter, aMaxLines, aPeriodSeconds, aFormat, (aLogFormatter).fmt(aFormat, ##__VA_ARGS__))
+
+#define cpccLOG_ADDF_LIMITED(aLogFormatter, aMaxLines, aPeriodSeconds, aFormat, ...)	\
+	cpccLOG_LIMITED_STATEMENT(aLogFormatter, aMaxLines, aPeriodSeconds, aFormat, (aLogFormatter).addf(aFormat, ##__VA_ARGS__))
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogRateLimiter
+//
+//	The state of one call site (a static object created by the macros above).
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogRateLimiter
+{
+private:
+	const uint32_t			m_maxLines;
+	const int64_t			m_periodMicroseconds;
+	std::atomic<int64_t>	m_periodStart;
+	std::atomic<uint32_t>	m_lines, m_suppressed;
+
+	// where flushSummary() writes. Set once, before the first suppressed line registers the limiter.
+	std::atomic<bool>		m_registered;
+	void					*m_log = NULL;
+	const cpcc_char			*m_format = NULL;
+	void					(*m_writeSummary)(void *aLog, const uint32_t aSuppressed, const double aSeconds, const cpcc_char *aFormat) = NULL;
+
+	template <typename tLogFormatter>
+	static void writeSummary(void *aLog, const uint32_t aSuppressed, const double aSeconds, const cpcc_char *aFormat)
+	{
+		static_cast<tLogFormatter *>(aLog)->fmt(_T("repeated {} times in {} s: {}"), aSuppressed, aSeconds, aFormat ? aFormat : _T(""));
+	}
+
+	template <typename tLogFormatter>
+	void registerForFlush(tLogFormatter &aLog, const cpcc_char *aFormat);
+
+public:
+	cpccLogRateLimiter(const uint32_t aMaxLines, const double aPeriodSeconds) :
+		m_maxLines(aMaxLines),
+		m_periodMicroseconds(static_cast<int64_t>(aPeriodSeconds * 1000000)),
+		m_periodStart(0), m_lines(0), m_suppressed(0), m_registered(false)
+	{ }
+
+	~cpccLogRateLimiter();
+
+	cpccLogRateLimiter(const cpccLogRateLimiter& x) = delete;
+	cpccLogRateLimiter& operator=(const cpccLogRateLimiter& x) = delete;
+
+	template <typename tLogFormatter>
+	inline bool allow(tLogFormatter &aLog, const cpcc_char *aFormat)
+	{
+		return allowAt(cpccLogTimestamp::getInstance().getMicrosecondsSinceStart(), aLog, aFormat);
+	}
+
+	/// true if the call site can write its line now. When a new period starts,
+	/// the thread that starts it writes the summary of the lines suppressed in the previous period.
+	template <typename tLogFormatter>
+	bool allowAt(const int64_t aNowMicroseconds, tLogFormatter &aLog, const cpcc_char *aFormat)
+	{
+		int64_t periodStart = m_periodStart.load(std::memory_order_relaxed);
+		if ((aNowMicroseconds - periodStart >= m_periodMicroseconds) &&
+			m_periodStart.compare_exchange_strong(periodStart, aNowMicroseconds))
+		{
+			m_lines.store(0, std::memory_order_relaxed);
+			const uint32_t suppressed = m_suppressed.exchange(0);
+			if (suppressed > 0)
+				writeSummary<tLogFormatter>(&aLog, suppressed, (aNowMicroseconds - periodStart) / 1000000.0, aFormat);
+		}
+
+		// a plain load first, so that a suppressed call does only one atomic increment
+		if ((m_lines.load(std::memory_order_relaxed) < m_maxLines) && (m_lines.fetch_add(1, std::memory_order_relaxed) < m_maxLines))
+			return true;
+		m_suppressed.fetch_add(1, std::memory_order_relaxed);
+		if (!m_registered.load(std::memory_order_relaxed))
+			registerForFlush(aLog, aFormat);
+		return false;
+	}
+
+	/// writes the summary of the lines suppressed so far in the current period, if any
+	void flushSummary(const int64_t aNowMicroseconds)
+	{
+		const uint32_t suppressed = m_suppressed.exchange(0);
+		if ((suppressed > 0) && m_writeSummary)
+			m_writeSummary(m_log, suppressed, (aNowMicroseconds - m_periodStart.load(std::memory_order_relaxed)) / 1000000.0, m_format);
+	}
+
+	inline uint32_t getSuppressed(void) const { return m_suppressed.load(std::memory_order_relaxed); }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogRateLimiters
+//
+//	The call sites that have suppressed lines. flushSummaries() is called by cpccLogManager::flush()
+//  and before the closing stamp of the log, so that the last suppressed lines are not lost.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogRateLimiters
+{
+	friend class cpccLogRateLimiter;
+
+private:
+	std::mutex							m_mutex;
+	std::vector<cpccLogRateLimiter *>	m_limiters;
+
+	cpccLogRateLimiters() { }
+	cpccLogRateLimiters(const cpccLogRateLimiters& x) = delete;
+	cpccLogRateLimiters& operator=(const cpccLogRateLimiters& x) = delete;
+
+	void add(cpccLogRateLimiter *aLimiter)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_limiters.push_back(aLimiter);
+	}
+
+	void remove(cpccLogRateLimiter *aLimiter)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_limiters.erase(std::remove(m_limiters.begin(), m_limiters.end(), aLimiter), m_limiters.end());
+	}
+
+public:
+	static cpccLogRateLimiters &getInstance(void)
+	{
+		static cpccLogRateLimiters* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccLogRateLimiters;
+		return *_instPtr;
+	}
+
+	void flushSummaries(void)
+	{
+		const int64_t now = cpccLogTimestamp::getInstance().getMicrosecondsSinceStart();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (cpccLogRateLimiter *limiter : m_limiters)
+			limiter->flushSummary(now);
+	}
+};
+
+
+template <typename tLogFormatter>
+inline void cpccLogRateLimiter::registerForFlush(tLogFormatter &aLog, const cpcc_char *aFormat)
+{
+	if (m_registered.exchange(true))
+		return;		// another thread registered it
+	m_log = &aLog;
+	m_format = aFormat;
+	m_writeSummary = &writeSummary<tLogFormatter>;
+	cpccLogRateLimiters::getInstance().add(this);	// its lock publishes the fields above to flushSummaries()
+}
+
+
+inline cpccLogRateLimiter::~cpccLogRateLimiter()
+{
+	if (m_registered)
+		cpccLogRateLimiters::getInstance().remove(this);
+}
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogRateLimiter testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+// collects the summary lines of the test, instead of a cpccLogFormatter
+struct cpccLogRateLimiterTestLog
+{
+	cpcc_string lastLine;
+	int			nLines = 0;
+
+	template <typename... tArgs>
+	void fmt(const cpcc_char *aFormat, const tArgs&... args) { lastLine.clear(); cpccLogFormat::format(lastLine, aFormat, args...); ++nLines; }
+};
+
+
+TEST_RUN(cpccLogRateLimiter_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpccLogRateLimiterTestLog fakeLog;
+
+	// 3 lines per second
+	cpccLogRateLimiter limiter(3, 1.0);
+	int allowed = 0;
+	for (int i = 0; i < 60; ++i)
+		if (limiter.allowAt(10000000 + i * 10000, fakeLog, _T("frame failed")))
+			++allowed;
+	TEST_EXPECT((allowed == 3) && (limiter.getSuppressed() == 57) && (fakeLog.nLines == 0), _T("#7268a: cpccLogRateLimiter within the period"));
+
+	// the first call of the next period writes the summary and is allowed
+	TEST_EXPECT(limiter.allowAt(11000000, fakeLog, _T("frame failed")), _T("#7268b: cpccLogRateLimiter next period"));
+	TEST_EXPECT((fakeLog.nLines == 1) && (fakeLog.lastLine.compare(_T("repeated 57 times in 1 s: frame failed")) == 0), _T("#7268c: cpccLogRateLimiter summary line"));
+
+	// lines suppressed in the last period are written by the flush, even if the call site does not fire again
+	for (int i = 1; i < 10; ++i)
+		limiter.allowAt(11000000 + i * 10000, fakeLog, _T("frame failed"));
+	limiter.flushSummary(11500000);
+	TEST_EXPECT((fakeLog.nLines == 2) && (fakeLog.lastLine.compare(_T("repeated 7 times in 0.5 s: frame failed")) == 0), _T("#7268d: cpccLogRateLimiter::flushSummary()"));
+	limiter.flushSummary(11600000);
+	TEST_EXPECT(fakeLog.nLines == 2, _T("#7268e: cpccLogRateLimiter::flushSummary() twice"));
+}
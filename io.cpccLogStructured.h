@@ -0,0 +1,444 @@
+/*  *****************************************
+ *  File:		io.cpccLogStructured.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				structured log records with key-value fields (JSON Lines or logfmt)
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <locale>
+#include <codecvt>
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccLogFormat.h"
+#include "io.cpccLogFilter.h"
+#include "cpccTesting.h"
+
+/*
+	Usage:
+		cpccLOG_KV(infoLog(), _T("download finished"), _T("bytes,file,seconds"), nBytes, filename, seconds);
+
+	The message and the keys are serialized once per call site (a static cpccLogRecordSite).
+	Every call only appends the values, with the integer and float converters of cpccLogFormat.
+
+	The text log gets the line:
+		Info>	12.000345	T1	download finished bytes=1024 file="my file.txt" seconds=0.25
+	and, depending on cpccLogManager::setStructuredOutput(), also (alongside) or only (instead) the record
+		{"ts_us":1600000012000345,"level":"info","thread":1,"msg":"download finished","bytes":1024,"file":"my file.txt","seconds":0.25}
+	or in logfmt
+		ts_us=1600000012000345 level=info thread=1 msg="download finished" bytes=1024 file="my file.txt" seconds=0.25
+
+	ts_us is microseconds since 1970 (UTC). The "scope" field is the scope path of cpccLogContext, when not empty.
+*/
+
+#define cpccLOG_KV(aLogFormatter, aMessage, aKeys, ...)	\
+	do { static const cpccLogRecordSite _cpccLogRecordSite(aMessage, aKeys); auto &_cpccLog = (aLogFormatter);	\
+		 if (_cpccLog.isEnabled()) _cpccLog.record(_cpccLogRecordSite, ##__VA_ARGS__); } while (0)
+
+
+enum class cpccLogRecordFormat { jsonLines = 0, logfmt };
+
+// textOnly:	the fields are appended to the text line (default)
+// alongside:	the text line and the record in a .jsonl or .logfmt file next to the text log
+// instead:		the record replaces the text line in the text log
+enum class cpccLogRecordOutput { textOnly = 0, alongside, instead };
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogRecordSite
+//
+//	A static object per call site (created by the cpccLOG_KV macro) with the message and the keys
+//  already serialized for the text line, JSON and logfmt.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogRecordSite
+{
+	friend class cpccLogRecordEncoder;
+
+private:
+	cpcc_string					m_message,			// download finished
+								m_jsonMessage,		// ,"msg":"download finished"
+								m_logfmtMessage;	// msg="download finished"
+	std::vector<cpcc_string>	m_jsonKeys,			// ,"bytes":
+								m_logfmtKeys;		// ' bytes='
+
+public:
+	/// aKeys is a comma separated list, e.g. _T("bytes,file")
+	cpccLogRecordSite(const cpcc_char *aMessage, const cpcc_char *aKeys);
+
+	cpccLogRecordSite(const cpccLogRecordSite& x) = delete;
+	cpccLogRecordSite& operator=(const cpccLogRecordSite& x) = delete;
+
+	inline size_t getKeyCount(void) const { return m_jsonKeys.size(); }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogRecordEncoder
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogRecordEncoder
+{
+public:
+
+	/// a buffer per thread for the records. cpccLogFormat::threadBuffer() holds the text line at the same time.
+	static cpcc_string &threadBuffer(void)
+	{
+		static thread_local cpcc_string _buffer;
+		if (_buffer.capacity() < cpccLogFormat::initialBufferCapacity)
+			_buffer.reserve(cpccLogFormat::initialBufferCapacity);
+		return _buffer;
+	}
+
+	/// the message and the fields in logfmt, for the text log line
+	template <typename... tArgs>
+	static void appendTextLine(cpcc_string &aBuffer, const cpccLogRecordSite &aSite, const tArgs&... aArgs)
+	{
+		aBuffer.append(aSite.m_message);
+		appendFields(aBuffer, false, aSite, 0, aArgs...);
+	}
+
+	template <typename... tArgs>
+	static void appendRecord(cpcc_string &aBuffer, const cpccLogRecordFormat aFormat, const cpccLogRecordSite &aSite,
+		const cpccLogLevel aLevel, const int64_t aEpochMicroseconds, const uint32_t aThreadNo, const cpcc_string &aScopePath, const tArgs&... aArgs)
+	{
+		const bool json = (aFormat == cpccLogRecordFormat::jsonLines);
+		aBuffer.append(json ? _T("{\"ts_us\":") : _T("ts_us="));
+		cpccLogFormat::appendValue(aBuffer, static_cast<long long>(aEpochMicroseconds));
+		aBuffer.append(json ? _T(",\"level\":\"") : _T(" level="));
+		aBuffer.append(cpccLogFilter::getLevelName(aLevel));
+		aBuffer.append(json ? _T("\",\"thread\":") : _T(" thread="));
+		cpccLogFormat::appendValue(aBuffer, aThreadNo);
+		if (!aScopePath.empty())
+		{
+			aBuffer.append(json ? _T(",\"scope\":") : _T(" scope="));
+			if (json)
+				appendJson(aBuffer, aScopePath);
+			else
+				appendLogfmt(aBuffer, aScopePath);
+		}
+		aBuffer.append(json ? aSite.m_jsonMessage : aSite.m_logfmtMessage);
+		appendFields(aBuffer, json, aSite, 0, aArgs...);
+		if (json)
+			aBuffer.push_back(_T('}'));
+	}
+
+public: // JSON values
+
+	static void appendJson(cpcc_string &aBuffer, const cpcc_char *aValue)
+	{
+		if (!aValue)
+		{
+			aBuffer.append(_T("null"));
+			return;
+		}
+		aBuffer.push_back(_T('"'));
+		appendEscaped(aBuffer, aValue);
+		aBuffer.push_back(_T('"'));
+	}
+
+	static void appendJson(cpcc_string &aBuffer, cpcc_char *aValue) { appendJson(aBuffer, (const cpcc_char *) aValue); }
+	static void appendJson(cpcc_string &aBuffer, const cpcc_string &aValue) { appendJson(aBuffer, aValue.c_str()); }
+	static void appendJson(cpcc_string &aBuffer, const bool aValue) { cpccLogFormat::appendValue(aBuffer, aValue); }
+	static void appendJson(cpcc_string &aBuffer, const cpcc_char aValue) { const cpcc_char text[2] = { aValue, 0 }; appendJson(aBuffer, text); }
+
+	template <size_t N>
+	static void appendJson(cpcc_string &aBuffer, const cpcc_char (&aValue)[N]) { appendJson(aBuffer, (const cpcc_char *)aValue); }
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, cpcc_char>::value>::type
+		appendJson(cpcc_string &aBuffer, const T aValue) { cpccLogFormat::appendValue(aBuffer, aValue); }
+
+	// JSON has no inf and nan
+	template <typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+		appendJson(cpcc_string &aBuffer, const T aValue)
+	{
+		if (std::isfinite(aValue))
+			cpccLogFormat::appendValue(aBuffer, aValue);
+		else
+			aBuffer.append(_T("null"));
+	}
+
+	template <typename T>
+	static void appendJson(cpcc_string &aBuffer, const T *aPointer)
+	{
+		aBuffer.push_back(_T('"'));
+		cpccLogFormat::appendValue(aBuffer, aPointer);
+		aBuffer.push_back(_T('"'));
+	}
+
+public: // logfmt values
+
+	/// quoted only when it is empty or has spaces, '=', quotes or control characters
+	static void appendLogfmt(cpcc_string &aBuffer, const cpcc_char *aValue)
+	{
+		if (!aValue)
+		{
+			aBuffer.append(_T("null"));
+			return;
+		}
+		bool needsQuotes = (*aValue == 0);
+		for (const cpcc_char *p = aValue; *p && !needsQuotes; ++p)
+			needsQuotes = (*p == _T(' ')) || (*p == _T('=')) || needsEscape(*p);
+		if (!needsQuotes)
+		{
+			aBuffer.append(aValue);
+			return;
+		}
+		aBuffer.push_back(_T('"'));
+		appendEscaped(aBuffer, aValue);	// the same escapes as JSON
+		aBuffer.push_back(_T('"'));
+	}
+
+	static void appendLogfmt(cpcc_string &aBuffer, cpcc_char *aValue) { appendLogfmt(aBuffer, (const cpcc_char *) aValue); }
+	static void appendLogfmt(cpcc_string &aBuffer, const cpcc_string &aValue) { appendLogfmt(aBuffer, aValue.c_str()); }
+	static void appendLogfmt(cpcc_string &aBuffer, const cpcc_char aValue) { const cpcc_char text[2] = { aValue, 0 }; appendLogfmt(aBuffer, text); }
+
+	template <size_t N>
+	static void appendLogfmt(cpcc_string &aBuffer, const cpcc_char (&aValue)[N]) { appendLogfmt(aBuffer, (const cpcc_char *)aValue); }
+
+	// numbers, bool and pointers are written as in the text log
+	template <typename T>
+	static typename std::enable_if<!std::is_same<T, cpcc_char>::value>::type
+		appendLogfmt(cpcc_string &aBuffer, const T &aValue) { cpccLogFormat::appendValue(aBuffer, aValue); }
+
+private:
+
+	static inline bool isControl(const cpcc_char c)
+	{
+		return static_cast<typename std::make_unsigned<cpcc_char>::type>(c) < 0x20;
+	}
+
+	static inline bool needsEscape(const cpcc_char c) { return (c == _T('"')) || (c == _T('\\')) || isControl(c); }
+
+	// the text between the escaped characters is appended in one piece
+	static void appendEscaped(cpcc_string &aBuffer, const cpcc_char *aText)
+	{
+		const cpcc_char *runStart = aText, *p = aText;
+		for (; *p; ++p)
+			if (needsEscape(*p))
+			{
+				aBuffer.append(runStart, p);
+				appendEscapedChar(aBuffer, *p);
+				runStart = p + 1;
+			}
+		aBuffer.append(runStart, p);
+	}
+
+	static void appendEscapedChar(cpcc_string &aBuffer, const cpcc_char c)
+	{
+		switch (c)
+		{
+			case _T('"'):	aBuffer.append(_T("\\\"")); return;
+			case _T('\\'):	aBuffer.append(_T("\\\\")); return;
+			case _T('\n'):	aBuffer.append(_T("\\n")); return;
+			case _T('\r'):	aBuffer.append(_T("\\r")); return;
+			case _T('\t'):	aBuffer.append(_T("\\t")); return;
+			default: break;
+		}
+		aBuffer.append(_T("\\u00"));
+		aBuffer.push_back(_T("0123456789abcdef")[(c >> 4) & 0xF]);
+		aBuffer.push_back(_T("0123456789abcdef")[c & 0xF]);
+	}
+
+	static void appendFields(cpcc_string &, const bool, const cpccLogRecordSite &, const size_t) { }
+
+	// more arguments than keys: the extra ones are ignored, as in cpccLogFormat::format()
+	template <typename tArg, typename... tArgs>
+	static void appendFields(cpcc_string &aBuffer, const bool aJson, const cpccLogRecordSite &aSite, const size_t aIndex, const tArg &aArg, const tArgs&... aArgs)
+	{
+		if (aIndex >= aSite.getKeyCount())
+			return;
+		if (aJson)
+		{
+			aBuffer.append(aSite.m_jsonKeys[aIndex]);
+			appendJson(aBuffer, aArg);
+		}
+		else
+		{
+			aBuffer.append(aSite.m_logfmtKeys[aIndex]);
+			appendLogfmt(aBuffer, aArg);
+		}
+		appendFields(aBuffer, aJson, aSite, aIndex + 1, aArgs...);
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogRecordWriter
+//
+//	Where the records go (see cpccLogRecordOutput) and the file of the alongside output.
+//  The text is written as UTF-8 bytes, as the text log.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogRecordWriter
+{
+private:
+	FILE					*m_fp = NULL;
+	std::mutex				m_mutex;
+	std::atomic<int>		m_output, m_format;
+
+	cpccLogRecordWriter(): m_output(static_cast<int>(cpccLogRecordOutput::textOnly)), m_format(static_cast<int>(cpccLogRecordFormat::jsonLines)) { }
+	cpccLogRecordWriter(const cpccLogRecordWriter& x) = delete;
+	cpccLogRecordWriter& operator=(const cpccLogRecordWriter& x) = delete;
+
+public:
+	~cpccLogRecordWriter() { close(); }
+
+	static cpccLogRecordWriter &getInstance(void)
+	{
+		static cpccLogRecordWriter* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccLogRecordWriter;
+		return *_instPtr;
+	}
+
+	inline cpccLogRecordOutput	getOutput(void) const { return static_cast<cpccLogRecordOutput>(m_output.load(std::memory_order_relaxed)); }
+	inline cpccLogRecordFormat	getFormat(void) const { return static_cast<cpccLogRecordFormat>(m_format.load(std::memory_order_relaxed)); }
+
+	void configure(const cpccLogRecordOutput aOutput, const cpccLogRecordFormat aFormat)
+	{
+		m_format = static_cast<int>(aFormat);
+		m_output = static_cast<int>(aOutput);
+	}
+
+	/// creates (or empties) the file of the alongside output
+	bool open(const cpcc_char *aFilename)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_fp)
+			fclose(m_fp);
+		#pragma warning(suppress : 4996)
+		m_fp = aFilename ? cpcc_fopen(aFilename, _T("wb")) : NULL;
+		if (!m_fp)
+			return false;
+		setvbuf(m_fp, NULL, _IOFBF, 64 * 1024);
+		return true;
+	}
+
+	void close(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_fp)
+			fclose(m_fp);
+		m_fp = NULL;
+	}
+
+	void flush(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_fp)
+			fflush(m_fp);
+	}
+
+	/// writes one record and a new line
+	void write(const cpcc_string &aRecord)
+	{
+	#ifdef UNICODE
+		std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+		const std::string bytes(converter.to_bytes(aRecord));
+	#else
+		const cpcc_string &bytes = aRecord;
+	#endif
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_fp)
+			return;
+		fwrite(bytes.data(), 1, bytes.size(), m_fp);
+		fputc('\n', m_fp);
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogRecordSite implementation
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+inline cpccLogRecordSite::cpccLogRecordSite(const cpcc_char *aMessage, const cpcc_char *aKeys) :
+	m_message(aMessage ? aMessage : _T(""))
+{
+	m_jsonMessage.append(_T(",\"msg\":"));
+	cpccLogRecordEncoder::appendJson(m_jsonMessage, m_message);
+	m_logfmtMessage.append(_T(" msg="));
+	cpccLogRecordEncoder::appendLogfmt(m_logfmtMessage, m_message);
+
+	const cpcc_string keys(aKeys ? aKeys : _T(""));
+	size_t start = 0;
+	while (start < keys.length())
+	{
+		size_t end = keys.find(_T(','), start);
+		if (end == cpcc_string::npos)
+			end = keys.length();
+		cpcc_string key(keys.substr(start, end - start));
+		start = end + 1;
+
+		key.erase(0, key.find_first_not_of(_T(" \t")));
+		key.erase(key.find_last_not_of(_T(" \t")) + 1);
+		if (key.empty())
+			key = _T("_");
+
+		m_jsonKeys.push_back(_T(","));
+		cpccLogRecordEncoder::appendJson(m_jsonKeys.back(), key);
+		m_jsonKeys.back().push_back(_T(':'));
+		m_logfmtKeys.push_back(_T(" ") + key + _T("="));
+	}
+}
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogRecordEncoder testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogRecordEncoder_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	const cpccLogRecordSite site(_T("download finished"), _T("bytes, file,ok,ratio"));
+	const cpcc_string file(_T("my \"file\".txt"));
+
+	cpcc_string text;
+	cpccLogRecordEncoder::appendTextLine(text, site, 1024, file, true, 0.5);
+	TEST_EXPECT(text.compare(_T("download finished bytes=1024 file=\"my \\\"file\\\".txt\" ok=true ratio=0.5")) == 0, _T("#7270a: cpccLogRecordEncoder text line"));
+
+	cpcc_string json;
+	cpccLogRecordEncoder::appendRecord(json, cpccLogRecordFormat::jsonLines, site, cpccLogLevel::warning, 1600000000000001LL, 2, _T("main"), -5, file, false, std::numeric_limits<double>::infinity());
+	TEST_EXPECT(json.compare(_T("{\"ts_us\":1600000000000001,\"level\":\"warning\",\"thread\":2,\"scope\":\"main\",\"msg\":\"download finished\",")
+		_T("\"bytes\":-5,\"file\":\"my \\\"file\\\".txt\",\"ok\":false,\"ratio\":null}")) == 0, _T("#7270b: cpccLogRecordEncoder JSON"));
+
+	cpcc_string logfmt;
+	cpccLogRecordEncoder::appendRecord(logfmt, cpccLogRecordFormat::logfmt, site, cpccLogLevel::info, 7, 1, cpcc_string(), _T("line1\nline2"));
+	TEST_EXPECT(logfmt.compare(_T("ts_us=7 level=info thread=1 msg=\"download finished\" bytes=\"line1\\nline2\"")) == 0, _T("#7270c: cpccLogRecordEncoder logfmt"));
+}
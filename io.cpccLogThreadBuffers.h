@@ -0,0 +1,157 @@
+/*  *****************************************
+ *  File:		io.cpccLogThreadBuffers.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				per-thread staging buffers for the log writer
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "cpccUnicodeSupport.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogThreadRing
+//
+//	Single producer / single consumer ring of formatted log records.
+//  The producer is the thread that owns the ring. The consumer is whoever holds the
+//  file lock of the log writer (the writer thread or a caller of flush()).
+//  The slots are strings that keep their capacity, so after the first few
+//  records neither side allocates memory.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogThreadRing
+{
+public:
+	enum { capacity = 1024 };	// must be a power of 2
+
+private:
+	std::vector<cpcc_string>	m_slots;
+	std::atomic<size_t>			m_head,	// next slot to write. Changed only by the producer.
+								m_tail;	// next slot to read. Changed only by the consumer.
+
+public:
+	std::atomic<bool>			m_threadHasExited;
+
+public:
+	cpccLogThreadRing(): m_slots(capacity), m_head(0), m_tail(0), m_threadHasExited(false) { }
+	cpccLogThreadRing(const cpccLogThreadRing& x) = delete;
+	cpccLogThreadRing& operator=(const cpccLogThreadRing& x) = delete;
+
+	size_t size(void) const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+	bool isEmpty(void) const { return size() == 0; }
+
+	// producer side. Returns false if the ring is full.
+	bool push(const cpcc_char *txt)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= capacity)
+			return false;
+
+		m_slots[head & (capacity - 1)].assign(txt);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer side. Calls aFunc(const cpcc_string &) for every record, in the order they were pushed.
+	template <typename tFunc>
+	size_t drain(tFunc aFunc)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		const size_t head = m_head.load(std::memory_order_acquire);
+		const size_t n = head - tail;
+		for (; tail != head; ++tail)
+			aFunc(m_slots[tail & (capacity - 1)]);
+		m_tail.store(tail, std::memory_order_release);
+		return n;
+	}
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogThreadRings
+//
+//	Keeps the rings of all the threads that have logged something.
+//  The mutex is taken only once per thread (when its ring is registered) and by the consumer.
+//  A ring stays registered after its thread exits, until the consumer has emptied it.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogThreadRings
+{
+private:
+	std::vector<std::shared_ptr<cpccLogThreadRing>>	m_rings;
+	std::mutex	m_mutex;
+
+	struct tThreadRingHolder
+	{
+		std::shared_ptr<cpccLogThreadRing> ring;
+		~tThreadRingHolder();
+	};
+
+	static bool &threadIsExiting(void)
+	{
+		// trivially destructible, so it can still be read while the thread_local objects are being destroyed
+		static thread_local bool _exiting = false;
+		return _exiting;
+	}
+
+public:
+
+	/// returns the ring of the calling thread, or NULL if the thread is shutting down
+	cpccLogThreadRing *getThisThreadRing(void)
+	{
+		if (threadIsExiting())
+			return NULL;
+
+		static thread_local tThreadRingHolder _holder;
+		if (!_holder.ring)
+		{
+			_holder.ring = std::make_shared<cpccLogThreadRing>();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_rings.push_back(_holder.ring);
+		}
+		return _holder.ring.get();
+	}
+
+	/// consumer side: empties all the rings. Only one consumer at a time is allowed.
+	template <typename tFunc>
+	size_t drainAll(tFunc aFunc)
+	{
+		size_t n = 0;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < m_rings.size(); )
+		{
+			// read the flag before draining, so that a record pushed just before the thread exited is not lost
+			const bool threadHasExited = m_rings[i]->m_threadHasExited;
+			n += m_rings[i]->drain(aFunc);
+			if (threadHasExited)
+				m_rings.erase(m_rings.begin() + i);
+			else
+				++i;
+		}
+		return n;
+	}
+};
+
+
+inline cpccLogThreadRings::tThreadRingHolder::~tThreadRingHolder()
+{
+	threadIsExiting() = true;
+	if (ring)
+		ring->m_threadHasExited = true;
+}
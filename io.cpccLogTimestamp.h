@@ -0,0 +1,191 @@
+/*  *****************************************
+ *  File:		io.cpccLogTimestamp.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				timestamps for the log lines
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <cstdint>
+
+#include "cpccUnicodeSupport.h"
+#include "io.cpccLogFormat.h"
+#include "cpccTesting.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccLogTimestamp
+//
+//	Every log line gets the microseconds since the log started, read from the steady clock.
+//  The hot path only predicts the current second from the steady clock and an epoch base,
+//  so it does not call time() or localtime().
+//  When a new second starts, exactly one thread (the one that wins the compare-exchange)
+//  reads the second from the system clock, resyncs the epoch base, and renders the
+//  date/time prefix with localtime_r() + strftime().
+//  So the date/time lines follow the system clock after a sleep or an NTP correction,
+//  while the offsets since the start stay monotonic.
+//  The steady clock does not advance during a sleep, so after waking up the date/time line
+//  can stay behind the system clock for up to one second of running time.
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccLogTimestamp
+{
+private:
+	const std::chrono::steady_clock::time_point	m_steadyStart;
+	std::atomic<int64_t>		m_epochMicrosecondsBase;	// the system clock when the steady clock was m_steadyStart
+	std::atomic<int64_t>		m_lastSecond;
+	std::mutex					m_prefixMutex;
+	cpcc_string					m_prefix;
+
+	cpccLogTimestamp():
+		m_steadyStart(std::chrono::steady_clock::now()),
+		m_epochMicrosecondsBase(getSystemMicroseconds()),
+		m_lastSecond(-1)
+	{ }
+
+	cpccLogTimestamp(const cpccLogTimestamp& x) = delete;
+	cpccLogTimestamp& operator=(const cpccLogTimestamp& x) = delete;
+
+public:
+
+	static cpccLogTimestamp &getInstance(void)
+	{
+		static cpccLogTimestamp* _instPtr = NULL;
+		if (!_instPtr)
+			_instPtr = new cpccLogTimestamp;
+		return *_instPtr;
+	}
+
+	inline int64_t getMicrosecondsSinceStart(void) const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_steadyStart).count();
+	}
+
+	static int64_t getSystemMicroseconds(void)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	/// the microseconds since 1970 of the steady clock start, as of the last resync
+	inline int64_t getEpochMicrosecondsBase(void) const { return m_epochMicrosecondsBase.load(std::memory_order_relaxed); }
+
+	/// converts microseconds since the log started to microseconds since 1970
+	inline int64_t getEpochMicroseconds(const int64_t aMicrosecondsSinceStart) const { return getEpochMicrosecondsBase() + aMicrosecondsSinceStart; }
+
+	/// reads the system clock and moves the epoch base to it. Returns the current second since 1970.
+	/// The base moves only when the clocks differ by more than 1 ms, so that the jitter of the two reads does not move it every second.
+	int64_t resync(const int64_t aMicrosecondsSinceStart)
+	{
+		const int64_t systemMicroseconds = getSystemMicroseconds();
+		const int64_t drift = systemMicroseconds - getEpochMicroseconds(aMicrosecondsSinceStart);
+		if ((drift > 1000) || (drift < -1000))
+			m_epochMicrosecondsBase.store(systemMicroseconds - aMicrosecondsSinceStart, std::memory_order_relaxed);
+		return systemMicroseconds / 1000000;
+	}
+
+	/// returns true only for the first call (from any thread) in a new second.
+	/// The caller can then copy the date/time line with appendPrefix().
+	bool newSecondStarted(const int64_t aMicrosecondsSinceStart)
+	{
+		int64_t lastSecond = m_lastSecond.load(std::memory_order_relaxed);
+		if (getEpochMicroseconds(aMicrosecondsSinceStart) / 1000000 <= lastSecond)
+			return false;
+
+		// the steady clock says that a new second started. Ask the system clock which one.
+		const int64_t second = resync(aMicrosecondsSinceStart);
+		if (second == lastSecond)
+			return false;	// the system clock is behind the steady clock. The base now waits for it.
+		if (!m_lastSecond.compare_exchange_strong(lastSecond, second))
+			return false;	// another thread started the new second
+
+		std::lock_guard<std::mutex> lock(m_prefixMutex);
+		m_prefix.clear();
+		appendDateTime(m_prefix, static_cast<time_t>(second));
+		return true;
+	}
+
+	/// appends the date/time line of the current second, e.g. "     \t2020-03-15  13:44:04"
+	void appendPrefix(cpcc_string &aBuffer)
+	{
+		std::lock_guard<std::mutex> lock(m_prefixMutex);
+		aBuffer.append(m_prefix);
+	}
+
+	static void appendDateTime(cpcc_string &aBuffer, const time_t aSeconds)
+	{
+		struct tm timeStruct;
+		#ifdef _WIN32
+			localtime_s(&timeStruct, &aSeconds);
+		#else
+			localtime_r(&aSeconds, &timeStruct);
+		#endif
+		cpcc_char buffer[100];
+		// More information about date/time format
+		// http://www.cplusplus.com/reference/clibrary/ctime/strftime/
+		cpcc_strftime(buffer, sizeof(buffer) / sizeof(buffer[0]), _T("     \t%F  %X"), &timeStruct);
+		aBuffer.append(buffer);
+	}
+
+	/// appends the microseconds as seconds with 6 decimals, e.g. 12.000345
+	static void appendOffset(cpcc_string &aBuffer, const int64_t aMicroseconds)
+	{
+		cpccLogFormat::appendValue(aBuffer, aMicroseconds / 1000000);
+		aBuffer.push_back(_T('.'));
+		int64_t fraction = aMicroseconds % 1000000;
+		for (int64_t divider = 100000; divider > 0; divider /= 10)
+		{
+			aBuffer.push_back(static_cast<cpcc_char>(_T('0') + fraction / divider));
+			fraction %= divider;
+		}
+	}
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccLogTimestamp testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccLogTimestamp_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpcc_string offset;
+	cpccLogTimestamp::appendOffset(offset, 12000345);
+	TEST_EXPECT(offset.compare(_T("12.000345")) == 0, _T("#7263a: cpccLogTimestamp::appendOffset()"));
+
+	cpccLogTimestamp &timestamp = cpccLogTimestamp::getInstance();
+	const int64_t t1 = timestamp.getMicrosecondsSinceStart();
+	const int64_t t2 = timestamp.getMicrosecondsSinceStart();
+	TEST_EXPECT(t1 >= 0 && t2 >= t1, _T("#7263b: cpccLogTimestamp is not monotonic"));
+
+	// a second that has already been started must not start again
+	timestamp.newSecondStarted(t2);
+	TEST_EXPECT(!timestamp.newSecondStarted(t2), _T("#7263c: cpccLogTimestamp::newSecondStarted() twice for the same second"));
+
+	// the epoch base follows the system clock
+	const int64_t difference = timestamp.getEpochMicroseconds(timestamp.getMicrosecondsSinceStart()) - cpccLogTimestamp::getSystemMicroseconds();
+	TEST_EXPECT((difference < 1000000) && (difference > -1000000), _T("#7263d: cpccLogTimestamp differs from the system clock"));
+}
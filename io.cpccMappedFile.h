@@ -0,0 +1,323 @@
+/*  *****************************************
+ *  File:		io.cpccMappedFile.h
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				read-only memory mapped view of a file
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#else
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+#endif
+
+#if (__cplusplus >= 201703L) || (defined(_MSVC_LANG) && (_MSVC_LANG >= 201703L))
+	#include <string_view>
+	#define cpccMappedFile_HAS_STRING_VIEW
+#endif
+
+#include "cpccUnicodeSupport.h"
+#include "cpccTesting.h"
+#include "fs.cpccPathHelper.h"
+#include "fs.cpccUserFolders.h"
+
+/*
+	Usage:
+		cpccMappedFile file(_T("settings.ini"));
+		if (file.isOpen())
+			parse(file.data(), file.size());	// or file.begin(), file.end(), or file.view() with C++17
+
+	The view stays valid until close() or the destructor.
+	Regular files are mapped, so only the pages that are touched are read from the disk.
+	Empty files and special files (pipes, /proc etc.) cannot be mapped and are read into a buffer instead;
+	isMapped() tells which one happened. The data are not zero terminated.
+	The size is fixed when the file is opened: text appended later by another process is not in the view,
+	and on macOS/Linux truncating a file while it is mapped crashes the reader (SIGBUS).
+	So do not map files that another process may truncate, e.g. a log file: read them with fread() instead.
+*/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	class cpccMappedFile
+//
+///////////////////////////////////////////////////////////////////////////////
+class cpccMappedFile
+{
+public:
+	/// hints to the OS about how the view will be read (madvise() on macOS/Linux)
+	enum class tAccess { normal = 0, sequential, random, willNeed };
+
+private:
+	const char	*m_data = NULL;
+	size_t		m_size = 0;
+	bool		m_isOpen = false,
+				m_isMapped = false;
+	std::string	m_buffer;	// the data of files that could not be mapped
+
+#ifdef _WIN32
+	HANDLE		m_file = INVALID_HANDLE_VALUE,
+				m_mapping = NULL;
+#else
+	int			m_fd = -1;
+#endif
+
+	cpccMappedFile(const cpccMappedFile& x) = delete;
+	cpccMappedFile& operator=(const cpccMappedFile& x) = delete;
+
+public:
+	cpccMappedFile() { }
+
+	explicit cpccMappedFile(const cpcc_char *aFilename, const tAccess aAccess = tAccess::sequential) { open(aFilename, aAccess); }
+
+	~cpccMappedFile() { close(); }
+
+	bool open(const cpcc_char *aFilename, const tAccess aAccess = tAccess::sequential)
+	{
+		close();
+		if (!aFilename)
+			return false;
+		m_isOpen = openPlatform(aFilename, aAccess);
+		if (!m_isOpen)
+			close();
+		return m_isOpen;
+	}
+
+	void close(void)
+	{
+	#ifdef _WIN32
+		if (m_isMapped)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+		m_mapping = NULL;
+		m_file = INVALID_HANDLE_VALUE;
+	#else
+		if (m_isMapped)
+			munmap(const_cast<char *>(m_data), m_size);
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_fd = -1;
+	#endif
+		m_data = NULL;
+		m_size = 0;
+		m_isOpen = m_isMapped = false;
+		std::string().swap(m_buffer);
+	}
+
+	inline bool			isOpen(void) const { return m_isOpen; }
+	inline bool			isMapped(void) const { return m_isMapped; }
+	inline const char	*data(void) const { return m_data; }
+	inline size_t		size(void) const { return m_size; }
+	inline bool			empty(void) const { return m_size == 0; }
+	inline const char	*begin(void) const { return m_data; }
+	inline const char	*end(void) const { return m_data + m_size; }
+
+	std::string toString(void) const { return m_size ? std::string(m_data, m_size) : std::string(); }
+
+#ifdef cpccMappedFile_HAS_STRING_VIEW
+	inline std::string_view view(void) const { return std::string_view(m_data, m_size); }
+#endif
+
+	/// hint for a part of the view. aLength == 0 means up to the end.
+	void advise(const tAccess aAccess, const size_t aOffset = 0, const size_t aLength = 0) const
+	{
+		if (!m_isMapped || (aOffset >= m_size))
+			return;
+		const size_t length = ((aLength == 0) || (aLength > m_size - aOffset)) ? m_size - aOffset : aLength;
+	#ifdef _WIN32
+		#if defined(_WIN32_WINNT_WIN8) && (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+			if (aAccess == tAccess::willNeed)
+			{
+				WIN32_MEMORY_RANGE_ENTRY range = { const_cast<char *>(m_data + aOffset), length };
+				PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+			}
+		#else
+			(void) aAccess; (void) length;
+		#endif
+	#else
+		// madvise() needs a page aligned address
+		const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		const size_t start = aOffset - (aOffset % pageSize);
+		madvise(const_cast<char *>(m_data + start), length + (aOffset - start), toMadvise(aAccess));
+	#endif
+	}
+
+private:
+
+#ifdef _WIN32
+
+	bool openPlatform(const cpcc_char *aFilename, const tAccess aAccess)
+	{
+		const DWORD flags = FILE_ATTRIBUTE_NORMAL | ((aAccess == tAccess::sequential) ? FILE_FLAG_SEQUENTIAL_SCAN : 0) | ((aAccess == tAccess::random) ? FILE_FLAG_RANDOM_ACCESS : 0);
+		// the file may be open for writing by another process, e.g. a log file
+		m_file = CreateFile(aFilename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, flags, NULL);
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if ((GetFileType(m_file) == FILE_TYPE_DISK) && GetFileSizeEx(m_file, &fileSize) && (fileSize.QuadPart > 0))
+		{
+			if (static_cast<unsigned long long>(fileSize.QuadPart) > static_cast<unsigned long long>(SIZE_MAX))
+				return false;
+			m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+			const void *view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+			if (view)
+			{
+				m_data = static_cast<const char *>(view);
+				m_size = static_cast<size_t>(fileSize.QuadPart);
+				m_isMapped = true;
+				return true;
+			}
+		}
+		return readToBuffer();
+	}
+
+	bool readToBuffer(void)
+	{
+		char chunk[64 * 1024];
+		DWORD nRead = 0;
+		BOOL ok;
+		while ((ok = ReadFile(m_file, chunk, sizeof(chunk), &nRead, NULL)) && (nRead > 0))
+			m_buffer.append(chunk, nRead);
+		if (!ok && (GetLastError() != ERROR_BROKEN_PIPE))	// the end of a pipe
+			return false;
+		m_data = m_buffer.data();
+		m_size = m_buffer.size();
+		return true;
+	}
+
+#else
+
+	static int toMadvise(const tAccess aAccess)
+	{
+		switch (aAccess)
+		{
+			case tAccess::sequential:	return MADV_SEQUENTIAL;
+			case tAccess::random:		return MADV_RANDOM;
+			case tAccess::willNeed:		return MADV_WILLNEED;
+			default:					return MADV_NORMAL;
+		}
+	}
+
+	bool openPlatform(const cpcc_char *aFilename, const tAccess aAccess)
+	{
+		m_fd = ::open(aFilename, O_RDONLY);
+		if (m_fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(m_fd, &info) != 0)
+			return false;
+		if (S_ISREG(info.st_mode) && (info.st_size > 0))
+		{
+			if (static_cast<unsigned long long>(info.st_size) > static_cast<unsigned long long>(SIZE_MAX))
+				return false;
+			void *view = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, m_fd, 0);
+			if (view != MAP_FAILED)
+			{
+				m_data = static_cast<const char *>(view);
+				m_size = static_cast<size_t>(info.st_size);
+				m_isMapped = true;
+				if (aAccess != tAccess::normal)
+					advise(aAccess);
+				return true;
+			}
+		}
+		return readToBuffer();
+	}
+
+	bool readToBuffer(void)
+	{
+		char chunk[64 * 1024];
+		for (;;)
+		{
+			const ssize_t nRead = ::read(m_fd, chunk, sizeof(chunk));
+			if (nRead == 0)
+				break;
+			if (nRead < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;	// e.g. a folder
+			}
+			m_buffer.append(chunk, static_cast<size_t>(nRead));
+		}
+		m_data = m_buffer.data();
+		m_size = m_buffer.size();
+		return true;
+	}
+
+#endif
+};
+
+
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//		class cpccMappedFile testing
+//
+// /////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+TEST_RUN(cpccMappedFile_test)
+{
+	const bool skipThisTest = false;
+
+	if (skipThisTest)
+	{
+		TEST_ADDNOTE("Test skipped");
+		return;
+	}
+
+	cpcc_string fn(cpccUserFolders::getUsersTempDir());
+	cpccPathHelper::addTrailingPathDelimiter(fn);
+	fn.append(_T("cpccMappedFile_test.tmp"));
+	const char text[] = "cpccMappedFile test\nsecond line";
+	auto writeFile = [&fn](const char *aData, const size_t aLength)
+		{
+			#pragma warning(suppress : 4996)
+			FILE *fp = cpcc_fopen(fn.c_str(), _T("wb"));
+			if (fp)
+			{
+				fwrite(aData, 1, aLength, fp);
+				fclose(fp);
+			}
+		};
+	writeFile(text, sizeof(text) - 1);
+
+	cpccMappedFile file(fn.c_str());
+	TEST_EXPECT(file.isOpen() && file.isMapped(), _T("#7273a: cpccMappedFile did not map the file"));
+	TEST_EXPECT(file.toString().compare(text) == 0, _T("#7273b: cpccMappedFile data"));
+	file.advise(cpccMappedFile::tAccess::willNeed, 3, 5);
+	file.close();	// Windows cannot truncate a mapped file
+
+	writeFile("", 0);
+	file.open(fn.c_str());
+	TEST_EXPECT(file.isOpen() && !file.isMapped() && file.empty(), _T("#7273c: cpccMappedFile with an empty file"));
+
+	file.close();
+	cpcc_remove(fn.c_str());
+	TEST_EXPECT(!file.open(fn.c_str()) && (file.size() == 0), _T("#7273d: cpccMappedFile opened a missing file"));
+}
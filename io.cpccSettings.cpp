@@ -231,7 +231,8 @@ cpccSettings::cpccSettings(const settingsScope aScope):
 	
 cpccSettings::~cpccSettings()
 {
-	if (m_needsSaving)
+	disableAutoSave();
+	if (m_needsSaving || m_journalBytes)
 		if (!save())
 			cpcc_cerr << _T("Error #1352: saving cpccSettings to file:") << mFilename << std::endl;
 }
@@ -241,7 +242,10 @@ bool cpccSettings::load(void)
 {
     if (!cpccFileSystemMini::fileExists(mFilename.c_str()))
     {
-        clear();
+        m_map.clear();
+        if (replayJournal())
+            save();
+        ++m_generation;
         return true; // consider the INI loaded (empty file)
     }
         
@@ -257,7 +261,7 @@ bool cpccSettings::load(void)
     std::locale namedObject_loc = iniFile.imbue(my_utf8_locale); // namedObject_loc is  to suppress warning C26444
 
     // directly manipulate the map so that the save-to-file is not triggered
-    clear();
+    m_map.clear();
     cpcc_string key, value;
 
     // http://forums.codeguru.com/showthread.php?511066-RESOLVED-Is-it-possible-to-use-getline-with-unicode
@@ -273,6 +277,11 @@ bool cpccSettings::load(void)
         m_map[key] = value;
     }
 
+    // the file gets the changes of the journal, which is removed, so that the next record
+    // is not appended to a last record that was not written completely
+    if (replayJournal())
+        save();
+    ++m_generation;
     return true;
 
 }
@@ -294,38 +303,278 @@ std::string helper_to_utf8(const wchar_t* buffer, int len)
 #endif
 
 
-bool cpccSettings::save(void)
+cpcc_string cpccSettings::getFileText(void)
+{
+    const cpcc_string text(toFileText(getMap()));
+
+#ifdef DEBUG
+    cpcc_string test = serialize(_T("\n"), true, cSerialCodec::encode);
+    if (test.compare(text)!=0)
+        cpcc_cerr <<  _T("#9582: error in save() serialize*()") << std::endl;
+#endif
+    return text;
+}
+
+
+cpcc_string cpccSettings::toFileText(const tKeysAndValues &aMap)
 {
     cpcc_ostringstream ss;
 
     // for (cpccKeyValue::tKeysAndValues::const_iterator it = m_map.begin(); it != m_map.end(); ++it)
-    for (auto element : getMap())
+    // in the order of the keys, so that the file changes only where the values change
+    for (const auto element : cpccSortedElements(aMap))
     {
-        const cpcc_char* key = element.first.c_str();
-        cpcc_string    value = element.second; // todo: value( it->second);
+        const cpcc_char* key = element->first.c_str();
+        cpcc_string    value(element->second.getText());
         
         cSerialCodec::encode(value);
         ss << key << _T("=") << value << std::endl;
     }
+    return ss.str();
+}
 
-#ifdef DEBUG
-    cpcc_string test = serialize(_T("\n"), true, cSerialCodec::encode);
-    if (test.compare(ss.str())!=0)
-        cpcc_cerr <<  _T("#9582: error in save() serialize*()") << std::endl;
-#endif
-    
-#ifdef UNICODE	// write the BOM if UTF-8
-    //const cpcc_string tmpTxt(ss.str());
-    //const cpcc_string tmpTxtAfterUTF8(helper_to_utf8(tmpTxt.c_str(), tmpTxt.length()));
-    //return saveStringToFile(mFilename.c_str(), tmpTxtAfterUTF8.c_str(), true);
-    return cpccFileSystemMini::writeTextFile(mFilename.c_str(), ss.str().c_str(), true);
+
+#ifdef UNICODE	// write the text as UTF-8
+    static const bool settingsInUTF8 = true;
 #else
-    return cpccFileSystemMini::writeTextFile(mFilename.c_str(), ss.str().c_str(), false);
+    static const bool settingsInUTF8 = false;
 #endif
-    
+
+
+bool cpccSettings::save(void)
+{
+    if (m_autoSave)
+        return flush();
+
+    if (!cpccFileSystemMini::writeTextFile(mFilename.c_str(), getFileText().c_str(), settingsInUTF8, m_durableSaving))
+        return false;
+    // the file now has all the changes of the journal
+    removeJournal();
+    return true;
+}
+
+
+bool cpccSettings::save(cpccAtomicFileGroup &aGroup)
+{
+    return aGroup.addText(mFilename.c_str(), getFileText().c_str(), settingsInUTF8);
+}
+
+
+
+/*
+    The journal has one line per change, in the encoding of the file:
+        +key=encoded value      the key was set
+        -key=                   the key was removed
+    A line without its '\n' was not written completely, e.g. because of a crash, and is ignored.
+*/
+bool cpccSettings::appendToJournal(const cpcc_char* aKey, const cpccTypedValue* aValue)
+{
+    if (!m_journal)
+    {
+        const cpcc_string journalFilename(getJournalFilename());
+        #pragma warning(suppress : 4996)
+        m_journal = cpcc_fopen(journalFilename.c_str(), _T("ab"));
+        cpccStatCache::getInstance().invalidate(journalFilename.c_str());
+        if (!m_journal)
+            return false;
+    }
+
+    cpcc_string record(aValue ? _T("+") : _T("-"));
+    record.append(aKey).append(_T("="));
+    if (aValue)
+    {
+        cpcc_string value(aValue->getText());
+        cSerialCodec::encode(value);
+        record.append(value);
+    }
+    record.append(_T("\n"));
+
+    // flushed at once, so that the change survives a crash of the application
+    const std::string bytes(cpccAtomicFileGroup::textToBytes(record.c_str(), settingsInUTF8));
+    if ((fwrite(bytes.data(), 1, bytes.size(), m_journal) != bytes.size()) || (fflush(m_journal) != 0))
+        return false;
+    m_journalBytes += bytes.size();
+    return true;
+}
+
+
+/// returns true if there was a journal
+bool cpccSettings::replayJournal(void)
+{
+    const cpcc_string journalFilename(getJournalFilename());
+    if (!cpccFileSystemMini::fileExists(journalFilename.c_str()))
+        return false;
+
+    cpcc_ifstream journal(journalFilename);
+    std::locale my_utf8_locale(std::locale(), new std::codecvt_utf8<wchar_t>);
+    std::locale namedObject_loc = journal.imbue(my_utf8_locale); // namedObject_loc is  to suppress warning C26444
+
+    cpcc_string record;
+    while (getline(journal, record))
+    {
+        if (journal.eof())
+            break;  // the last record was not written completely
+        const cpcc_string::size_type separator = record.find(_T('='));
+        if ((record.length() < 2) || (separator == cpcc_string::npos))
+            continue;
+        const cpcc_string key(record.substr(1, separator - 1));
+        if (record[0] == _T('+'))
+        {
+            cpcc_string value(record.substr(separator + 1));
+            cSerialCodec::decode(value);
+            m_map[key] = value;
+        }
+        else if (record[0] == _T('-'))
+            m_map.erase(key);
+    }
+
+    // so that the next save() deletes the journal
+    const long long journalSize = cpccFileSystemMini::getFileSize(journalFilename.c_str());
+    m_journalBytes += (journalSize > 0) ? static_cast<size_t>(journalSize) : 1;
+    return true;
+}
+
+
+void cpccSettings::removeJournal(void)
+{
+    if (m_journal)
+        fclose(m_journal);
+    m_journal = NULL;
+    if (m_journalBytes)
+        cpccFileSystemMini::deleteFile(getJournalFilename().c_str());
+    m_journalBytes = 0;
+}
+
+
+void cpccSettings::enableAutoSave(const unsigned int aDelayMsec)
+{
+    if (m_autoSave)
+        return;
+    m_autoSave.reset(new tAutoSave);
+    m_autoSave->delay = std::chrono::milliseconds(aDelayMsec);
+    m_autoSave->savedMap = getMap();
+    if (m_needsSaving || m_journalBytes)
+    {   // e.g. changes while instant saving was paused, or a journal from a crash
+        m_autoSave->nChanges = 1;
+        m_autoSave->due = std::chrono::steady_clock::now();
+    }
+    m_autoSave->thread = std::thread(&cpccSettings::autoSaveThreadFunction, this);
 }
 
 
+void cpccSettings::disableAutoSave(void)
+{
+    if (!m_autoSave)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_autoSave->mutex);
+        m_autoSave->stop = true;
+    }
+    m_autoSave->wakeUp.notify_all();
+    m_autoSave->thread.join();
+    if (m_autoSave->nSaved == m_autoSave->nChanges)
+        m_needsSaving = false;
+    m_autoSave.reset();
+}
+
+
+bool cpccSettings::flush(void)
+{
+    if (!m_autoSave)
+        return (m_needsSaving || m_journalBytes) ? save() : true;
+
+    tAutoSave &autoSave = *m_autoSave;
+    std::unique_lock<std::mutex> lock(autoSave.mutex);
+    const uint64_t target = autoSave.nChanges;
+    if (autoSave.nSaved < target)
+    {
+        autoSave.flushRequested = true;
+        autoSave.wakeUp.notify_all();
+        autoSave.wakeUp.wait(lock, [&autoSave, target]() { return (autoSave.nSaved >= target) || (!autoSave.flushRequested && (autoSave.nAttempted >= target)); });
+    }
+    if (autoSave.nSaved < target)
+        return false;
+    m_needsSaving = false;
+    return true;
+}
+
+
+// called by the thread that changed the settings. It does not touch the disk.
+void cpccSettings::scheduleAutoSave(const cpcc_char* aKey, const cpccTypedValue* aValue, const bool aAllChanged)
+{
+    tAutoSave &autoSave = *m_autoSave;
+    bool wasIdle;
+    {
+        std::lock_guard<std::mutex> lock(autoSave.mutex);
+        if (aAllChanged)
+        {
+            autoSave.pendingMap = getMap();
+            autoSave.pendingAll = true;
+            autoSave.pendingKeys.clear();
+        }
+        else if (aKey)
+            autoSave.pendingKeys[aKey] = std::make_pair(aValue == NULL, aValue ? *aValue : cpccTypedValue());
+        wasIdle = (autoSave.nSaved == autoSave.nChanges);
+        ++autoSave.nChanges;
+        autoSave.due = std::chrono::steady_clock::now() + autoSave.delay;
+    }
+    if (wasIdle)
+        autoSave.wakeUp.notify_all();   // else the thread is already waiting for the due time, which it reads again
+}
+
+
+void cpccSettings::autoSaveThreadFunction(void)
+{
+    tAutoSave &autoSave = *m_autoSave;
+    std::unique_lock<std::mutex> lock(autoSave.mutex);
+    for (;;)
+    {
+        const bool hasChanges = (autoSave.nSaved < autoSave.nChanges);
+        if (autoSave.stop && (!hasChanges || (autoSave.nAttempted == autoSave.nChanges)))
+            break;
+        if (!hasChanges)
+        {
+            autoSave.flushRequested = false;
+            autoSave.wakeUp.wait(lock);
+            continue;
+        }
+        if (!autoSave.stop && !autoSave.flushRequested && (std::chrono::steady_clock::now() < autoSave.due))
+        {
+            autoSave.wakeUp.wait_until(lock, autoSave.due);
+            continue;
+        }
+
+        // take the changes, and write them without holding the lock
+        if (autoSave.pendingAll)
+            autoSave.savedMap.swap(autoSave.pendingMap);
+        for (const auto &change : autoSave.pendingKeys)
+            if (change.second.first)
+                autoSave.savedMap.erase(change.first);
+            else
+                autoSave.savedMap[change.first] = change.second.second;
+        autoSave.pendingKeys.clear();
+        autoSave.pendingMap.clear();
+        autoSave.pendingAll = false;
+        autoSave.flushRequested = false;
+        const uint64_t nChanges = autoSave.nChanges;
+        lock.unlock();
+
+        const bool saved = cpccFileSystemMini::writeTextFile(mFilename.c_str(), toFileText(autoSave.savedMap).c_str(), settingsInUTF8, m_durableSaving);
+        if (saved)
+            removeJournal();    // a journal from before enableAutoSave()
+        else
+            cpcc_cerr << _T("Error #1354: saving cpccSettings to file:") << mFilename << std::endl;
+
+        lock.lock();
+        autoSave.nAttempted = nChanges;
+        if (saved)
+            autoSave.nSaved = nChanges;
+        else
+            autoSave.due = std::chrono::steady_clock::now() + std::chrono::seconds(1);  // try again later
+        autoSave.wakeUp.notify_all();
+    }
+}
+
 
 void cpccSettings::resumeInstantSaving(void)
 {
@@ -21,12 +21,22 @@
 #include <assert.h>
 #include <sstream>
 #include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
 #include "core.cpccIdeMacros.h"
 #include "cpccUnicodeSupport.h"
 #include "core.cpccKeyValue.h"
 #include "cpccTesting.h"
 #include "fs.cpccPathHelper.h"
 #include "io.cpccFileSystemMini.h"
+#include "fs.cpccAtomicFile.h"
 
 /** A small and portable (cross platform) C++ class 
 	to save/load application settings from an INI-like file
@@ -70,10 +80,42 @@
 //
 // //////////////////////////////////////////////////////////////////////////////
 
-class cpccSettings: public cpccKeyValue
+class cpccSettings: public cpccKeyValueFlat
 {
 private:
     cpcc_string 	mFilename;
+    size_t          m_maxJournalBytes = 0;  // 0: the journal is off
+    size_t          m_journalBytes = 0;
+    FILE            *m_journal = NULL;
+    bool            m_durableSaving = false;
+
+    // the state of enableAutoSave(), shared with its thread
+    struct tAutoSave
+    {
+        std::mutex                              mutex;
+        std::condition_variable                 wakeUp;
+        std::thread                             thread;
+        std::chrono::milliseconds               delay;
+        std::chrono::steady_clock::time_point   due;
+        tKeysAndValues                          savedMap,       // owned by the thread: the keys of the file
+                                                pendingMap;     // a copy of all the keys, after clear() etc.
+        bool                                    pendingAll = false;
+        std::map<cpcc_string, std::pair<bool, cpccTypedValue>> pendingKeys;  // key -> (removed, value)
+        uint64_t                                nChanges = 0,
+                                                nSaved = 0,     // the changes that are in the file
+                                                nAttempted = 0; // the changes that the last save tried to write
+        bool                                    flushRequested = false,
+                                                stop = false;
+    };
+    std::unique_ptr<tAutoSave>  m_autoSave;
+
+    cpcc_string     getFileText(void);
+    static cpcc_string toFileText(const tKeysAndValues &aMap);
+    void            autoSaveThreadFunction(void);
+    void            scheduleAutoSave(const cpcc_char* aKey, const cpccTypedValue* aValue, const bool aAllChanged);
+    bool            appendToJournal(const cpcc_char* aKey, const cpccTypedValue* aValue);
+    bool            replayJournal(void);
+    void            removeJournal(void);
 
 public:	// class metadata and selftest
 	enum class settingsScope { scopeCurrentUser=0, scopeAllUsers };
@@ -96,14 +138,39 @@ public:		// functions
 
     virtual void dataHasChanged(void) override;
 
+    /// instant saving appends each changed key to the file getJournalFilename(), instead of rewriting the whole file.
+    /// The whole file is rewritten (compacted) when the journal grows over aMaxJournalBytes, by save() and by the destructor.
+    /// load() applies a journal that was left by a crash, and saves the file with its changes.
+    void        enableJournal(const size_t aMaxJournalBytes = 64 * 1024) { m_maxJournalBytes = aMaxJournalBytes ? aMaxJournalBytes : 1; }
+    cpcc_string getJournalFilename(void) const { return mFilename + _T(".journal"); }
+
+    /// the file is always replaced atomically. Durable saving also waits until the disk has it,
+    /// so that it survives a power loss (see cpccAtomicFileGroup). Call it before enableAutoSave().
+    void        enableDurableSaving(const bool aDurable = true) { m_durableSaving = aDurable; }
+
+    /// set() only records the change, and a background thread saves the file aDelayMsec after the last change,
+    /// so that a burst of changes is one write and set() never waits for the disk.
+    /// flush(), save() and the destructor save the pending changes at once. The journal is not used in this mode.
+    void        enableAutoSave(const unsigned int aDelayMsec = 250);
+    /// saves the pending changes and stops the thread
+    void        disableAutoSave(void);
+    inline bool isAutoSaving(void) const { return m_autoSave != nullptr; }
+    /// saves the pending changes now, and waits until they are saved
+    bool        flush(void);
+
 	cpcc_string getFilename(void) const { return mFilename; }
 	
 	bool		load(void);
 	bool		save(void);
+	/// adds the file to a group of files that are saved together with one sync of the disk. See fs.cpccAtomicFile.h
+	bool		save(cpccAtomicFileGroup &aGroup);
 
 	void		pauseInstantSaving(void) { instantSaving = false; }
 	void		resumeInstantSaving(void);
 
+protected:
+    virtual void keyHasChanged(const cpcc_char* aKey, const cpccTypedValue* aValue) override;
+
 };
 
 // //////////////////////////////////////////////////////////////////////////////
@@ -116,6 +183,11 @@ public:		// functions
 inline void cpccSettings::dataHasChanged(void)
 {
     m_needsSaving = true;
+    if (m_autoSave)
+    {
+        scheduleAutoSave(NULL, NULL, true);
+        return;
+    }
     if (!instantSaving)
         return;
 
@@ -126,6 +198,27 @@ inline void cpccSettings::dataHasChanged(void)
 }
 
 
+inline void cpccSettings::keyHasChanged(const cpcc_char* aKey, const cpccTypedValue* aValue)
+{
+    if (m_autoSave)
+    {
+        m_needsSaving = true;
+        scheduleAutoSave(aKey, aValue, false);
+        return;
+    }
+
+    // without the journal, or if it cannot be written, the whole file is saved
+    if (!m_maxJournalBytes || !instantSaving || !appendToJournal(aKey, aValue))
+    {
+        dataHasChanged();
+        return;
+    }
+
+    if (m_journalBytes > m_maxJournalBytes)
+        dataHasChanged();   // compacts the journal into the file
+}
+
+
 
 
 // /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -134,6 +227,8 @@ inline void cpccSettings::dataHasChanged(void)
 //
 // /////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Several threads can read the same variable. As with cpccSettings, the settings must not be changed
+// while other threads read them.
 template <typename T>
 class cpccPersistentVar
 {
@@ -142,26 +237,60 @@ private:
 	 cpcc_string	mKey;
      const T		mDefaultValue;
 
-	const cpcc_string createIndexedKey(const int index) const
+     // the value as it was read at the generation mCachedGeneration of the settings (0: not read yet).
+     // mCachedValue is written only under mRefillMutex, before mCachedGeneration is published.
+     mutable T                      mCachedValue;
+     mutable std::atomic<uint64_t>  mCachedGeneration;
+     mutable std::mutex             mRefillMutex;
+
+	// mKey followed by the index, in a buffer of the calling thread that keeps its memory between the calls
+	const cpcc_char *createIndexedKey(const int index) const
 	{
-		cpcc_ostringstream s;
-		s << mKey << index;
-		return cpcc_string(s.str());
+		static thread_local cpcc_string _indexedKey;
+		_indexedKey.assign(mKey);
+		unsigned int magnitude = (index < 0) ? 0u - static_cast<unsigned int>(index) : static_cast<unsigned int>(index);
+		if (index < 0)
+			_indexedKey.push_back(_T('-'));
+		const size_t firstDigit = _indexedKey.length();
+		do
+		{
+			_indexedKey.push_back(static_cast<cpcc_char>(_T('0') + magnitude % 10));
+			magnitude /= 10;
+		} while (magnitude);
+		std::reverse(_indexedKey.begin() + firstDigit, _indexedKey.end());
+		return _indexedKey.c_str();
+	}
+
+	inline T getCachedValue(void) const
+	{
+		const uint64_t generation = mIniRef.getGeneration();
+		if (mCachedGeneration.load(std::memory_order_acquire) != generation)
+		{
+			std::lock_guard<std::mutex> lock(mRefillMutex);
+			if (mCachedGeneration.load(std::memory_order_relaxed) != generation)	// else another thread refilled it meanwhile
+			{
+				mCachedValue = mIniRef.get(mKey.c_str(), mDefaultValue);
+				mCachedGeneration.store(generation, std::memory_order_release);
+			}
+		}
+		return mCachedValue;
 	}
        
 public:
     explicit cpccPersistentVar(cpccSettings &aIniPtr, const cpcc_char *aKey, const T aDefaultValue):
             mIniRef(aIniPtr),
             mKey(aKey),
-            mDefaultValue(aDefaultValue)
+            mDefaultValue(aDefaultValue),
+            mCachedValue(aDefaultValue),
+            mCachedGeneration(0)
 	{ }
 
-    // get value
-    inline const T getValue(void) const     { return mIniRef.get(mKey.c_str(), mDefaultValue); }
-	inline  operator const T(void) const     { return mIniRef.get(mKey.c_str(), mDefaultValue); }
+    // get value. The value is read from the settings again only if they have changed
+    inline const T getValue(void) const     { return getCachedValue(); }
+	inline  operator const T(void) const     { return getCachedValue(); }
 	// T read(void) const { return mIniRef.read(mKey.c_str(), mDefaultValue); }
 	// T readAtIndex(const int index) const { return mIniRef.read(createIndexedKey(index).c_str(), mDefaultValue); }
-	inline const T operator[](const int index) const { return mIniRef.get(createIndexedKey(index).c_str(), mDefaultValue); }
+	inline const T operator[](const int index) const { return mIniRef.get(createIndexedKey(index), mDefaultValue); }
 
     // set value
     inline void setValue(const T &aValue)	{ mIniRef.set(mKey.c_str(), aValue); }
@@ -169,7 +298,7 @@ public:
 	// void operator=(T &aValue)	const { mIniRef.write(mKey.c_str(), aValue); } // try a non-const version
 	void operator=(const T &aValue)	const { mIniRef.set(mKey.c_str(), aValue); }
 	//void write(const T aValue) const { mIniRef.write(mKey.c_str(), aValue); }
-	void writeAtIndex(const int index, const T aValue) { mIniRef.set(createIndexedKey(index).c_str(), aValue); }
+	void writeAtIndex(const int index, const T aValue) { mIniRef.set(createIndexedKey(index), aValue); }
 };
 
 
@@ -311,3 +440,137 @@ TEST_RUN(cpccSettings_testNew)
     // cpccFileSystemMini::deleteFolder(folderCurrentUser.c_str());
     // cpccFileSystemMini::deleteFolder(folderAllUsers.c_str());
 }
+
+
+TEST_RUN(cpccSettings_journalTest)
+{
+    const bool skipThisTest = false;
+
+    if (skipThisTest)
+    {
+        TEST_ADDNOTE("Test skipped");
+        return;
+    }
+
+    const cpcc_string fn(cpccFileSystemMini::getTempFilename() + _T(".ini"));
+    const cpcc_string journalFn(fn + _T(".journal"));
+
+    // the file and the journal that a crash left behind. The last record is not complete.
+    cpccFileSystemMini::writeTextFile(fn.c_str(), _T("a=1\nb=2\n"), true);
+    cpccFileSystemMini::writeTextFile(journalFn.c_str(), _T("+b=3\n-a=\n+c=x\\ny\n+d=torn"), true);
+    {
+        cpccSettings settings(fn.c_str());
+        TEST_EXPECT(!settings.keyExists(_T("a")) && (settings.get(_T("b"), _T("")) == _T("3")) && (settings.get(_T("c"), _T("")) == _T("x\ny")) && !settings.keyExists(_T("d")), _T("#7278a: cpccSettings did not replay the journal"));
+
+        // the next record starts a new journal, instead of continuing the torn record
+        settings.enableJournal(200);
+        settings.set(_T("f"), _T("6"));
+        TEST_EXPECT(cpccFileSystemMini::getFileSize(journalFn.c_str()) == static_cast<long long>(cpccAtomicFileGroup::textToBytes(_T("+f=6\n"), true).size()), _T("#7278f: cpccSettings appended to the torn record of the journal"));
+
+        settings.save();
+        TEST_EXPECT(!cpccFileSystemMini::fileExists(journalFn.c_str()), _T("#7278b: cpccSettings::save() did not remove the journal"));
+
+        settings.set(_T("e"), _T("5"));
+        settings.removeKey(_T("b"));
+        TEST_EXPECT(cpccFileSystemMini::fileExists(journalFn.c_str()) && (cpccFileSystemMini::getFileSize(journalFn.c_str()) == static_cast<long long>(cpccAtomicFileGroup::textToBytes(_T("+e=5\n-b=\n"), true).size())), _T("#7278c: cpccSettings journal records"));
+
+        for (int i = 0; i < 30; ++i)
+            settings.set(_T("counter"), i);
+        TEST_EXPECT(cpccFileSystemMini::getFileSize(journalFn.c_str()) <= 200 + 16, _T("#7278d: cpccSettings did not compact the journal"));
+    }
+
+    cpccSettings settings(fn.c_str());
+    TEST_EXPECT(!cpccFileSystemMini::fileExists(journalFn.c_str()) && (settings.get(_T("e"), 0) == 5) && (settings.get(_T("counter"), 0) == 29) && !settings.keyExists(_T("b")), _T("#7278e: cpccSettings after the journal was compacted"));
+
+    cpccFileSystemMini::deleteFile(fn.c_str());
+}
+
+
+TEST_RUN(cpccSettings_autoSaveTest)
+{
+    const bool skipThisTest = false;
+
+    if (skipThisTest)
+    {
+        TEST_ADDNOTE("Test skipped");
+        return;
+    }
+
+    const cpcc_string fn(cpccFileSystemMini::getTempFilename() + _T(".ini"));
+    {
+        cpccSettings settings(fn.c_str());
+        settings.enableAutoSave(60 * 1000);
+        for (int i = 0; i < 100; ++i)
+            settings.set((cpcc_string(_T("key")) + cpcc_to_string(i)).c_str(), i);
+        TEST_EXPECT(settings.isAutoSaving() && !cpccFileSystemMini::fileExists(fn.c_str()), _T("#7279a: cpccSettings auto save wrote before the delay"));
+
+        TEST_EXPECT(settings.flush() && (cpccSettings(fn.c_str()).getCount() == 100), _T("#7279b: cpccSettings::flush()"));
+
+        settings.removeKey(_T("key0"));
+        settings.set(_T("key1"), _T("changed"));
+    }
+    {
+        cpccSettings settings(fn.c_str());
+        TEST_EXPECT((settings.getCount() == 99) && (settings.get(_T("key1"), _T("")) == _T("changed")), _T("#7279c: cpccSettings auto save in the destructor"));
+
+        settings.enableAutoSave(20);
+        settings.clear();
+        settings.set(_T("last"), 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        TEST_EXPECT(cpccSettings(fn.c_str()).getCount() == 1, _T("#7279d: cpccSettings auto save after the delay"));
+    }
+
+    cpccFileSystemMini::deleteFile(fn.c_str());
+}
+
+
+TEST_RUN(cpccPersistentVar_cacheTest)
+{
+    const bool skipThisTest = false;
+
+    if (skipThisTest)
+    {
+        TEST_ADDNOTE("Test skipped");
+        return;
+    }
+
+    const cpcc_string fn(cpccFileSystemMini::getTempFilename() + _T(".ini"));
+    {
+        cpccSettings settings(fn.c_str());
+        settings.pauseInstantSaving();
+        cpccPersistentVar<int> width(settings, _T("width"), 640);
+        TEST_EXPECT(width == 640, _T("#7282a: cpccPersistentVar default value"));
+
+        const uint64_t generation = settings.getGeneration();
+        settings.set(_T("width"), 800);
+        TEST_EXPECT((settings.getGeneration() != generation) && (width == 800), _T("#7282b: cpccPersistentVar did not see set()"));
+        settings.set(_T("width"), 800);     // the same value: no change
+        TEST_EXPECT(width.getValue() == 800, _T("#7282c: cpccPersistentVar after set() of the same value"));
+
+        settings.loadFromSimpleString(_T("width=1024\nwidth-3=7\nwidth12=5"));
+        TEST_EXPECT((width == 1024) && (width[-3] == 7) && (width[12] == 5) && (width[1] == 640), _T("#7282d: cpccPersistentVar after loadFromSimpleString()"));
+
+        settings.removeKey(_T("width"));
+        TEST_EXPECT(width == 640, _T("#7282e: cpccPersistentVar did not see removeKey()"));
+
+        width.writeAtIndex(2, 3);
+        TEST_EXPECT(settings.get(_T("width2"), 0) == 3, _T("#7282f: cpccPersistentVar::writeAtIndex()"));
+
+        // several threads read the variable after a change, and refill its cache at the same time
+        settings.set(_T("width"), 1280);
+        std::atomic<int> nWrongValues(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t)
+            readers.emplace_back([&width, &nWrongValues]()
+                {
+                    for (int i = 0; i < 10000; ++i)
+                        if ((width != 1280) || (width[2] != 3))
+                            ++nWrongValues;
+                });
+        for (auto &reader : readers)
+            reader.join();
+        TEST_EXPECT(nWrongValues == 0, _T("#7284: cpccPersistentVar read by several threads"));
+    }
+    cpccFileSystemMini::deleteFile(fn.c_str());
+}
+
@@ -0,0 +1,95 @@
+/*  *****************************************
+ *  File:		data.cpccKeyValueBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of the containers of cpccKeyValueStr: std::map and cpccFlatHashMap
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccKeyValueBenchmark [number of keys]
+
+	With keys like the keys of a settings or translation file ("window.main.column12.width"), 5000 by default, times:
+		insert			set() of all the keys in an empty container
+		lookup			get() of every key, 20 times, with a const TCHAR * as the callers have it
+		miss			keyExists() of keys that are not there
+	for the containers:
+		std::map		cpccKeyValueSortedMap, that makes a temporary string for each lookup
+		flat hash map	cpccKeyValueFlatMap
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -O2 -I.. data.cpccKeyValueBenchmark.cpp -o cpccKeyValueBenchmark
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "../core.cpccKeyValue.h"
+
+
+typedef std::chrono::steady_clock tClock;
+
+static double nsecPer(const tClock::time_point aStart, const size_t aCount)
+{
+	return std::chrono::duration<double, std::nano>(tClock::now() - aStart).count() / aCount;
+}
+
+
+template <typename tContainer>
+static void timeIt(const char *aName, const std::vector<cpcc_string> &aKeys, const std::vector<cpcc_string> &aMissingKeys)
+{
+	const int lookupRounds = 20;
+	cpccKeyValueT<tContainer> keyValue;
+	long long sum = 0;
+
+	auto start = tClock::now();
+	for (size_t i = 0; i < aKeys.size(); ++i)
+		keyValue.set(aKeys[i].c_str(), static_cast<int>(i));
+	const double insertNsec = nsecPer(start, aKeys.size());
+
+	start = tClock::now();
+	for (int round = 0; round < lookupRounds; ++round)
+		for (const auto &key : aKeys)
+			sum += keyValue.get(key.c_str(), 0);
+	const double lookupNsec = nsecPer(start, aKeys.size() * lookupRounds);
+
+	start = tClock::now();
+	for (int round = 0; round < lookupRounds; ++round)
+		for (const auto &key : aMissingKeys)
+			sum += keyValue.keyExists(key.c_str()) ? 1 : 0;
+	const double missNsec = nsecPer(start, aMissingKeys.size() * lookupRounds);
+
+	printf("%-14s insert %7.1f ns   lookup %7.1f ns   miss %7.1f ns   (%lld)\n", aName, insertNsec, lookupNsec, missNsec, sum);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const int nKeys = (argc > 1) ? atoi(argv[1]) : 5000;
+	std::vector<cpcc_string> keys, missingKeys;
+	for (int i = 0; i < nKeys; ++i)
+	{
+		const cpcc_string number(cpcc_to_string(i));
+		keys.push_back(cpcc_string(_T("window.main.column")) + number + _T(".width"));
+		missingKeys.push_back(cpcc_string(_T("window.main.column")) + number + _T(".height"));
+	}
+	// the lookups are not in the order of the inserts
+	srand(1);
+	for (size_t i = keys.size(); i > 1; --i)
+		std::swap(keys[i - 1], keys[rand() % i]);
+
+	printf("%d keys\n", nKeys);
+	timeIt<cpccKeyValueSortedMap>("std::map", keys, missingKeys);
+	timeIt<cpccKeyValueFlatMap>("flat hash map", keys, missingKeys);
+	return 0;
+}
@@ -0,0 +1,187 @@
+/*  *****************************************
+ *  File:		fs.cpccAtomicFileBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of cpccAtomicFile: speed, and files left by a crash
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccAtomicFileBenchmark <folder> [number of files] [file size]
+
+	Saves the files (20 files of 4 KB by default) in the folder with:
+		in place			fopen("wb") and fwrite(), as writeTextFile() did before
+		atomic				cpccAtomicFile::replace(), aDurable = false
+		atomic + sync		cpccAtomicFile::replace(), aDurable = true, one file at a time
+		group + sync		one cpccAtomicFileGroup for all the files
+	macOS/Linux: it then kills (SIGKILL) a child process that keeps saving a 256 KB file, 200 times,
+	and counts how often the file was left empty or half written. This shows crashes of the application,
+	not power losses.
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -O2 -I.. fs.cpccAtomicFileBenchmark.cpp -o cpccAtomicFileBenchmark -lpthread
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#ifndef _WIN32
+	#include <signal.h>
+	#include <sys/wait.h>
+#endif
+
+#include "../fs.cpccAtomicFile.h"
+
+
+static std::vector<cpcc_string> filenames;
+static std::string data;
+
+
+static bool saveInPlace(const cpcc_string &aFilename, const std::string &aData)
+{
+	#pragma warning(suppress : 4996)
+	FILE *fp = cpcc_fopen(aFilename.c_str(), _T("wb"));
+	if (!fp)
+		return false;
+	const bool ok = (fwrite(aData.data(), 1, aData.size(), fp) == aData.size());
+	return (fclose(fp) == 0) && ok;
+}
+
+
+template <typename tFunction>
+static void timeIt(const char *aName, tFunction aFunction)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const bool ok = aFunction();
+	const double msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%-16s %8.2f ms for %u files %8.3f ms per file%s\n", aName, msec, static_cast<unsigned int>(filenames.size()), msec / filenames.size(), ok ? "" : "  (failed)");
+}
+
+
+#ifndef _WIN32
+
+// the file must contain one full version: aSize times the same letter
+static bool isWhole(const cpcc_string &aFilename, const size_t aSize)
+{
+	std::string content(aSize + 1, '\0');
+	FILE *fp = fopen(aFilename.c_str(), "rb");
+	if (!fp)
+		return false;
+	const size_t n = fread(&content[0], 1, content.size(), fp);
+	fclose(fp);
+	return (n == aSize) && (content.find_first_not_of(content[0], 0) >= aSize);
+}
+
+
+static unsigned int countTornFiles(const cpcc_string &aFilename, const bool aAtomic)
+{
+	const size_t size = 256 * 1024;
+	const int rounds = 200;
+	unsigned int torn = 0;
+	saveInPlace(aFilename, std::string(size, 'a'));
+	for (int round = 0; round < rounds; ++round)
+	{
+		const pid_t child = fork();
+		if (child == 0)
+		{
+			for (char letter = 'a'; ; letter = (letter == 'z') ? 'a' : letter + 1)
+			{
+				const std::string version(size, letter);
+				if (aAtomic)
+					cpccAtomicFile::replace(aFilename.c_str(), version.data(), version.size(), false);
+				else
+					saveInPlace(aFilename, version);
+			}
+		}
+		usleep(1000 + (rand() % 5000));
+		kill(child, SIGKILL);
+		waitpid(child, NULL, 0);
+		if (!isWhole(aFilename, size))
+		{
+			++torn;
+			saveInPlace(aFilename, std::string(size, 'a'));
+		}
+	}
+	// the temporary files of the killed processes
+	const cpcc_string prefix(cpccPathHelper::extractFilename(aFilename) + _T("."));
+	const cpcc_string folder(cpccPathHelper::getParentFolderOf(aFilename.c_str()));
+	for (const auto &entry : cpccDirectoryIterator::list(folder.c_str()))
+		if ((entry.name.compare(0, prefix.length(), prefix) == 0) && cpccDirectoryWalker::endsWith(entry.name, _T(".tmp")))
+			cpccFileSystem::deleteFile(cpccDirectoryWalker::joinPath(folder, entry.name).c_str());
+
+	printf("%-16s %u of %d crashes left a broken file\n", aAtomic ? "atomic" : "in place", torn, rounds);
+	return torn;
+}
+
+#endif
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <folder> [number of files] [file size]\n", argv[0]);
+		return 1;
+	}
+	const int nFiles = (argc > 2) ? atoi(argv[2]) : 20;
+	data.assign((argc > 3) ? atoi(argv[3]) : 4096, 'x');
+
+#if defined(_WIN32) && defined(UNICODE)
+	const cpcc_string folder(wchar_from_char(argv[1]).get());
+#else
+	const cpcc_string folder(argv[1]);
+#endif
+	cpccFileSystemMini::createFolder(folder.c_str());
+	for (int i = 0; i < nFiles; ++i)
+		filenames.push_back(folder + _T("/file") + cpcc_to_string(i) + _T(".ini"));
+
+	timeIt("in place", []()
+		{
+			bool ok = true;
+			for (const auto &fn : filenames)
+				ok = saveInPlace(fn, data) && ok;
+			return ok;
+		});
+	timeIt("atomic", []()
+		{
+			bool ok = true;
+			for (const auto &fn : filenames)
+				ok = cpccAtomicFile::replace(fn.c_str(), data.data(), data.size(), false) && ok;
+			return ok;
+		});
+	timeIt("atomic + sync", []()
+		{
+			bool ok = true;
+			for (const auto &fn : filenames)
+				ok = cpccAtomicFile::replace(fn.c_str(), data.data(), data.size()) && ok;
+			return ok;
+		});
+	timeIt("group + sync", []()
+		{
+			cpccAtomicFileGroup group;
+			for (const auto &fn : filenames)
+				group.add(fn.c_str(), data);
+			return group.commit();
+		});
+
+#ifndef _WIN32
+	const cpcc_string crashFile(folder + _T("/crash.ini"));
+	countTornFiles(crashFile, false);
+	countTornFiles(crashFile, true);
+	cpccFileSystem::deleteFile(crashFile.c_str());
+#endif
+
+	for (const auto &fn : filenames)
+		cpccFileSystem::deleteFile(fn.c_str());
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*  *****************************************
+ *  File:		fs.cpccFileCopyBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of cpccFileCopy against the old 4KB stdio loop
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccFileCopyBenchmark <folder> [max MB]
+
+	Creates test files of 1MB, 100MB and 2GB in the folder (only those not above max MB)
+	and copies each one with:
+		kernel		cpccFileCopy::copy()
+		buffered	cpccFileCopy::copyBuffered() with its 1MB buffer
+		stdio 4KB	the loop that copyFileToaFile() used before
+	The page cache is warm after the first copy, so the numbers compare the copy paths, not the disk.
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -O2 -I.. fs.cpccFileCopyBenchmark.cpp -o cpccFileCopyBenchmark
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "../fs.cpccFileCopy.h"
+
+
+static bool copyWithStdio4K(const cpcc_char *aSourceFile, const cpcc_char *aDestFile)
+{
+	#pragma warning(suppress : 4996)
+	FILE *source = cpcc_fopen(aSourceFile, _T("rb"));
+	if (!source)
+		return false;
+	#pragma warning(suppress : 4996)
+	FILE *dest = cpcc_fopen(aDestFile, _T("wb"));
+	if (!dest)
+	{
+		fclose(source);
+		return false;
+	}
+	char buf[4096];
+	size_t size;
+	bool errorOccured = false;
+	while ((!errorOccured) && (size = fread(buf, 1, sizeof(buf), source)))
+		errorOccured = (fwrite(buf, 1, size, dest) != size);
+	fclose(source);
+	return (fclose(dest) == 0) && !errorOccured;
+}
+
+
+static bool createTestFile(const cpcc_char *aFilename, const unsigned long long aBytes)
+{
+	#pragma warning(suppress : 4996)
+	FILE *f = cpcc_fopen(aFilename, _T("wb"));
+	if (!f)
+		return false;
+	std::vector<char> block(1024 * 1024);
+	for (size_t i = 0; i < block.size(); ++i)
+		block[i] = static_cast<char>(rand());
+	bool ok = true;
+	for (unsigned long long written = 0; ok && (written < aBytes); written += block.size())
+		ok = (fwrite(block.data(), 1, block.size(), f) == block.size());
+	return (fclose(f) == 0) && ok;
+}
+
+
+template <typename tFunction>
+static double timeMsec(tFunction aFunction, bool &aOk)
+{
+	const auto start = std::chrono::steady_clock::now();
+	aOk = aFunction();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <folder> [max MB]\n", argv[0]);
+		return 1;
+	}
+	const unsigned long long maxMB = (argc > 2) ? strtoull(argv[2], NULL, 10) : 2048;
+
+#if defined(_WIN32) && defined(UNICODE)
+	const cpcc_string folder(wchar_from_char(argv[1]).get());
+#else
+	const cpcc_string folder(argv[1]);
+#endif
+	const cpcc_string source(folder + _T("/cpccFileCopyBenchmark.src")), dest(folder + _T("/cpccFileCopyBenchmark.dst"));
+
+	const unsigned long long sizesMB[] = { 1, 100, 2048 };
+	printf("%10s %14s %14s %14s\n", "size", "kernel", "buffered", "stdio 4KB");
+	for (const auto sizeMB : sizesMB)
+	{
+		if (sizeMB > maxMB)
+			continue;
+		if (!createTestFile(source.c_str(), sizeMB * 1024 * 1024))
+		{
+			fprintf(stderr, "cannot create the %lluMB test file\n", sizeMB);
+			return 2;
+		}
+
+		// several rounds for the small file, to get above the timer resolution
+		const int rounds = (sizeMB < 10) ? 20 : 1;
+		double msec[3] = { 0, 0, 0 };
+		bool ok = true, allOk = true;
+		for (int round = 0; round < rounds; ++round)
+		{
+			msec[0] += timeMsec([&]() { return cpccFileCopy::copy(source.c_str(), dest.c_str()); }, ok);
+			allOk = allOk && ok;
+			msec[1] += timeMsec([&]() { return cpccFileCopy::copyBuffered(source.c_str(), dest.c_str()); }, ok);
+			allOk = allOk && ok;
+			msec[2] += timeMsec([&]() { return copyWithStdio4K(source.c_str(), dest.c_str()); }, ok);
+			allOk = allOk && ok;
+		}
+
+		const double mb = static_cast<double>(sizeMB);
+		printf("%8lluMB", sizeMB);
+		for (const double m : msec)
+			printf(" %9.1f MB/s", mb * rounds / (m / 1000.0));
+		printf("%s\n", allOk ? "" : "  (a copy failed)");
+
+		cpccFileSystem::deleteFile(dest.c_str());
+	}
+	cpccFileSystem::deleteFile(source.c_str());
+	return 0;
+}
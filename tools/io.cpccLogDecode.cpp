@@ -0,0 +1,86 @@
+/*  *****************************************
+ *  File:		io.cpccLogDecode.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line decoder of the binary log (.cpccLog.bin) to the text lines of the text log
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccLogDecode <binary log> [text file]
+
+	The binary log is the .cpccLog.bin file that is written next to the text log
+	when cpccLogManager::initialize() is called with cpccLogOutputFormat::binary.
+	The lines are the same as the text mode writes (see cpccBinaryLogDecoder).
+	Without a text file, they are written to the standard output.
+	Decode the file on the same kind of machine that wrote it (the byte order and the size of cpcc_char are native).
+	The exit code is 0 on success, 1 for wrong arguments or files and 2 if the binary log is not valid or is truncated.
+	In the last case the lines before the damaged record are still written.
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -I.. io.cpccLogDecode.cpp -o cpccLogDecode
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "../io.cpccLogBinary.h"
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <binary log> [text file]\n", argv[0]);
+		return 1;
+	}
+
+	if (argc > 2)
+	{
+	#if defined(_WIN32) && defined(UNICODE)
+		const cpcc_string binaryFilename(wchar_from_char(argv[1]).get()), textFilename(wchar_from_char(argv[2]).get());
+	#else
+		const cpcc_string binaryFilename(argv[1]), textFilename(argv[2]);
+	#endif
+		if (cpccBinaryLogDecoder::decodeFile(binaryFilename.c_str(), textFilename.c_str()))
+			return 0;
+		fprintf(stderr, "%s: could not decode %s to %s\n", argv[0], argv[1], argv[2]);
+		return 2;
+	}
+
+	#pragma warning(suppress : 4996)
+	FILE *fp = fopen(argv[1], "rb");
+	if (!fp)
+	{
+		fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[1]);
+		return 1;
+	}
+	std::string bytes;
+	char buffer[64 * 1024];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		bytes.append(buffer, n);
+	fclose(fp);
+
+	cpcc_string text;
+	const bool decodedOk = cpccBinaryLogDecoder::decode(bytes, text);
+#ifdef UNICODE
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	const std::string utf8(converter.to_bytes(text));
+#else
+	const std::string &utf8 = text;
+#endif
+	fwrite(utf8.data(), 1, utf8.size(), stdout);
+
+	if (decodedOk)
+		return 0;
+	fprintf(stderr, "%s: %s is not a binary log or it is truncated\n", argv[0], argv[1]);
+	return 2;
+}
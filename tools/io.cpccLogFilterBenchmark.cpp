@@ -0,0 +1,79 @@
+/*  *****************************************
+ *  File:		io.cpccLogFilterBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of the log calls that are filtered out by cpccLogFilter
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccLogFilterBenchmark [number of calls]
+
+	Makes 100000000 log calls by default, of a level that is filtered out, and prints the ns per call of:
+		cpccLOG				cpccLOG(debug).fmt() below the default threshold
+		cpccLOG_MODULE		cpccLOG_MODULE(module, debug).fmt() of a module that is off
+		infoLog().fmt		infoLog().fmt() below the default threshold
+		infoLog().addf		infoLog().addf() below the default threshold
+	and how many times the argument of the call was evaluated. The target is under 2 ns for the macros.
+	Nothing is written, so the log is not initialized.
+	Build it as a separate console program and link it with io.cpccLog.cpp and the cpcc sources it needs, e.g.
+		c++ -std=c++11 -O2 -pthread -I.. io.cpccLogFilterBenchmark.cpp ../io.cpccLog.cpp ... -o cpccLogFilterBenchmark
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "../io.cpccLog.h"
+
+
+typedef std::chrono::steady_clock tClock;
+
+static cpccLogModule benchmarkModule(_T("benchmark"));
+static int nEvaluations = 0;
+
+static int expensiveArgument(const int i)
+{
+	++nEvaluations;
+	return i;
+}
+
+
+template <typename tFunc>
+static void timeIt(const char *aName, const int nCalls, tFunc aFunc)
+{
+	nEvaluations = 0;
+	const auto start = tClock::now();
+	for (int i = 0; i < nCalls; ++i)
+		aFunc(i);
+	const double nsecPerCall = std::chrono::duration<double, std::nano>(tClock::now() - start).count() / nCalls;
+	printf("%-16s %6.2f ns/call   %s   argument evaluated %d times\n", aName, nsecPerCall, (nsecPerCall < 2.0) ? "under 2 ns" : "over 2 ns ", nEvaluations);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const int nCalls = (argc > 1) ? atoi(argv[1]) : 100000000;
+	if (nCalls <= 0)
+	{
+		printf("Usage: cpccLogFilterBenchmark [number of calls]\n");
+		return 1;
+	}
+
+	cpccLogFilter::getInstance().configure(_T("warning,benchmark=off"));
+	printf("%d calls\n", nCalls);
+
+	timeIt("cpccLOG", nCalls, [](const int i) { cpccLOG(debug).fmt(_T("value={}"), expensiveArgument(i)); });
+	timeIt("cpccLOG_MODULE", nCalls, [](const int i) { cpccLOG_MODULE(benchmarkModule, debug).fmt(_T("value={}"), expensiveArgument(i)); });
+	timeIt("infoLog().fmt", nCalls, [](const int i) { infoLog().fmt(_T("value={}"), expensiveArgument(i)); });
+	timeIt("infoLog().addf", nCalls, [](const int i) { infoLog().addf("value=%d", expensiveArgument(i)); });
+	return 0;
+}
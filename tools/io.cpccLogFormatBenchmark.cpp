@@ -0,0 +1,157 @@
+/*  *****************************************
+ *  File:		io.cpccLogFormatBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of the formatting of the log messages: addf(), toString() and fmt()
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccLogFormatBenchmark [number of calls]
+
+	Formats the same messages, 1000000 times by default, and prints the ns per call and the heap allocations per call of:
+		toString	cpccLogFormatter::toString(): vsnprintf into an 8000 chars stack buffer, returned as a new string
+		addf		cpccLogFormatter::addf(): vsnprintf into an 8000 chars stack buffer, copied into the line
+		fmt			cpccLogFormatter::fmt(): cpccLogFormat::format() into the buffer of the thread
+	Every message is appended to a line buffer that is reused, as cpccLogFormatter::write() does,
+	so only the formatting is measured, not the writing.
+	The allocations are counted by replacing the global operator new.
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -O2 -I.. io.cpccLogFormatBenchmark.cpp -o cpccLogFormatBenchmark
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <string>
+#include <chrono>
+#include <new>
+
+#include "../io.cpccLogFormat.h"
+
+
+static size_t nAllocations = 0;
+
+void *operator new(size_t aSize)
+{
+	++nAllocations;
+	if (void *p = malloc(aSize ? aSize : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+
+typedef std::chrono::steady_clock tClock;
+enum { MAX_LOG_STRING = 8000 };	// as in io.cpccLog.cpp
+
+
+// as cpccLogFormatter::toString()
+static std::string toStringf(const char *format, ...)
+{
+	char buff[MAX_LOG_STRING + 1];
+	va_list args;
+	va_start(args, format);
+	#pragma warning(suppress : 4996)
+	vsnprintf(buff, MAX_LOG_STRING, format, args);
+	va_end(args);
+	return buff;
+}
+
+
+// as cpccLogFormatter::addf() and writef(), up to the line of write()
+static void addf(std::string &aLine, const char *format, ...)
+{
+	char buff[MAX_LOG_STRING + 1];
+	va_list args;
+	va_start(args, format);
+	#pragma warning(suppress : 4996)
+	vsnprintf(buff, MAX_LOG_STRING, format, args);
+	va_end(args);
+	aLine.append(buff);
+}
+
+
+struct tResult
+{
+	double	nsecPerCall;
+	double	allocationsPerCall;
+	size_t	length;		// so that the compiler keeps the work
+};
+
+
+template <typename tFunc>
+static tResult timeIt(const int nCalls, tFunc aFunc)
+{
+	tResult result = { 0, 0, 0 };
+	for (int i = 0; i < 100; ++i)	// the buffers reach their capacity
+		result.length += aFunc(i);
+
+	const size_t allocationsBefore = nAllocations;
+	const auto start = tClock::now();
+	for (int i = 0; i < nCalls; ++i)
+		result.length += aFunc(i);
+	result.nsecPerCall = std::chrono::duration<double, std::nano>(tClock::now() - start).count() / nCalls;
+	result.allocationsPerCall = static_cast<double>(nAllocations - allocationsBefore) / nCalls;
+	return result;
+}
+
+
+static void printResult(const char *aMessage, const char *aMethod, const tResult &aResult)
+{
+	printf("%-24s %-9s %8.1f ns/call   %5.2f allocations/call   (%zu)\n", aMessage, aMethod, aResult.nsecPerCall, aResult.allocationsPerCall, aResult.length);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const int nCalls = (argc > 1) ? atoi(argv[1]) : 1000000;
+	if (nCalls <= 0)
+	{
+		printf("Usage: cpccLogFormatBenchmark [number of calls]\n");
+		return 1;
+	}
+
+	std::string line;		// addf() formats chars
+	cpcc_string fmtLine;
+	line.reserve(cpccLogFormat::initialBufferCapacity);
+	fmtLine.reserve(cpccLogFormat::initialBufferCapacity);
+	const std::string name("settings.ini");
+	const cpcc_string fmtName(_T("settings.ini"));
+	const double seconds = 0.125;
+
+	printf("%d calls\n", nCalls);
+
+	printResult("2 integers", "toString", timeIt(nCalls, [&](const int i) { line.clear(); line.append(toStringf("x=%d y=%d", i, -i)); return line.length(); }));
+	printResult("2 integers", "addf", timeIt(nCalls, [&](const int i) { line.clear(); addf(line, "x=%d y=%d", i, -i); return line.length(); }));
+	printResult("2 integers", "fmt", timeIt(nCalls, [&](const int i)
+		{
+			cpcc_string &buffer = cpccLogFormat::threadBuffer();
+			buffer.clear();
+			cpccLogFormat::format(buffer, _T("x={} y={}"), i, -i);
+			fmtLine.clear(); fmtLine.append(buffer);
+			return fmtLine.length();
+		}));
+
+	printResult("text, integer, double", "toString", timeIt(nCalls, [&](const int i) { line.clear(); line.append(toStringf("saved %s: %d keys in %g sec", name.c_str(), i, seconds)); return line.length(); }));
+	printResult("text, integer, double", "addf", timeIt(nCalls, [&](const int i) { line.clear(); addf(line, "saved %s: %d keys in %g sec", name.c_str(), i, seconds); return line.length(); }));
+	printResult("text, integer, double", "fmt", timeIt(nCalls, [&](const int i)
+		{
+			cpcc_string &buffer = cpccLogFormat::threadBuffer();
+			buffer.clear();
+			cpccLogFormat::format(buffer, _T("saved {}: {} keys in {} sec"), fmtName, i, seconds);
+			fmtLine.clear(); fmtLine.append(buffer);
+			return fmtLine.length();
+		}));
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*  *****************************************
+ *  File:		io.cpccLogRingBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of the staging of the log lines in async mode: mutex queue and per-thread rings
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccLogRingBenchmark [log calls per thread]
+
+	With 1, 4, 16 and 64 threads that log at the same time, 20000 calls per thread by default,
+	prints the percentiles of the latency of one log call (the time the calling thread spends to stage the line) for:
+		mutex queue		the staging before the rings: a bounded std::deque behind a mutex,
+						as cpccLogFileWriterWithBuffer::addToQueue()
+		thread rings	cpccLogThreadRing of the calling thread, as cpccLogFileWriterWithBuffer::addToThisThreadRing()
+	A consumer thread empties the staging every millisecond, as the writer thread does, but it does not write a file,
+	so the numbers are only the cost of the staging. The latencies include the ~20 ns of reading the clock.
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -O2 -pthread -I.. io.cpccLogRingBenchmark.cpp -o cpccLogRingBenchmark
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "../io.cpccLogThreadBuffers.h"
+
+
+typedef std::chrono::steady_clock tClock;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 	the two stagings, with the same interface
+//
+///////////////////////////////////////////////////////////////////////////////
+class tMutexQueue
+{
+private:
+	std::deque<cpcc_string>	m_queue;
+	const size_t			m_maxQueuedLines = 10000;
+	std::mutex				m_mutex;
+	std::condition_variable	m_hasRoom;
+	size_t					m_nBytes = 0;	// of the drained lines, only for the consumer
+
+public:
+	void add(const cpcc_char *txt)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_hasRoom.wait(lock, [this] { return m_queue.size() < m_maxQueuedLines; });
+		m_queue.emplace_back(txt);
+	}
+
+	void drain(void)
+	{
+		std::deque<cpcc_string> batch;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			batch.swap(m_queue);
+		}
+		m_hasRoom.notify_all();
+		for (const auto &line : batch)
+			m_nBytes += line.length();
+	}
+
+	size_t getDrainedBytes(void) const { return m_nBytes; }
+};
+
+
+class tThreadRings
+{
+private:
+	cpccLogThreadRings	m_rings;
+	std::mutex			m_consumerMutex;	// only one consumer at a time, as the file lock of the writer
+	size_t				m_nBytes = 0;		// of the drained lines, guarded by m_consumerMutex
+
+public:
+	void add(const cpcc_char *txt)
+	{
+		cpccLogThreadRing *ring = m_rings.getThisThreadRing();
+		while (!ring->push(txt))
+			drain();	// the ring is full: empty it from this thread
+	}
+
+	void drain(void)
+	{
+		std::lock_guard<std::mutex> lock(m_consumerMutex);
+		m_rings.drainAll([this](const cpcc_string &line) { m_nBytes += line.length(); });
+	}
+
+	size_t getDrainedBytes(void) const { return m_nBytes; }
+};
+
+
+template <typename tStaging>
+static void timeIt(const char *aName, const int nThreads, const int nCallsPerThread)
+{
+	tStaging staging;
+	std::atomic<bool> stopConsumer(false);
+	std::thread consumer([&]()
+		{
+			while (!stopConsumer)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				staging.drain();
+			}
+		});
+
+	std::vector<std::vector<double>> latencies(nThreads);
+	std::vector<std::thread> producers;
+	for (int t = 0; t < nThreads; ++t)
+		producers.emplace_back([&staging, &latencies, t, nCallsPerThread]()
+			{
+				const cpcc_string line(_T("12:00:00 Info. [worker] processed the request of the client, id=12345\n"));
+				std::vector<double> &threadLatencies = latencies[t];
+				threadLatencies.reserve(nCallsPerThread);
+				for (int i = 0; i < nCallsPerThread; ++i)
+				{
+					const auto start = tClock::now();
+					staging.add(line.c_str());
+					threadLatencies.push_back(std::chrono::duration<double, std::nano>(tClock::now() - start).count());
+				}
+			});
+	for (auto &producer : producers)
+		producer.join();
+	stopConsumer = true;
+	consumer.join();
+	staging.drain();
+
+	std::vector<double> all;
+	for (const auto &threadLatencies : latencies)
+		all.insert(all.end(), threadLatencies.begin(), threadLatencies.end());
+	std::sort(all.begin(), all.end());
+	auto percentile = [&all](const double p) { return all[static_cast<size_t>(p * (all.size() - 1))]; };
+
+	printf("%3d threads  %-13s p50 %8.0f ns   p90 %8.0f ns   p99 %8.0f ns   p99.9 %9.0f ns   max %10.0f ns   (%zu bytes)\n",
+		nThreads, aName, percentile(0.50), percentile(0.90), percentile(0.99), percentile(0.999), all.back(), staging.getDrainedBytes());
+}
+
+
+int main(int argc, char *argv[])
+{
+	const int nCallsPerThread = (argc > 1) ? atoi(argv[1]) : 20000;
+	if (nCallsPerThread <= 0)
+	{
+		printf("Usage: cpccLogRingBenchmark [log calls per thread]\n");
+		return 1;
+	}
+
+	printf("%d log calls per thread, %u hardware threads\n", nCallsPerThread, std::thread::hardware_concurrency());
+	const int threadCounts[] = { 1, 4, 16, 64 };
+	for (const int nThreads : threadCounts)
+	{
+		timeIt<tMutexQueue>("mutex queue", nThreads, nCallsPerThread);
+		timeIt<tThreadRings>("thread rings", nThreads, nCallsPerThread);
+	}
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*  *****************************************
+ *  File:		io.cpccLogTail.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line viewer of the live log tap of a running application
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccLogTail <tap name> [-n]
+
+	The tap name is the appNameStem given to cpccLogManager::initialize(), after cpccLogManager::setLiveTap().
+	-n	show only the new lines, instead of starting from the oldest text in the ring.
+
+	The tool waits for the application to start and attaches again when the application restarts.
+	Build it as a separate console program, e.g.
+		c++ -std=c++11 -I.. io.cpccLogTail.cpp -o cpccLogTail		(add -lrt on older Linux)
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "../io.cpccLogLiveTap.h"
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <tap name> [-n]\n", argv[0]);
+		return 1;
+	}
+
+#if defined(_WIN32) && defined(UNICODE)
+	const cpcc_string tapName(wchar_from_char(argv[1]).get());
+#else
+	const cpcc_string tapName(argv[1]);
+#endif
+	bool fromTheEnd = (argc > 2) && (strcmp(argv[2], "-n") == 0);
+
+	cpccLogLiveTapReader reader;
+	std::string text;
+	int idleMsec = 0;
+	uint64_t closedSessionId = 0;
+	for (;;)
+	{
+		if (!reader.isAttached())
+		{
+			if (!reader.attach(tapName.c_str(), fromTheEnd) || (reader.isClosed() && (reader.getSessionId() == closedSessionId)))
+			{
+				reader.detach();
+				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+				continue;
+			}
+			fprintf(stderr, "-- attached to %s\n", argv[1]);
+			fromTheEnd = false;	// after a restart, show the new run from its beginning
+		}
+
+		text.clear();
+		uint64_t lostBytes = 0;
+		const bool closed = reader.isClosed();	// before reading, so that the last lines are not missed
+		if (reader.read(text, &lostBytes) > 0)
+			idleMsec = 0;
+		if (lostBytes > 0)
+			fprintf(stdout, "-- %llu bytes were overwritten before they could be shown\n", static_cast<unsigned long long>(lostBytes));
+		fwrite(text.data(), 1, text.size(), stdout);
+		fflush(stdout);
+
+		if (closed)
+		{
+			fprintf(stderr, "-- the application closed the log\n");
+			closedSessionId = reader.getSessionId();
+			reader.detach();
+			continue;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		// the application may have crashed and started again, with a new tap under the same name
+		idleMsec += 50;
+		if (idleMsec >= 2000)
+		{
+			idleMsec = 0;
+			cpccLogLiveTapReader probe;
+			if (probe.attach(tapName.c_str()) && (probe.getSessionId() != reader.getSessionId()))
+				reader.detach();
+		}
+	}
+}
@@ -0,0 +1,81 @@
+/*  *****************************************
+ *  File:		io.cpccSettingsJournalBenchmark.cpp
+ *	Purpose:	Portable (cross-platform), light-weight library
+ *				command line benchmark of cpccSettings instant saving: whole file, journal and auto save
+ *	*****************************************
+ *  Library:	Cross Platform C++ Classes (cpcc)
+ *  Copyright: 	2020 StarMessage software.
+ *  License: 	Free for opensource projects.
+ *  			Commercial license for closed source projects.
+ *	Web:		http://www.StarMessageSoftware.com/cpcclibrary
+ *				https://github.com/starmessage/cpcc
+ *	email:		sales -at- starmessage.info
+ *	*****************************************
+ */
+
+/*
+	Usage:
+		cpccSettingsJournalBenchmark <folder> [number of keys]
+
+	Sets the keys (1000 by default) one by one, with instant saving, in a new INI file:
+		whole file		every set() rewrites the whole file (the default)
+		journal			every set() appends one record to the journal; enableJournal() with the default size
+		auto save		every set() records the change; enableAutoSave() with the default delay.
+						"set()" is the time of the set() calls, "total" includes the flush() of the destructor
+	Build it as a separate console program together with io.cpccSettings.cpp and io.cpccFileSystemMini.cpp
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "../io.cpccSettings.h"
+
+
+enum class tMode { wholeFile, journal, autoSave };
+
+static void timeIt(const char *aName, const cpcc_string &aFilename, const int aKeys, const tMode aMode)
+{
+	typedef std::chrono::steady_clock tClock;
+	cpccFileSystemMini::deleteFile(aFilename.c_str());
+	const auto start = tClock::now();
+	tClock::time_point setsEnd;
+	{
+		cpccSettings settings(aFilename.c_str());
+		if (aMode == tMode::journal)
+			settings.enableJournal();
+		if (aMode == tMode::autoSave)
+			settings.enableAutoSave();
+		for (int i = 0; i < aKeys; ++i)
+			settings.set((cpcc_string(_T("key")) + cpcc_to_string(i)).c_str(), cpcc_string(_T("a value of the key number ")) + cpcc_to_string(i));
+		setsEnd = tClock::now();
+	}	// the destructor compacts the journal, or saves the pending changes
+	const double msecSets = std::chrono::duration<double, std::milli>(setsEnd - start).count();
+	const double msec = std::chrono::duration<double, std::milli>(tClock::now() - start).count();
+	printf("%-12s set() %8.2f us   total %9.1f ms for %d keys\n", aName, msecSets * 1000.0 / aKeys, msec, aKeys);
+	cpccFileSystemMini::deleteFile(aFilename.c_str());
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <folder> [number of keys]\n", argv[0]);
+		return 1;
+	}
+	const int nKeys = (argc > 2) ? atoi(argv[2]) : 1000;
+
+#if defined(_WIN32) && defined(UNICODE)
+	const cpcc_string folder(wchar_from_char(argv[1]).get());
+#else
+	const cpcc_string folder(argv[1]);
+#endif
+	const cpcc_string filename(folder + _T("/cpccSettingsJournalBenchmark.ini"));
+
+	timeIt("whole file", filename, nKeys, tMode::wholeFile);
+	timeIt("journal", filename, nKeys, tMode::journal);
+	timeIt("auto save", filename, nKeys, tMode::autoSave);
+	return 0;
+}